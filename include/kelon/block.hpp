@@ -0,0 +1,127 @@
+
+#ifndef KELON_BLOCK_H
+#define KELON_BLOCK_H
+
+#include <cstddef>
+
+#include <kelon/simd.hpp>
+
+namespace kelon {
+
+/// Most frames a voice renders per pass of its stages. Longer blocks are
+/// rendered in chunks, so scratch buffers have a fixed size whatever the
+/// block size.
+const unsigned int CHUNK_FRAMES = 256;
+/// Alignment of scratch buffers: a cache line, which suits every vector
+/// width `simd` targets.
+const std::size_t SCRATCH_ALIGNMENT = 64;
+
+/**
+ * Scratch buffers a voice renders a chunk into, one stage at a time: each
+ * stage is a tight loop over the chunk, which the compiler can vectorize,
+ * and the mono result is panned into the output by `panAccumulate`, or
+ * across a speaker layout by `SpatialGains`.
+ *
+ * Each thread rendering voices has its own (see `scratch`).
+ */
+struct Scratch {
+    /// Mono output of the voice.
+    alignas(SCRATCH_ALIGNMENT) float mono[CHUNK_FRAMES];
+    /// Output of a single stage, such as an oscillator or an envelope.
+    alignas(SCRATCH_ALIGNMENT) float stage[CHUNK_FRAMES];
+    /// Gain of each frame towards the left channel.
+    alignas(SCRATCH_ALIGNMENT) float left[CHUNK_FRAMES];
+    /// Gain of each frame towards the right channel.
+    alignas(SCRATCH_ALIGNMENT) float right[CHUNK_FRAMES];
+};
+
+/// Scratch buffers of the calling thread.
+Scratch &scratch();
+
+/// Set `frames` samples to zero.
+inline void clear(float *const out, const unsigned int frames) {
+    for (unsigned int i = 0; i < frames; i++) {
+        out[i] = 0.f;
+    }
+}
+
+/// Fill `out` with a linear ramp starting at `start` and changing by `step`
+/// per frame.
+inline void ramp(float *const out, const unsigned int frames,
+                 const float start, const float step) {
+    for (unsigned int i = 0; i < frames; i++) {
+        out[i] = start + float(i) * step;
+    }
+}
+
+/// Add `in`, scaled by a linear ramp starting at `start` and changing by
+/// `step` per frame, to `out`.
+inline void accumulateRamp(float *const out, const float *const in,
+                           const unsigned int frames, const float start,
+                           const float step) {
+    for (unsigned int i = 0; i < frames; i++) {
+        out[i] += in[i] * (start + float(i) * step);
+    }
+}
+
+/// Add `in`, scaled by a fixed gain, to `out`.
+inline void accumulate(float *const out, const float *const in,
+                       const unsigned int frames, const float gain) {
+    const simd::vfloat vectorGain = simd::set(gain);
+    unsigned int i = 0;
+    for (; i + simd::WIDTH <= frames; i += simd::WIDTH) {
+        simd::store(out + i,
+                    simd::add(simd::load(out + i),
+                              simd::mul(simd::load(in + i), vectorGain)));
+    }
+    for (; i < frames; i++) {
+        out[i] += in[i] * gain;
+    }
+}
+
+/// Add `mono`, scaled by each frame's left and right gains, to the left and
+/// right channels.
+inline void panAccumulate(const float *const mono, const float *const gainsLeft,
+                          const float *const gainsRight,
+                          const unsigned int frames, float *const left,
+                          float *const right) {
+    unsigned int i = 0;
+    for (; i + simd::WIDTH <= frames; i += simd::WIDTH) {
+        const simd::vfloat sample = simd::load(mono + i);
+        simd::store(left + i,
+                    simd::add(simd::load(left + i),
+                              simd::mul(sample, simd::load(gainsLeft + i))));
+        simd::store(right + i,
+                    simd::add(simd::load(right + i),
+                              simd::mul(sample, simd::load(gainsRight + i))));
+    }
+    for (; i < frames; i++) {
+        left[i] += mono[i] * gainsLeft[i];
+        right[i] += mono[i] * gainsRight[i];
+    }
+}
+
+/// Add `mono`, scaled by fixed left and right gains, to the left and right
+/// channels.
+inline void panAccumulate(const float *const mono, const float gainLeft,
+                          const float gainRight, const unsigned int frames,
+                          float *const left, float *const right) {
+    const simd::vfloat vectorLeft = simd::set(gainLeft);
+    const simd::vfloat vectorRight = simd::set(gainRight);
+    unsigned int i = 0;
+    for (; i + simd::WIDTH <= frames; i += simd::WIDTH) {
+        const simd::vfloat sample = simd::load(mono + i);
+        simd::store(left + i, simd::add(simd::load(left + i),
+                                        simd::mul(sample, vectorLeft)));
+        simd::store(right + i, simd::add(simd::load(right + i),
+                                         simd::mul(sample, vectorRight)));
+    }
+    for (; i < frames; i++) {
+        left[i] += mono[i] * gainLeft;
+        right[i] += mono[i] * gainRight;
+    }
+}
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,59 @@
+
+#ifndef KELON_CONTROL_H
+#define KELON_CONTROL_H
+
+#include <cstddef>
+
+namespace kelon {
+
+/// Largest number of frames between control-rate updates.
+const unsigned int MAX_CONTROL_PERIOD = 256;
+
+/// Number of frames between control-rate updates.
+unsigned int controlPeriod();
+/// Set the number of frames between control-rate updates. Clamped to
+/// [1, `MAX_CONTROL_PERIOD`]. Safe to call from any thread.
+void controlPeriod(const unsigned int frames);
+
+/**
+ * Three-segment linear envelope evaluated at control rate. Instead of
+ * producing a value every sample, the envelope is advanced by whole control
+ * periods, and callers ramp linearly between the values it returns.
+ */
+class ControlEnvelope {
+public:
+    /// Number of segments.
+    static const std::size_t SEGMENTS = 3;
+
+    /// Set the level at each breakpoint.
+    void levels(const float (&l)[SEGMENTS + 1]);
+    /// Set the length of each segment, in frames.
+    void lengths(const float attack, const float decay, const float release);
+
+    /// Restart the envelope from its first breakpoint.
+    void reset();
+    /// Advance the envelope by `frames` frames and return its new value.
+    float advance(const float frames);
+
+    /// Current value.
+    float value() const { return current; }
+    /// Whether the first segment has ended.
+    bool decaying() const { return segment > 0; }
+    /// Whether the last segment has ended.
+    bool done() const { return segment == SEGMENTS; }
+
+private:
+    float breakpoints[SEGMENTS + 1] = {0.f, 0.f, 0.f, 0.f};
+    float segmentLengths[SEGMENTS] = {0.f, 0.f, 0.f};
+
+    /// Current segment.
+    std::size_t segment = SEGMENTS;
+    /// Frames elapsed in the current segment.
+    float position = 0.f;
+    /// Current value.
+    float current = 0.f;
+};
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,72 @@
+
+#ifndef KELON_CULL_H
+#define KELON_CULL_H
+
+#include <atomic>
+#include <cstdint>
+
+#include <al/io/al_AudioIOData.hpp>
+
+namespace kelon {
+
+/// Level below which anything is culled, however quiet the mix, in dBFS.
+const float ABSOLUTE_CULL_FLOOR = -120.f;
+
+/**
+ * Decides when partials and voices are too quiet to hear. The mix level is
+ * tracked from rendered blocks, and anything more than `threshold` dB below
+ * it is considered masked. Voices compare their gains against `floor`, drop
+ * masked partials and free themselves once they are masked as a whole.
+ *
+ * Every member may be called from any thread.
+ */
+class Culler {
+public:
+    Culler();
+
+    /// Set the masking threshold in dB relative to the mix level.
+    void threshold(const float db);
+    /// Get the masking threshold in dB relative to the mix level.
+    float threshold() const {
+        return thresholdDb.load(std::memory_order_relaxed);
+    }
+
+    /// Update the mix level from every channel of a rendered block.
+    void measure(const al::AudioIOData &io);
+    /// Smoothed peak level of the mix.
+    float level() const { return mixLevel.load(std::memory_order_relaxed); }
+
+    /// Linear amplitude below which a partial or voice is inaudible.
+    float floor() const { return cullFloor.load(std::memory_order_relaxed); }
+
+    /// Count a partial dropped from a sounding voice.
+    void partialCulled() { partials.fetch_add(1, std::memory_order_relaxed); }
+    /// Count a voice freed before its envelope ended.
+    void voiceCulled() { voices.fetch_add(1, std::memory_order_relaxed); }
+
+    /// Number of partials culled so far.
+    std::uint64_t culledPartials() const {
+        return partials.load(std::memory_order_relaxed);
+    }
+    /// Number of voices culled so far.
+    std::uint64_t culledVoices() const {
+        return voices.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<float> thresholdDb;
+    std::atomic<float> mixLevel{0.f};
+    std::atomic<float> cullFloor;
+    std::atomic<std::uint64_t> partials{0};
+    std::atomic<std::uint64_t> voices{0};
+
+    /// Recompute `cullFloor` from the mix level and threshold.
+    void update();
+};
+
+/// The process-wide culler.
+Culler &culler();
+
+}; // namespace kelon
+
+#endif
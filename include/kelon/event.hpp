@@ -0,0 +1,50 @@
+
+#ifndef KELON_EVENT_H
+#define KELON_EVENT_H
+
+#include <cstdint>
+
+#include <kelon/ring.hpp>
+
+namespace kelon {
+
+/// Compact note or controller event passed to the audio thread.
+struct NoteEvent {
+    enum class Type : std::uint8_t {
+        NoteOn,
+        NoteOff,
+        Control,
+        Program,
+    };
+
+    Type type;
+    /// MIDI channel, from 0.
+    std::uint8_t channel;
+    /// MIDI note, controller number for `Control` events, or program number
+    /// for `Program` events.
+    std::uint8_t number;
+    /// Velocity in [0, 1], or controller value in [0, 1].
+    float value;
+    /// Arrival time in nanoseconds on the steady clock.
+    std::int64_t timestamp;
+};
+
+/// Queue of events from one producer thread to the audio thread.
+using EventQueue = SpscRing<NoteEvent, 1024>;
+
+/// Current time on the clock used for event timestamps.
+std::int64_t eventClock();
+
+/**
+ * Frame of a block at which an event should land. Events are delayed by one
+ * block: an event arriving a given time after the previous block started
+ * lands the same time into the current block. This trades one block of
+ * latency for jitter-free timing. The result is clamped to the block.
+ */
+int frameOffset(const std::int64_t timestamp,
+                const std::int64_t previousBlockStart, const double sampleRate,
+                const int frames);
+
+}; // namespace kelon
+
+#endif
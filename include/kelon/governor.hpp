@@ -0,0 +1,99 @@
+
+#ifndef KELON_GOVERNOR_H
+#define KELON_GOVERNOR_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace kelon {
+
+/// How much synthesis voices may spend on their tails, from best to
+/// cheapest.
+enum class QualityTier : std::uint8_t {
+    /// Every partial.
+    Full,
+    /// No second overtone.
+    NoSecondOvertone,
+    /// Fundamental only.
+    Fundamental,
+};
+
+/// Number of quality tiers.
+const std::size_t QUALITY_TIERS = 3;
+
+/// Get the name of this quality tier.
+const std::string &name(const QualityTier &t);
+/// Parse a quality tier name. Returns false if the name is unknown.
+bool parse(const std::string &s, QualityTier &t);
+
+/**
+ * Steps through quality tiers as the audio callback nears its deadline.
+ * `update` takes the load of each callback, as timed by the DSP meter (see
+ * `DspMeter::load`), so callbacks are only timed once. A sustained load
+ * above `DEGRADE_LOAD`
+ * drops a tier, and the governor only climbs back once the load has stayed
+ * below `RECOVER_LOAD` for `RECOVER_SECONDS`, so it does not flap.
+ *
+ * Voices read `tier` once per control period and thin only the notes past
+ * their attack, so new notes always sound in full.
+ *
+ * `update` is audio thread only; everything else may be called from any
+ * thread.
+ */
+class LoadGovernor {
+public:
+    /// Fraction of the block period above which quality drops.
+    static constexpr float DEGRADE_LOAD = 0.8f;
+    /// Fraction of the block period below which quality may recover.
+    static constexpr float RECOVER_LOAD = 0.5f;
+    /// Consecutive blocks over `DEGRADE_LOAD` before dropping a tier.
+    static const unsigned int DEGRADE_BLOCKS = 4;
+    /// Time the load must stay under `RECOVER_LOAD` before climbing a tier.
+    static constexpr float RECOVER_SECONDS = 2.f;
+
+    /// Account an audio callback that rendered `frames` frames at `load`,
+    /// the fraction of its block period it took, and step through the tiers
+    /// if needed.
+    void update(const float load, const unsigned int frames,
+                const double sampleRate);
+
+    /// Current quality tier.
+    QualityTier tier() const { return current.load(std::memory_order_relaxed); }
+    /// Set the quality tier. It stays until the governor moves it.
+    void tier(const QualityTier t);
+
+    /// Whether the governor moves between tiers.
+    bool enabled() const { return governing.load(std::memory_order_relaxed); }
+    /// Let the governor move between tiers, or hold the current tier.
+    void enabled(const bool e) {
+        governing.store(e, std::memory_order_relaxed);
+    }
+
+    /// Audio time spent in a tier, in seconds.
+    double seconds(const QualityTier t) const;
+
+private:
+    std::atomic<QualityTier> current{QualityTier::Full};
+    std::atomic<bool> governing{true};
+    /// Frames rendered in each tier.
+    std::atomic<std::uint64_t> tierFrames[QUALITY_TIERS] = {};
+    /// Sampling rate of the last callback.
+    std::atomic<double> rate{0.};
+
+    /// Consecutive blocks over `DEGRADE_LOAD`.
+    unsigned int overBlocks = 0;
+    /// Frames since the load was last above `RECOVER_LOAD`.
+    double calmFrames = 0.;
+};
+
+/// Greatest number of additive partials rendered past the attack in a tier.
+std::size_t partialLimit(const QualityTier t);
+
+/// The process-wide load governor.
+LoadGovernor &governor();
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,106 @@
+
+#ifndef KELON_LIMITER_H
+#define KELON_LIMITER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include <al/io/al_AudioIOData.hpp>
+
+namespace kelon {
+
+/// Level the master bus is limited to unless set otherwise, in dBFS.
+const float DEFAULT_LIMITER_THRESHOLD = -1.f;
+/// Time gain reduction starts ahead of the peak it is for, in seconds. The
+/// master bus is delayed by as much.
+const float LIMITER_LOOKAHEAD = 0.002f;
+/// Time gain reduction takes to recover, in seconds.
+const float LIMITER_RELEASE = 0.1f;
+
+/**
+ * Look-ahead peak limiter on the master bus, built on the gain computer and
+ * look-ahead ramp of SimpleCompressor. The side chain is the loudest of the
+ * channels, and the same gain is applied to all of them, so the stereo or
+ * spatial image holds while the mix is pulled down.
+ *
+ * Blocks are processed in chunks into buffers allocated by `prepare`, so
+ * processing never allocates or locks. Without SimpleCompressor in the
+ * build, the limiter passes the mix through and only meters it.
+ *
+ * `process` is audio thread only; the other members may be called from any
+ * thread.
+ */
+class Limiter {
+public:
+    Limiter();
+    ~Limiter();
+
+    /// Whether the build includes SimpleCompressor, without which nothing is
+    /// limited.
+    static bool available();
+
+    /// Allocate the buffers and delay lines for a sampling rate and a number
+    /// of channels. Must be called before processing, off the audio thread.
+    void prepare(const double sampleRate, const unsigned int channels = 2);
+    /// Frames the master bus is delayed by.
+    unsigned int latency() const;
+
+    /// Limit the channels of a rendered block in place, up to the number
+    /// prepared for. Does nothing until prepared.
+    void process(al::AudioIOData &io);
+
+    /// Set the level peaks are limited to, in dBFS.
+    void threshold(const float db) {
+        thresholdDb.store(db, std::memory_order_relaxed);
+    }
+    /// Get the level peaks are limited to, in dBFS.
+    float threshold() const {
+        return thresholdDb.load(std::memory_order_relaxed);
+    }
+
+    /// Set whether gain is reduced. The mix stays delayed either way, so
+    /// toggling does not click.
+    void enabled(const bool e) {
+        limiting.store(e, std::memory_order_relaxed);
+    }
+    /// Get whether gain is reduced.
+    bool enabled() const { return limiting.load(std::memory_order_relaxed); }
+
+    /// Largest gain reduction of the latest block, in dB.
+    float reduction() const {
+        return blockReduction.load(std::memory_order_relaxed);
+    }
+    /// Largest gain reduction since the peak was reset, in dB.
+    float peakReduction() const {
+        return maxReduction.load(std::memory_order_relaxed);
+    }
+    /// Peak level of the latest block before limiting, in dBFS.
+    float inputLevel() const {
+        return blockLevel.load(std::memory_order_relaxed);
+    }
+    /// Number of blocks whose gain was reduced.
+    std::uint64_t limitedBlocks() const {
+        return limited.load(std::memory_order_relaxed);
+    }
+    /// Forget the largest gain reduction.
+    void resetPeak() { maxReduction.store(0.f, std::memory_order_relaxed); }
+
+private:
+    /// Gain computer, delay lines and chunk buffers. Kept out of the header
+    /// so SimpleCompressor's headers stay private to the library.
+    struct Engine;
+    std::unique_ptr<Engine> engine;
+
+    std::atomic<float> thresholdDb{DEFAULT_LIMITER_THRESHOLD};
+    std::atomic<bool> limiting{true};
+
+    std::atomic<float> blockReduction{0.f};
+    std::atomic<float> maxReduction{0.f};
+    std::atomic<float> blockLevel;
+    std::atomic<std::uint64_t> limited{0};
+};
+
+}; // namespace kelon
+
+#endif
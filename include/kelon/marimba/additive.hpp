@@ -4,13 +4,12 @@
 
 #include <tuple>
 
-#include <Gamma/Analysis.h>
-#include <Gamma/Effects.h>
-#include <Gamma/Envelope.h>
 #include <Gamma/Oscillator.h>
 #include <al/scene/al_PolySynth.hpp>
 
+#include <kelon/control.hpp>
 #include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/voice.hpp>
 
 namespace kelon {
 
@@ -26,6 +25,7 @@ namespace kelon {
  */
 float marimbaDecay(const unsigned char midiNote, const float baseDecay = 1.5f);
 
+class VoicePlanCache;
 
 /**
  * Parameters required for adjusting the additive marimba. Should not change
@@ -35,7 +35,7 @@ struct AdditiveMarimbaParameters {
     /// Number of oscillators.
     static const std::size_t OSCILLATOR_COUNT = 3;
     /// Internal parameter count.
-    static const std::size_t INTERNAL_PARAMETER_COUNT = 11;
+    static const std::size_t INTERNAL_PARAMETER_COUNT = 12;
     /// Envelope curve.
     static constexpr float ENVELOPE_CURVE = 0.f;
     /// Envelope levels.
@@ -50,23 +50,43 @@ struct AdditiveMarimbaParameters {
     const float scaleAmplitude;
 
     /// Default values for the internal trigger parameters.
-    const std::tuple<const MarimbaParameter, const float, const float,
-                     const float>
-        internalTriggerParameters[INTERNAL_PARAMETER_COUNT];
+    const ParameterDefaults internalTriggerParameters[INTERNAL_PARAMETER_COUNT];
+
+    /// Per-note plans for this instrument. Not owned by the parameters.
+    VoicePlanCache *const plans;
+};
+
+/**
+ * Everything about a note that only depends on the instrument, its parameters
+ * and the tuning, precomputed by `VoicePlanCache`.
+ */
+struct VoicePlan {
+    /// Frequency of the fundamental.
+    float frequency;
+    /// Frequency of each partial.
+    float frequencies[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+    /// Attack, decay and release time of each partial, in seconds.
+    float lengths[AdditiveMarimbaParameters::OSCILLATOR_COUNT][3];
+    /// Gain of each partial, before amplitude scaling.
+    float gains[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+    /// MIDI note each partial is displayed at.
+    unsigned char displayNotes[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
 };
 
 /**
  * Additive synthesizer for generating a marimba- or xylophone-like sound.
  *
+ * Envelopes, partial gains and the pan are evaluated once per control period
+ * (see `controlPeriod`), and each sample ramps linearly between the values,
+ * so live parameter changes glide instead of stepping at block boundaries.
+ * Partials masked by the mix (see `Culler`) stop being rendered, and the
+ * voice frees itself once all of them are masked. Under CPU pressure the
+ * overtones that the current `QualityTier` leaves out are faded from notes
+ * past their attack.
+ *
  * The ID of a given AdditiveMarimbaBase voice is the MIDI note it sounds.
  */
-class AdditiveMarimbaBase : public al::SynthVoice {
-public:
-    /// Get the value of the given internal trigger parameter.
-    float value(const MarimbaParameter &p);
-    /// Set the value of the given internal trigger parameter.
-    void value(const MarimbaParameter &p, const float value);
-
+class AdditiveMarimbaBase : public MarimbaVoice {
 protected:
     /**
      * Parameters for the additive marimba. Not owned by the instrument.
@@ -80,20 +100,86 @@ protected:
 
     /// Oscillators. Each oscillator is paired with its harmonic number.
     gam::Sine<> oscillators[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
-    /// Envelopes. Each oscillator is paired with its harmonic number.
-    gam::Env<3> envelopes[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
-    /// Envelope followers for graphics.
-    gam::EnvFollow<> followers[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
-
-    /// 2-channel panner.
-    gam::Pan<> pan;
+    /// Envelopes, evaluated at control rate. Each oscillator is paired with
+    /// its harmonic number.
+    ControlEnvelope envelopes[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+
+    /// Plan of the note being played, copied when the voice is triggered.
+    VoicePlan plan;
+
+    /// Level of each partial before amplitude scaling, for graphics. Updated
+    /// at control rate.
+    float levels[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+
+    /// Get the level of a partial, scaled like an envelope follower.
+    float level(const std::size_t partial) const;
+
+private:
+    /// Gain of each partial, ramping towards `targets`.
+    float gains[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+    /// Gain of each partial at the end of the control period.
+    float targets[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+    /// Change in each partial's gain per frame.
+    float steps[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+
+    /// Left and right pan gains, ramping towards `panTargets`.
+    float panGains[2];
+    /// Left and right pan gains at the end of the control period.
+    float panTargets[2];
+    /// Change in each pan gain per frame.
+    float panSteps[2];
+
+    /// Gain of each partial from `partialHardness` and `partialBrightness`,
+    /// before the envelopes.
+    float partials[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+    /// Hardness and brightness `partials` was computed from.
+    float partialHardness, partialBrightness;
+    /// Pan position `panTargets` was computed from.
+    float panPosition;
+
+    /// Partials still being rendered. The first `liveCount` entries are
+    /// used.
+    std::size_t live[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+    /// Number of partials still being rendered.
+    std::size_t liveCount = 0;
+
+    /// Frames left in the current control period.
+    unsigned int tickFrames = 0;
+    /// Whether the next control period is the note's first.
+    bool starting = false;
+    /// Whether every partial has ended or been culled.
+    bool finished = false;
+    /// Whether partials are culled by the mix and thinned under load.
+    bool adapting = true;
+
+    /// Plans to read when triggered, instead of the instrument's. Not owned
+    /// by the voice.
+    VoicePlanCache *planCache = nullptr;
+
+    /// Start a control period: advance the envelopes and set up the gain
+    /// ramps from the current parameters.
+    void tick(const ParameterSnapshot &params);
 
 public:
     void init() override; // Triggered once per voice.
     void onProcess(al::AudioIOData &io) override;
-    virtual void onProcess(al::Graphics &g) override = 0;
-    void onTriggerOn() override;
+    void onStrike() override;
     void onTriggerOff() override;
+    float loudness() const override;
+
+    /**
+     * Read plans from `c` instead of the instrument's cache, so voices
+     * triggered from different threads do not share one. Null restores the
+     * instrument's cache. The cache is not owned by the voice.
+     */
+    void plans(VoicePlanCache *const c) { planCache = c; }
+
+    /**
+     * Set whether the voice culls partials masked by the mix and thins its
+     * overtones under load. Renders that must not depend on either, such as
+     * `SampleBank`'s, turn it off.
+     */
+    void adaptive(const bool a) { adapting = a; }
 };
 
 }; // namespace kelon
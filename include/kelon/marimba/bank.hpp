@@ -0,0 +1,156 @@
+
+#ifndef KELON_MARIMBA_BANK_H
+#define KELON_MARIMBA_BANK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <al/io/al_AudioIOData.hpp>
+
+#include <kelon/block.hpp>
+#include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/simd.hpp>
+
+namespace kelon {
+
+/// Engines synthesizing the additive instruments.
+enum class AdditiveEngine : std::uint8_t {
+    /// A voice per note, managed by a `PolySynth`.
+    Voices,
+    /// An `AdditiveVoiceBank` per instrument.
+    Bank,
+};
+
+/// Get the name of this engine.
+const std::string &name(const AdditiveEngine &e);
+/// Parse an engine name. Returns false if the name is unknown.
+bool parse(const std::string &s, AdditiveEngine &e);
+
+/**
+ * Additive engine rendering the partials of every sounding note of one
+ * instrument together. Oscillator phases, increments, envelope states and
+ * partial gains are stored in structure-of-arrays form and packed densely, so
+ * that `simd::WIDTH` partials are rendered per instruction. Each lane mixes
+ * into its own accumulator, and the lanes are summed once per frame after
+ * every partial has been rendered.
+ *
+ * Produces the sound of `AdditiveMarimbaBase` for the same parameters, with
+ * linear three-segment envelopes and the voice's cos/sin equal-power pan.
+ * The bank has no voices for `PolySynth` to manage: `Ensemble` and
+ * kelon-render play the additive instruments through it when the `Bank`
+ * engine is chosen, striking notes between the spans of a block they render.
+ * Its notes are neither stolen, culled nor thinned under load, and take no
+ * parameter changes once struck.
+ */
+class AdditiveVoiceBank {
+public:
+    /// Maximum number of simultaneously sounding notes.
+    static const std::size_t MAX_VOICES = 256;
+    /// Maximum number of simultaneously sounding partials.
+    static const std::size_t MAX_PARTIALS =
+        MAX_VOICES * AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+
+    /// Create a bank for the given instrument. The parameters are not owned
+    /// by the bank.
+    AdditiveVoiceBank(const AdditiveMarimbaParameters *const params);
+
+    /**
+     * Strike a note. Reads the same `MarimbaParameter`s as
+     * `AdditiveMarimbaBase`. Returns false if the bank is full.
+     */
+    bool trigger(const unsigned char note, const ParameterSnapshot &params);
+
+    /// Accumulate every sounding partial into the first two output channels.
+    void render(al::AudioIOData &io) { render(io, 0, io.framesPerBuffer()); }
+    /// Accumulate frames `begin` up to `end` of the block, so that a note
+    /// can be struck at a frame within it.
+    void render(al::AudioIOData &io, const unsigned int begin,
+                const unsigned int end);
+
+    /// Silence every note.
+    void clear();
+
+    /**
+     * Read plans from `c` instead of the instrument's cache, so banks
+     * struck from different threads do not share one. Null restores the
+     * instrument's cache. The cache is not owned by the bank.
+     */
+    void plans(VoicePlanCache *const c) { planCache = c; }
+
+    /// Number of sounding notes.
+    std::size_t activeVoices() const { return voiceCount; }
+    /// Number of sounding partials.
+    std::size_t activePartials() const { return partialCount; }
+
+private:
+    /// Number of envelope segments.
+    static const std::size_t SEGMENTS = 3;
+    /// Envelope segment of a partial that has finished.
+    static const std::uint8_t DONE = SEGMENTS;
+    /// Room for the last, partially filled vector.
+    static const std::size_t CAPACITY = MAX_PARTIALS + simd::WIDTH;
+
+    /// Parameters for the additive marimba. Not owned by the bank.
+    const AdditiveMarimbaParameters *const parameters;
+    /// Plans to read when struck, instead of the instrument's. Not owned by
+    /// the bank.
+    VoicePlanCache *planCache = nullptr;
+
+    /// Number of sounding partials. Partials are packed at the front.
+    std::size_t partialCount = 0;
+    /// Number of sounding notes.
+    std::size_t voiceCount = 0;
+
+    /// Oscillator phases, in 2^-32 cycles. Kept in fixed point, as Gamma's
+    /// oscillators are, so they do not drift however long a note rings; each
+    /// chunk renders from them in floating point.
+    std::uint32_t phases[CAPACITY];
+    /// Phase increment per frame, in 2^-32 cycles.
+    std::uint32_t steps[CAPACITY];
+    /// Phase increment per frame, in cycles.
+    float increments[CAPACITY];
+    /// Envelope level change per frame in the current segment.
+    float slopes[CAPACITY];
+    /// Partial gain towards the left channel.
+    float gainsLeft[CAPACITY];
+    /// Partial gain towards the right channel.
+    float gainsRight[CAPACITY];
+    /// Frames left in the current envelope segment.
+    std::uint32_t remaining[CAPACITY];
+    /// Current envelope segment.
+    std::uint8_t segments[CAPACITY];
+    /// Segment lengths in frames. Not rounded, so that every partial's
+    /// breakpoints fall where the reference's do.
+    float lengths[CAPACITY][SEGMENTS];
+    /// How far past the end of the current segment its last frame leaves the
+    /// envelope, in frames, carried into the next segment.
+    float overshoots[CAPACITY];
+    /// Note slot each partial belongs to.
+    std::uint16_t owners[CAPACITY];
+
+    /// Number of sounding partials per note slot. Zero marks a free slot.
+    std::uint8_t voicePartials[MAX_VOICES];
+
+    /// Left and right mix of each lane, `simd::WIDTH` floats per frame of the
+    /// chunk being rendered.
+    float lanesLeft[CHUNK_FRAMES * simd::WIDTH];
+    float lanesRight[CHUNK_FRAMES * simd::WIDTH];
+
+    /// Enter an envelope segment of a partial `offset` frames in, skipping
+    /// segments the offset passes.
+    void enter(const std::size_t partial, std::uint8_t segment, float offset);
+    /// Envelope level of a partial at the next frame it renders. Worked out
+    /// from the frames left in the segment rather than summed frame by frame,
+    /// so that long releases do not drift.
+    float envelope(const std::size_t partial) const;
+    /// Reset a slot to a silent, finished partial.
+    void silence(const std::size_t partial);
+    /// Move a partial from one slot to another.
+    void move(const std::size_t from, const std::size_t to);
+};
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,162 @@
+
+#ifndef KELON_MARIMBA_ENSEMBLE_H
+#define KELON_MARIMBA_ENSEMBLE_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <al/io/al_AudioIOData.hpp>
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/marimba/bank.hpp>
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/pool.hpp>
+#include <kelon/marimba/samples.hpp>
+#include <kelon/marimba/voice.hpp>
+
+namespace kelon {
+
+/// Instruments an `Ensemble` plays.
+enum class Instrument : std::uint8_t {
+    /// `AdditiveMarimba`.
+    Marimba,
+    /// `AdditiveXylophone`.
+    Xylophone,
+    /// `SubtractiveMarimba`.
+    Subtractive,
+    /// `EnsembleModalMarimba`.
+    Modal,
+};
+
+/// Number of instruments.
+constexpr std::size_t INSTRUMENTS = std::size_t(Instrument::Modal) + 1;
+/// Number of instruments that can be played from a `SampleBank` or an
+/// `AdditiveVoiceBank`: the additive ones, which come first.
+constexpr std::size_t SAMPLED_INSTRUMENTS = 2;
+/// Number of MIDI channels.
+constexpr std::size_t MIDI_CHANNELS = 16;
+
+/// Get the name of this instrument.
+const std::string &name(const Instrument &i);
+/// Parse an instrument name. Returns false if the name is unknown.
+bool parse(const std::string &s, Instrument &i);
+
+/**
+ * Multi-timbral set of instruments sharing one synth. Each MIDI channel is
+ * routed to an instrument, and each instrument has its own voice pool and
+ * parameters. Since every voice lives in the same synth, all instruments
+ * render in one pass into one mix, are accounted and scheduled together,
+ * and publish their levels in one snapshot.
+ *
+ * The additive instruments may instead be synthesized by an
+ * `AdditiveVoiceBank` each, rendered once per block after the synth. Their
+ * notes are then struck with `strike` rather than on voices, and are not
+ * drawn.
+ *
+ * Audio thread only, apart from `allocate`, `policy` and routing.
+ */
+class Ensemble {
+public:
+    /// Create an ensemble playing through a synth. The synth is not owned by
+    /// the ensemble. Channel `n` is routed to instrument `n`, and the
+    /// remaining channels to the marimba.
+    Ensemble(al::PolySynth &s);
+
+    /**
+     * Allocate and initialize the voices of every instrument, with
+     * `polyphony` voices sounding at once and `reserve` more for stolen
+     * voices to fade out. If `sampled` is set, the additive instruments get
+     * as many voices again to play from sample banks. If `banked` is set,
+     * they are synthesized by voice banks instead of voices. Call once,
+     * before audio starts.
+     */
+    void allocate(const unsigned int polyphony, const unsigned int reserve,
+                  const bool sampled = false, const bool banked = false);
+    /// Set the steal policy of every instrument.
+    void policy(const StealPolicy p);
+
+    /// Get the instrument a MIDI channel is routed to.
+    Instrument route(const std::uint8_t channel) const {
+        return routes[channel % MIDI_CHANNELS].load(std::memory_order_relaxed);
+    }
+    /// Route a MIDI channel to an instrument. Any thread.
+    void route(const std::uint8_t channel, const Instrument i) {
+        routes[channel % MIDI_CHANNELS].store(i, std::memory_order_relaxed);
+    }
+
+    /// Get the parameters notes of an instrument are struck with.
+    ParameterSnapshot &parameters(const Instrument i) {
+        return instrumentParameters[std::size_t(i)];
+    }
+
+    /**
+     * Get a voice of an instrument to strike `note` with, stealing one of
+     * its voices first if needed. Returns null, dropping the note, if every
+     * voice of the instrument is still fading out.
+     */
+    MarimbaVoice *acquire(const Instrument i, const unsigned char note);
+    /**
+     * Get a voice of an additive instrument to play `note` from a sample
+     * bank, which must outlive the note. Voices are only available if
+     * allocated with `sampled`. Other instruments are synthesized as usual.
+     */
+    MarimbaVoice *acquire(const Instrument i, const unsigned char note,
+                          const SampleBank *const bank);
+
+    /// Whether an instrument is synthesized by a voice bank rather than by
+    /// voices.
+    bool banked(const Instrument i) const {
+        return std::size_t(i) < SAMPLED_INSTRUMENTS && banks[std::size_t(i)];
+    }
+    /**
+     * Strike `note` on the voice bank of an instrument, at frame `offset` of
+     * the block about to be rendered. Returns false, dropping the note, if
+     * the instrument has no bank or too many notes were struck this block.
+     */
+    bool strike(const Instrument i, const unsigned char note,
+                const ParameterSnapshot &params, const unsigned int offset);
+    /// Render the voice banks into the first two output channels, striking
+    /// their notes at their frames. Call once per block, after the synth.
+    void render(al::AudioIOData &io);
+
+    /// Set a parameter of an instrument, for the notes struck after it and
+    /// the notes sounding, from frame `offset` of the block about to be
+    /// rendered. Notes sounding from voice banks keep their parameters.
+    void value(const Instrument i, const MarimbaParameter p, const float v,
+               const unsigned int offset = 0);
+
+private:
+    /// A note struck on a voice bank, waiting for its frame of the block.
+    struct BankStrike {
+        Instrument instrument;
+        unsigned char note;
+        unsigned int offset;
+        ParameterSnapshot params;
+    };
+
+    /// Maximum number of notes struck on the voice banks per block.
+    static const std::size_t MAX_BANK_STRIKES = 256;
+
+    /// Voices of each instrument.
+    std::array<VoicePool, INSTRUMENTS> pools;
+    /// Voices of each additive instrument playing from sample banks.
+    std::array<VoicePool, SAMPLED_INSTRUMENTS> sampledPools;
+    /// Voice bank of each additive instrument, if allocated with `banked`.
+    std::array<std::unique_ptr<AdditiveVoiceBank>, SAMPLED_INSTRUMENTS> banks;
+    /// Notes struck on the voice banks for the block about to be rendered,
+    /// in the order they were struck.
+    std::array<BankStrike, MAX_BANK_STRIKES> bankStrikes;
+    /// Number of notes in `bankStrikes`.
+    std::size_t bankStrikeCount = 0;
+    /// Parameters of each instrument.
+    std::array<ParameterSnapshot, INSTRUMENTS> instrumentParameters;
+    /// Instrument of each MIDI channel.
+    std::array<std::atomic<Instrument>, MIDI_CHANNELS> routes;
+};
+
+}; // namespace kelon
+
+#endif
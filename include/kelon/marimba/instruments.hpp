@@ -3,6 +3,7 @@
 #define KELON_MARIMBA_XYLOPHONE_H
 
 #include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/modal.hpp>
 #include <kelon/marimba/visualization.hpp>
 
 namespace kelon {
@@ -11,6 +12,9 @@ class AdditiveMarimba : public AdditiveVisualizedMarimba {
 public:
     AdditiveMarimba();
 
+    /// Constants for this instrument.
+    static const AdditiveMarimbaParameters *const PARAMETERS;
+
     static const std::tuple<MarimbaParameter, float, float, float>
         INTERNAL_TRIGGER_PARAMETERS[AdditiveMarimbaParameters::INTERNAL_PARAMETER_COUNT];
 
@@ -23,6 +27,9 @@ class AdditiveXylophone : public AdditiveVisualizedMarimba {
 public:
     AdditiveXylophone();
 
+    /// Constants for this instrument.
+    static const AdditiveMarimbaParameters *const PARAMETERS;
+
     static const std::tuple<MarimbaParameter, float, float, float>
         INTERNAL_TRIGGER_PARAMETERS[AdditiveMarimbaParameters::INTERNAL_PARAMETER_COUNT];
 
@@ -35,6 +42,9 @@ class SubtractiveMarimba : public SubtractiveVisualizedMarimba {
 public:
     SubtractiveMarimba();
 
+    /// Constants for this instrument.
+    static const SubtractiveMarimbaParameters *const PARAMETERS;
+
     static const std::tuple<MarimbaParameter, float, float, float>
         INTERNAL_TRIGGER_PARAMETERS[SubtractiveMarimbaParameters::INTERNAL_PARAMETER_COUNT];
 
@@ -43,6 +53,57 @@ protected:
     static const std::pair<const unsigned char, const unsigned char> RANGE;
 };
 
+/// `AdditiveMarimba` played from a `SampleBank`.
+class SampledMarimba : public SampledVisualizedMarimba {
+public:
+    SampledMarimba();
+};
+
+/// `AdditiveXylophone` played from a `SampleBank`.
+class SampledXylophone : public SampledVisualizedMarimba {
+public:
+    SampledXylophone();
+};
+
+/**
+ * Marimba built from `N` modes of a tuned bar. Instantiated for 3, 8, 16 and
+ * 32 modes; the first three are the tuned modes of the additive marimba.
+ */
+template <std::size_t N> class ModalMarimba : public ModalMarimbaBase<N> {
+public:
+    ModalMarimba();
+
+    /// Constants for this instrument.
+    static const ModalMarimbaParameters *const PARAMETERS;
+};
+
+extern template class ModalMarimba<3>;
+extern template class ModalMarimba<8>;
+extern template class ModalMarimba<16>;
+extern template class ModalMarimba<32>;
+
+/**
+ * Xylophone built from `N` modes of a tuned bar. Instantiated for 3, 8, 16
+ * and 32 modes; the first three are the tuned modes of the additive
+ * xylophone.
+ */
+template <std::size_t N> class ModalXylophone : public ModalMarimbaBase<N> {
+public:
+    ModalXylophone();
+
+    /// Constants for this instrument.
+    static const ModalMarimbaParameters *const PARAMETERS;
+};
+
+extern template class ModalXylophone<3>;
+extern template class ModalXylophone<8>;
+extern template class ModalXylophone<16>;
+extern template class ModalXylophone<32>;
+
+/// Modal marimba an `Ensemble` plays: 16 modes, at half the cost of all 32,
+/// since the modes past them are quiet and short-lived.
+using EnsembleModalMarimba = ModalMarimba<16>;
+
 }; // namespace kelon
 
 #endif
@@ -0,0 +1,136 @@
+
+#ifndef KELON_MARIMBA_MODAL_H
+#define KELON_MARIMBA_MODAL_H
+
+#include <atomic>
+#include <cstddef>
+
+#include <Gamma/Effects.h>
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/visualization.hpp>
+#include <kelon/marimba/voice.hpp>
+#include <kelon/tuning.hpp>
+
+namespace kelon {
+
+/// A vibrational mode of a bar.
+struct MarimbaMode {
+    /// Frequency relative to the fundamental.
+    float ratio;
+    /// Decay time relative to the fundamental's.
+    float decay;
+    /// Amplitude when the bar is struck.
+    float gain;
+};
+
+/**
+ * Parameters required for adjusting the modal marimba. Should not change
+ * during execution.
+ */
+struct ModalMarimbaParameters {
+    /// Internal parameter count.
+    static const std::size_t INTERNAL_PARAMETER_COUNT = 11;
+
+    /// Modes of the bar, most important first. A voice with fewer modes uses
+    /// the first ones. The first three are the tuned modes, and the ratios of
+    /// the rest are relative to the third's.
+    const MarimbaMode *const modes;
+    /// Number of entries in `modes`.
+    const std::size_t modeCount;
+
+    /// Factor to scale hardness by.
+    const float scaleHardness;
+    /// Factor to scale amplitude by.
+    const float scaleAmplitude;
+
+    /// Default values for the internal trigger parameters.
+    const ParameterDefaults internalTriggerParameters[INTERNAL_PARAMETER_COUNT];
+
+    /// Tuning notes are struck in, which may be set from any thread. Null is
+    /// equal temperament. Neither is owned by the parameters.
+    std::atomic<const TuningTable *> *const tuning;
+};
+
+/**
+ * Modal synthesizer for a marimba-like bar with `N` modes.
+ *
+ * Each mode is a recursive damped complex resonator: its state is multiplied
+ * by a complex pole once per sample, and the imaginary part of the state is
+ * the mode's output. Striking the bar excites every resonator with an
+ * impulse.
+ *
+ * - `FirstOvertone` and `SecondOvertone` set the ratios of the second and
+ *   third tuned modes, as they set the additive marimba's overtones. The
+ *   modes past them keep their table ratios relative to the third mode, so
+ *   retuning the bar moves them with it. A ratio of zero silences its mode;
+ *   with the third mode silenced, the rest keep their table ratios.
+ * - `Hardness` scales the modes above the fundamental, and `Brightness` tilts
+ *   them: at 1 every mode keeps its table gain, at 0 each is divided by its
+ *   frequency ratio.
+ * - `ReleaseTime` sets the decay of the fundamental through `marimbaDecay`;
+ *   the other modes decay relative to it.
+ * - The fundamental is pitched by the instrument's tuning table.
+ * - `AttackTime` fades the strike in. A struck bar has no sustain level to
+ *   decay to, so unlike the additive marimba there is no `DecayTime`.
+ *
+ * Modes that have died away or are masked by the mix (see `Culler`) are
+ * dropped at the end of each block, and the voice frees itself once it is
+ * masked as a whole.
+ *
+ * The ID of a given voice is the MIDI note it sounds.
+ */
+template <std::size_t N>
+class ModalMarimbaBase : public MarimbaVoice, protected MarimbaVisualizer {
+public:
+    /// Number of modes.
+    static const std::size_t MODE_COUNT = N;
+
+    ModalMarimbaBase(const ModalMarimbaParameters *const params,
+                     const MarimbaRange *const range);
+
+    void init() override; // Triggered once per voice.
+    void onProcess(al::AudioIOData &io) override;
+    void onStrike() override;
+    void onTriggerOff() override;
+    float loudness() const override;
+    void publish(VoiceLevels &levels) override;
+
+protected:
+    /// Parameters for the modal marimba. Not owned by the instrument.
+    const ModalMarimbaParameters *const parameters;
+
+    /// Frequency of the fundamental.
+    float frequency = 0.f;
+    /// Real part of each resonator's state.
+    float stateReal[N];
+    /// Imaginary part of each resonator's state.
+    float stateImag[N];
+    /// Real part of each resonator's pole.
+    float poleReal[N];
+    /// Imaginary part of each resonator's pole.
+    float poleImag[N];
+    /// MIDI note each mode is displayed at.
+    unsigned char displayNotes[N];
+    /// Number of modes still ringing. They are kept in order at the front of
+    /// the arrays above.
+    std::size_t live = 0;
+
+    /// Gain of the strike's fade-in.
+    float attack = 1.f;
+    /// Change in `attack` per frame.
+    float attackStep = 0.f;
+
+    /// 2-channel panner.
+    gam::Pan<> pan;
+};
+
+extern template class ModalMarimbaBase<3>;
+extern template class ModalMarimbaBase<8>;
+extern template class ModalMarimbaBase<16>;
+extern template class ModalMarimbaBase<32>;
+
+}; // namespace kelon
+
+#endif
@@ -2,6 +2,8 @@
 #ifndef KELON_MARIMBA_PARAMETER_H
 #define KELON_MARIMBA_PARAMETER_H
 
+#include <array>
+#include <cstddef>
 #include <string>
 
 #include <al/scene/al_PolySynth.hpp>
@@ -21,6 +23,9 @@ enum class MarimbaParameter {
     Amplitude,
     /// Pan amount.
     Pan,
+    /// Distance from the centre of a speaker layout, where speakers are
+    /// usually 1 away. Stereo ignores it.
+    Distance,
 
     ////// Envelope Parameters //////
 
@@ -55,6 +60,63 @@ enum class MarimbaParameter {
     SecondOvertone,
 };
 
+/// Number of marimba parameters.
+constexpr std::size_t PARAMETER_COUNT =
+    std::size_t(MarimbaParameter::SecondOvertone) + 1;
+
+/// Index of this marimba parameter in enum-indexed storage.
+constexpr std::size_t index(const MarimbaParameter p) { return std::size_t(p); }
+
+/// Parameter values indexed by `MarimbaParameter`.
+class ParameterSnapshot {
+public:
+    /// Get the value of the given parameter.
+    float operator[](const MarimbaParameter p) const {
+        return values[index(p)];
+    }
+    /// Get a reference to the value of the given parameter.
+    float &operator[](const MarimbaParameter p) { return values[index(p)]; }
+
+    bool operator==(const ParameterSnapshot &other) const {
+        return values == other.values;
+    }
+    bool operator!=(const ParameterSnapshot &other) const {
+        return values != other.values;
+    }
+
+private:
+    std::array<float, PARAMETER_COUNT> values{};
+};
+
+/**
+ * Enum-indexed handles to the internal trigger parameters of a voice. The
+ * parameters keep their names so that presets and the GUI can still address
+ * them, but the voice itself never looks them up by string.
+ */
+class ParameterTable {
+public:
+    /// Create the given parameter on the passed `voice` and keep its handle.
+    void create(const MarimbaParameter &p, al::SynthVoice &voice,
+                const float default_, const float min, const float max);
+    /// Whether the given parameter has been created.
+    bool has(const MarimbaParameter &p) const;
+
+    /// Get the value of the given parameter. Parameters that were never
+    /// created read as 0.
+    float get(const MarimbaParameter &p) const;
+    /// Set the value of the given parameter, if it has been created.
+    void set(const MarimbaParameter &p, const float value);
+
+    /// Read every parameter once.
+    ParameterSnapshot snapshot() const;
+    /// Set every created parameter from a snapshot.
+    void assign(const ParameterSnapshot &snapshot);
+
+private:
+    /// Parameter handles. Owned by the voice the parameters were created on.
+    std::array<al::Parameter *, PARAMETER_COUNT> handles{};
+};
+
 /// Get the name of this marimba parameter.
 const std::string &name(const MarimbaParameter &p);
 
@@ -63,7 +125,8 @@ void create(const MarimbaParameter &p, al::SynthVoice &voice,
             const float default_, const float min, const float max);
 /**
  * Get the value of this parameter on the given `voice`. Does not modify
- * `voice`.
+ * `voice`. Looks the parameter up by name; voices should prefer their own
+ * `ParameterTable`.
  */
 float value(const MarimbaParameter &p, al::SynthVoice &voice);
 /// Set the value of this parameter on the given `voice`.
@@ -0,0 +1,89 @@
+
+#ifndef KELON_MARIMBA_PLAN_H
+#define KELON_MARIMBA_PLAN_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/tuning.hpp>
+
+namespace kelon {
+
+/**
+ * Get the gain of each partial of a note of an instrument, before amplitude
+ * scaling, for the given hardness and brightness.
+ */
+void partialGains(const AdditiveMarimbaParameters &instrument,
+                  const unsigned char note, const float hardness,
+                  const float brightness,
+                  float (&gains)[AdditiveMarimbaParameters::OSCILLATOR_COUNT]);
+
+/**
+ * Plans of the 128 MIDI notes of an additive instrument. A note's plan is
+ * built the first time it is struck after a parameter it depends on or the
+ * tuning changes, so that striking a note costs at most the transcendental
+ * math behind its own frequencies, envelope lengths and gains, and repeated
+ * strikes cost a table read.
+ *
+ * Not thread-safe: `plan` must only be called from the thread triggering
+ * voices. Voices copy their plan when struck, so rendering them on other
+ * threads never reads the cache. `tuning` may be called from any thread.
+ */
+class VoicePlanCache {
+public:
+    VoicePlanCache();
+
+    /**
+     * Get the plan of a note of an instrument struck with `params`, building
+     * it first if `params` or the tuning changed since it was last built.
+     */
+    const VoicePlan &plan(const AdditiveMarimbaParameters &instrument,
+                          const unsigned char note,
+                          const ParameterSnapshot &params);
+
+    /**
+     * Use a tuning table for notes struck from now on. The table is not owned
+     * by the cache and must not change while it is in use. Null restores equal
+     * temperament.
+     */
+    void tuning(const TuningTable *const t);
+
+private:
+    /// Number of parameters the plans depend on.
+    static const std::size_t KEY_COUNT = 7;
+    /// Parameters the plans depend on.
+    static const MarimbaParameter KEYS[KEY_COUNT];
+
+    /// Plan of every MIDI note.
+    std::array<VoicePlan, TuningTable::NOTES> plans;
+    /// Generation each plan was built in. Zero if it never was.
+    std::array<std::uint64_t, TuningTable::NOTES> builtGenerations{};
+
+    /// Generation of the current keys, counting the times they changed.
+    std::uint64_t generation = 0;
+    /// Values of `KEYS` of the current generation.
+    float keyValues[KEY_COUNT];
+    /// Tuning of the current generation.
+    const TuningTable *builtTuning = nullptr;
+    /// Instrument of the current generation.
+    const AdditiveMarimbaParameters *builtInstrument = nullptr;
+
+    /// Tuning to build the plans with.
+    std::atomic<const TuningTable *> currentTuning;
+
+    /// Whether these arguments start a new generation.
+    bool stale(const AdditiveMarimbaParameters &instrument,
+               const ParameterSnapshot &params,
+               const TuningTable *const tuning) const;
+    /// Rebuild the plan of a note.
+    void build(const AdditiveMarimbaParameters &instrument,
+               const std::size_t note, const ParameterSnapshot &params,
+               const TuningTable *const tuning);
+};
+
+}; // namespace kelon
+
+#endif
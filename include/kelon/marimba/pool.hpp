@@ -0,0 +1,121 @@
+
+#ifndef KELON_MARIMBA_POOL_H
+#define KELON_MARIMBA_POOL_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/marimba/voice.hpp>
+#include <kelon/trace.hpp>
+
+namespace kelon {
+
+/// How `VoicePool` chooses a voice to steal.
+enum class StealPolicy : std::uint8_t {
+    /// Steal the voice struck longest ago.
+    Oldest,
+    /// Steal the voice with the lowest loudness.
+    Quietest,
+    /// A note struck again replaces the voice already sounding it, so rolls
+    /// use a bounded number of voices. Otherwise steal the oldest voice.
+    SameNote,
+};
+
+/// Get the name of this steal policy.
+const std::string &name(const StealPolicy &p);
+/// Parse a steal policy name. Returns false if the name is unknown.
+bool parse(const std::string &s, StealPolicy &p);
+
+/**
+ * Fixed set of marimba voices, allocated and initialized before playing
+ * starts. At most `polyphony` voices sound at once; striking another steals
+ * one, which fades out over `DECLICK_FRAMES` frames while the new note
+ * starts on one of the `reserve` voices kept for that purpose.
+ *
+ * Turns off allocation in the synth, so acquiring a voice never allocates.
+ * It still takes the synth's free-voice mutex, but once audio starts only the
+ * audio thread takes it, so it is never contended and never blocks.
+ * Audio thread only, apart from `allocate`.
+ */
+class VoicePool {
+public:
+    /// Length of the fade applied to stolen voices.
+    static const unsigned int DECLICK_FRAMES = 64;
+
+    /// Create a pool for a synth. The synth is not owned by the pool.
+    VoicePool(al::PolySynth &s);
+
+    /**
+     * Allocate and initialize every voice the pool will use, then disable
+     * allocation in the synth. Call once, before audio starts.
+     */
+    template <class TVoice>
+    void allocate(const unsigned int polyphony, const unsigned int reserve) {
+        cap = polyphony ? polyphony : 1;
+        synth.allocatePolyphony<TVoice>(cap + reserve);
+        synth.disableAllocation();
+        struck.assign(cap + reserve, nullptr);
+    }
+
+    /// Maximum number of voices sounding at once, not counting voices fading
+    /// out.
+    unsigned int polyphony() const { return cap; }
+
+    /// Get the steal policy.
+    StealPolicy policy() const { return stealPolicy; }
+    /// Set the steal policy.
+    void policy(const StealPolicy p) { stealPolicy = p; }
+
+    /**
+     * Get a voice to strike `note` with, then steal one if the policy or the
+     * polyphony cap calls for it. Returns null, dropping the note and
+     * stealing nothing, if every voice is still fading out.
+     */
+    template <class TVoice> TVoice *acquire(const unsigned char note) {
+        // Take a free voice before stealing, so a note that cannot sound
+        // does not cut another off.
+        TVoice *const voice = synth.getVoice<TVoice>();
+        if (!voice) {
+            trace(TraceLevel::Warning, TraceEvent::NoteDropped, -1, note, 0.f);
+            return nullptr;
+        }
+        release(note);
+        track(voice);
+        return voice;
+    }
+
+    /// Number of voices sounding, not counting voices fading out.
+    unsigned int sounding() const;
+
+    /// Set an internal trigger parameter on every voice sounding from the
+    /// pool, from frame `offset` of the block about to be rendered.
+    void value(const MarimbaParameter &p, const float value,
+               const unsigned int offset = 0);
+
+private:
+    /// Synth the voices belong to. Not owned by the pool.
+    al::PolySynth &synth;
+    /// Maximum number of voices sounding at once.
+    unsigned int cap = 0;
+    /// Steal policy.
+    StealPolicy stealPolicy = StealPolicy::Oldest;
+    /// Order of the next voice struck.
+    std::uint64_t nextOrder = 1;
+
+    /// Voices struck through the pool. Null slots are unused.
+    std::vector<MarimbaVoice *> struck;
+
+    /// Steal the voices that must make room for `note`.
+    void release(const unsigned char note);
+    /// Record a voice about to be struck.
+    void track(MarimbaVoice *const voice);
+    /// Choose a sounding voice to steal under the current policy.
+    MarimbaVoice *victim() const;
+};
+
+}; // namespace kelon
+
+#endif
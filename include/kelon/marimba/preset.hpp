@@ -0,0 +1,112 @@
+
+#ifndef KELON_MARIMBA_PRESET_H
+#define KELON_MARIMBA_PRESET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <kelon/marimba/parameter.hpp>
+
+namespace kelon {
+
+/// Longest preset name stored in a bank, including the terminating null.
+const std::size_t PRESET_NAME_BYTES = 32;
+/// Version of the binary bank layout. Bumped whenever `MarimbaParameter` or
+/// the records change.
+const std::uint32_t PRESET_BANK_VERSION = 2;
+
+static_assert(PARAMETER_COUNT <= 32, "preset masks hold 32 parameters");
+
+/**
+ * A preset as stored in a binary bank: a value for each `MarimbaParameter`,
+ * indexed by the enum, and a mask of the values the preset sets. Records
+ * have a fixed size and are stored in the machine's byte order, so a bank is
+ * read in place from a memory map. Never modified once written.
+ */
+struct PresetRecord {
+    /// Null-terminated name.
+    char name[PRESET_NAME_BYTES];
+    /// Bit `index(p)` is set if the preset sets parameter `p`.
+    std::uint32_t mask;
+    /// Value of each parameter, indexed by `MarimbaParameter`.
+    float values[PARAMETER_COUNT];
+
+    /// Whether the preset sets the given parameter.
+    bool has(const MarimbaParameter p) const {
+        return mask & (std::uint32_t(1) << index(p));
+    }
+    /// Overwrite the parameters the preset sets in `snapshot`.
+    void apply(ParameterSnapshot &snapshot) const;
+};
+
+/// Start of a binary preset bank, followed by `count` records.
+struct PresetBankHeader {
+    /// `KLNP`.
+    char magic[4];
+    std::uint32_t version;
+    /// `PARAMETER_COUNT` when the bank was written.
+    std::uint32_t parameters;
+    /// Number of records.
+    std::uint32_t count;
+};
+
+/**
+ * Read a text preset written by `al::PresetHandler`. The `::name` line names
+ * the preset and each `/parameter f value` line sets a parameter; unknown
+ * parameters are skipped. Returns false if no parameter was read.
+ */
+bool parsePreset(std::istream &in, PresetRecord &record);
+/**
+ * Read the presets listed by an `al::PresetHandler` preset map
+ * (`index:name` lines), in order, from the `.preset` files next to it.
+ * Names without a file are skipped. Returns false if the map cannot be read.
+ */
+bool loadPresetMap(const std::string &path, std::vector<PresetRecord> &records);
+
+/// Write a binary preset bank. Returns false if writing fails.
+bool writePresetBank(std::ostream &out,
+                     const std::vector<PresetRecord> &records);
+
+/**
+ * Binary preset bank, memory-mapped read-only. Records stay valid until the
+ * bank is closed, so the audio thread can hold pointers to them.
+ */
+class PresetBank {
+public:
+    PresetBank() = default;
+    PresetBank(const PresetBank &) = delete;
+    PresetBank &operator=(const PresetBank &) = delete;
+    ~PresetBank();
+
+    /// Map a bank file. Returns false if it cannot be mapped or is not a bank
+    /// of this version.
+    bool open(const std::string &path);
+    /// Unmap the bank. No record may be in use.
+    void close();
+
+    /// Number of presets.
+    std::size_t size() const { return count; }
+    /// Get a preset by index.
+    const PresetRecord &operator[](const std::size_t i) const {
+        return records[i];
+    }
+    /// Find a preset by name. Returns null if there is none.
+    const PresetRecord *find(const std::string &name) const;
+
+private:
+    /// Mapped file.
+    void *mapping = nullptr;
+    /// Size of the mapped file.
+    std::size_t bytes = 0;
+    /// Records in the mapped file.
+    const PresetRecord *records = nullptr;
+    std::size_t count = 0;
+};
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,266 @@
+
+#ifndef KELON_MARIMBA_SAMPLES_H
+#define KELON_MARIMBA_SAMPLES_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/voice.hpp>
+#include <kelon/ring.hpp>
+#include <kelon/tuning.hpp>
+
+namespace kelon {
+
+/// Version of the sample bank layout. Bumped whenever the layout or the way
+/// notes are rendered changes.
+const std::uint32_t SAMPLE_BANK_VERSION = 2;
+/// Velocity layers rendered unless set otherwise.
+const unsigned int DEFAULT_VELOCITY_LAYERS = 1;
+/// Longest a rendered note may ring, in seconds.
+const float MAX_SAMPLE_SECONDS = 8.f;
+/// Megabytes of banks a cache directory holds unless set otherwise.
+const std::uint64_t DEFAULT_SAMPLE_CACHE_MB = 512;
+
+/// Start of a sample bank, followed by `NOTES * layers` entries and their
+/// samples.
+struct SampleBankHeader {
+    /// `KLNS`.
+    char magic[4];
+    std::uint32_t version;
+    /// Velocity layers per note.
+    std::uint32_t layers;
+    /// Sampling rate the notes were rendered at.
+    std::uint32_t sampleRate;
+    /// Hash of everything the rendered notes depend on.
+    std::uint64_t key;
+    /// Total number of samples.
+    std::uint64_t samples;
+    /// Parameters the notes were rendered with.
+    float values[PARAMETER_COUNT];
+};
+
+/// A rendered note in a sample bank.
+struct SampleEntry {
+    /// Index of the first sample in the bank's samples.
+    std::uint64_t offset;
+    /// Number of samples.
+    std::uint32_t frames;
+    /// Frame of the loudest sample. The note may be culled after it.
+    std::uint32_t peak;
+    /// Amplitude of a sample of full scale.
+    float scale;
+};
+
+/**
+ * Every MIDI note of an additive instrument, rendered in mono at `layers`
+ * velocities and stored as 16-bit samples scaled per note. Layer `l` of `n`
+ * is struck with amplitude `(l + 1) / n`.
+ *
+ * Notes are rendered without culling or thinning, so a bank only depends on
+ * its instrument, parameters, tuning, sampling rate and control period. The
+ * bank is cached on disk under a hash of those, and mapped read-only from
+ * the cache when it is loaded again. Never modified once loaded, so any
+ * thread may read it.
+ */
+class SampleBank {
+public:
+    SampleBank() = default;
+    SampleBank(const SampleBank &) = delete;
+    SampleBank &operator=(const SampleBank &) = delete;
+    ~SampleBank();
+
+    /// Hash of everything the notes of a bank with these arguments depend
+    /// on.
+    static std::uint64_t key(const AdditiveMarimbaParameters &instrument,
+                             const ParameterSnapshot &params,
+                             const TuningTable *const tuning,
+                             const unsigned int sampleRate,
+                             const unsigned int layers);
+
+    /**
+     * Map the bank cached in `directory` for these arguments, or render it
+     * and cache it there. Returns false if a rendered bank could not be
+     * written to the cache; it is usable either way. Needs the Gamma
+     * sampling rate to be set.
+     */
+    bool load(const std::string &directory,
+              const AdditiveMarimbaParameters &instrument,
+              const ParameterSnapshot &params,
+              const TuningTable *const tuning, const unsigned int layers);
+
+    /// Velocity layers per note.
+    unsigned int layers() const { return header->layers; }
+    /// Get the entry of a note's velocity layer.
+    const SampleEntry &entry(const unsigned char note,
+                             const unsigned int layer) const {
+        return entries[(note % TuningTable::NOTES) * header->layers + layer];
+    }
+    /// Get the samples of an entry.
+    const std::int16_t *samples(const SampleEntry &e) const {
+        return data + e.offset;
+    }
+
+    /// Whether notes struck with `params` sound like the bank's, whatever
+    /// their amplitude and pan.
+    bool matches(const ParameterSnapshot &params) const;
+
+private:
+    /// Mapped cache file, if the bank was read from the cache.
+    void *mapping = nullptr;
+    /// Size of the mapped file.
+    std::size_t bytes = 0;
+    /// Rendered bank, laid out like the cache file, if it was rendered.
+    std::vector<unsigned char> image;
+
+    const SampleBankHeader *header = nullptr;
+    const SampleEntry *entries = nullptr;
+    const std::int16_t *data = nullptr;
+
+    /// Map a cache file. Returns false if it is missing or not the bank for
+    /// `key`.
+    bool open(const std::string &path, const std::uint64_t key);
+    /// Render the bank into `image`.
+    void render(const AdditiveMarimbaParameters &instrument,
+                const ParameterSnapshot &params,
+                const TuningTable *const tuning, const std::uint64_t key,
+                const unsigned int layers);
+    /// Point the header, entries and samples into a bank's bytes.
+    void use(const unsigned char *const bytes);
+};
+
+/**
+ * Delete the least recently used banks in a cache directory until its banks
+ * take at most `limit` bytes. The most recently used bank is always kept.
+ * Mapping a bank from the cache counts as using it.
+ */
+void trimSampleCache(const std::string &directory, const std::uint64_t limit);
+
+/**
+ * Keeps a `SampleBank` matching the parameters an instrument is played with.
+ * The audio thread asks for the parameters notes are struck with, and a
+ * background thread loads or renders the bank for them and swaps it in once
+ * they have stopped changing, so that sweeping a control renders one bank
+ * rather than one per step. Replaced banks are freed once no note can still
+ * be playing them, and the cache directory is trimmed after each bank.
+ */
+class SampleLoader {
+public:
+    SampleLoader() = default;
+    SampleLoader(const SampleLoader &) = delete;
+    SampleLoader &operator=(const SampleLoader &) = delete;
+    /// Stop loading. No bank may be in use.
+    ~SampleLoader();
+
+    /**
+     * Start loading banks of an instrument from and into a cache directory,
+     * with `layers` velocity layers, keeping at most `cacheBytes` of banks in
+     * the directory. The instrument and tuning are not owned by the loader.
+     * Call once, before audio starts.
+     */
+    void start(const AdditiveMarimbaParameters *const i,
+               const std::string &d, const TuningTable *const t,
+               const unsigned int l,
+               const std::uint64_t c = DEFAULT_SAMPLE_CACHE_MB << 20);
+    /// Whether the loader has been started.
+    bool started() const { return worker.joinable(); }
+
+    /// Ask for the bank of notes struck with `params`. Audio thread only;
+    /// real-time safe.
+    void request(const ParameterSnapshot &params);
+    /// Latest bank loaded, or null. It may not match the latest request.
+    /// Any thread.
+    const SampleBank *bank() const {
+        return current.load(std::memory_order_acquire);
+    }
+
+private:
+    const AdditiveMarimbaParameters *instrument = nullptr;
+    std::string directory;
+    const TuningTable *tuning = nullptr;
+    unsigned int layers = DEFAULT_VELOCITY_LAYERS;
+    std::uint64_t cacheBytes = DEFAULT_SAMPLE_CACHE_MB << 20;
+
+    /// Parameters last requested. Audio thread only.
+    ParameterSnapshot requested;
+    /// Whether anything has been requested.
+    std::atomic<bool> pending{false};
+    /// Requests handed from the audio thread to `worker`.
+    TripleBuffer<ParameterSnapshot> requests;
+
+    /// Bank swapped in last.
+    std::atomic<const SampleBank *> current{nullptr};
+    /// Owner of `current`. Worker only.
+    std::unique_ptr<SampleBank> latest;
+    /// Replaced banks, with the time they were replaced at. Worker only.
+    std::vector<std::pair<std::unique_ptr<SampleBank>,
+                          std::chrono::steady_clock::time_point>>
+        retired;
+
+    /// Whether `worker` should stop.
+    std::atomic<bool> stopping{false};
+    std::thread worker;
+
+    /// Body of the background thread.
+    void run();
+};
+
+/**
+ * Plays the notes of an additive instrument from a `SampleBank`, crossfading
+ * between the two velocity layers around the note's amplitude. The pan is
+ * read once per block, and each block ramps to it, so a voice costs little
+ * more than copying its samples into the mix.
+ *
+ * The ID of a given voice is the MIDI note it sounds.
+ */
+class SampledMarimbaBase : public MarimbaVoice {
+protected:
+    /// Parameters of the instrument the bank was rendered from. Not owned by
+    /// the voice.
+    const AdditiveMarimbaParameters *const parameters;
+
+    SampledMarimbaBase(const AdditiveMarimbaParameters *const params);
+
+    /// Peak of the previous block, after the velocity and pan.
+    float blockPeak = 0.f;
+
+public:
+    /// Play notes from `b` from the next trigger on. The bank is not owned
+    /// by the voice and must outlive the notes.
+    void bank(const SampleBank *const b) { sampleBank = b; }
+
+    void init() override;
+    void onProcess(al::AudioIOData &io) override;
+    void onStrike() override;
+    float loudness() const override { return blockPeak; }
+
+private:
+    /// Bank to play the next note from. Not owned by the voice.
+    const SampleBank *sampleBank = nullptr;
+
+    /// Samples of the lower and upper velocity layers.
+    const std::int16_t *lower = nullptr, *upper = nullptr;
+    /// Gain of each layer, including its scale and crossfade weight.
+    float lowerGain = 0.f, upperGain = 0.f;
+    /// Frames in the note, and frames played.
+    std::uint32_t frames = 0, position = 0;
+    /// Frame after which the note may be culled.
+    std::uint32_t peak = 0;
+
+    /// Left and right pan gains at the end of the previous block.
+    float panGains[2] = {0.f, 0.f};
+    /// Pan position `panGains` was computed from.
+    float panPosition = NAN;
+};
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,64 @@
+
+#ifndef KELON_MARIMBA_STRIKE_H
+#define KELON_MARIMBA_STRIKE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+#include <vector>
+
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/voice.hpp>
+#include <kelon/score.hpp>
+
+namespace kelon {
+
+/// A note of a score placed on the timeline.
+struct Strike {
+    /// Frame the note is struck at.
+    std::uint64_t frame;
+    /// Frame by which the note is predicted to have been freed. The same as
+    /// `frame` until a renderer predicts it.
+    std::uint64_t end;
+    /// Parameters the note is struck with.
+    ParameterSnapshot params;
+    unsigned char note;
+};
+
+/// Parameters of a score note, filled in from an instrument's defaults.
+template <std::size_t N>
+ParameterSnapshot strikeParams(const ParameterDefaults (&table)[N],
+                               const ScoreNote &note) {
+    ParameterSnapshot params = defaults(table);
+    for (std::size_t i = 0; i < N && i < note.parameters.size(); i++) {
+        params[std::get<0>(table[i])] = note.parameters[i];
+    }
+    if (note.velocity >= 0.f) {
+        params[MarimbaParameter::Amplitude] = note.velocity;
+    }
+    return params;
+}
+
+/// Place the notes of a score on the timeline, with the parameters of an
+/// instrument's table of defaults.
+template <std::size_t N>
+std::vector<Strike> place(const Score &score,
+                          const ParameterDefaults (&table)[N],
+                          const double sampleRate) {
+    std::vector<Strike> strikes;
+    strikes.reserve(score.notes.size());
+    for (const ScoreNote &n : score.notes) {
+        Strike s;
+        s.frame = std::llround(n.time * sampleRate);
+        s.end = s.frame;
+        s.note = n.note & 0x7f;
+        s.params = strikeParams(table, n);
+        strikes.push_back(s);
+    }
+    return strikes;
+}
+
+}; // namespace kelon
+
+#endif
@@ -12,6 +12,7 @@
 #include <al/scene/al_PolySynth.hpp>
 
 #include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/voice.hpp>
 
 namespace kelon {
 
@@ -22,19 +23,17 @@ namespace kelon {
  */
 struct SubtractiveMarimbaParameters {
     /// Internal parameter
-    static const std::size_t INTERNAL_PARAMETER_COUNT = 12;
+    static const std::size_t INTERNAL_PARAMETER_COUNT = 13;
     /// Envelope curve.
     static constexpr float ENVELOPE_CURVE = 0.f;
     /// Envelope levels.
     static constexpr float ENVELOPE_LEVELS[4] = {0.f, 1.f, 0.2f, 0.f};
 
     /// Default values for the internal trigger parameters.
-    const std::tuple<const MarimbaParameter, const float, const float,
-                     const float>
-        internalTriggerParameters[INTERNAL_PARAMETER_COUNT];
+    const ParameterDefaults internalTriggerParameters[INTERNAL_PARAMETER_COUNT];
 };
 
-class SubtractiveMarimbaBase : public al::SynthVoice {
+class SubtractiveMarimbaBase : public MarimbaVoice {
 protected:
     const SubtractiveMarimbaParameters *const parameters;
 
@@ -43,7 +42,8 @@ protected:
     /// Destroy the subtractive marimba.
     ~SubtractiveMarimbaBase();
 
-    /// Oscillator.
+    /// Oscillator. Limited to the harmonics below Nyquist, and loses more past
+    /// the attack under CPU pressure.
     gam::DSF<> oscillator;
     /// Noise generator.
     gam::NoiseWhite<> noise;
@@ -57,12 +57,28 @@ protected:
     /// 2-channel panner.
     gam::Pan<> pan;
 
+private:
+    /// Frequency of the note, set when the voice is triggered.
+    float frequency = 0.f;
+    /// Harmonics of the note that fit below Nyquist and the audible range,
+    /// set when the voice is triggered.
+    float budget = 1.f;
+    /// Harmonics the oscillator was last given.
+    float harmonics = 0.f;
+    /// Parameters the envelope, comb filter and pan were last set up from.
+    ParameterSnapshot applied;
+    /// Whether they have been set up since the voice was triggered.
+    bool prepared = false;
+
+    /// Set up the envelope, comb filter and pan from `params`.
+    void prepare(const ParameterSnapshot &params);
+
 public:
     void init() override; // Triggered once per voice.
     void onProcess(al::AudioIOData &io) override;
-    virtual void onProcess(al::Graphics &g) override = 0;
-    void onTriggerOn() override;
+    void onStrike() override;
     void onTriggerOff() override;
+    float loudness() const override;
 };
 }; // namespace kelon
 
@@ -3,38 +3,97 @@
 #define KELON_MARIMBA_VISUALIZATION_H
 
 #include <utility>
+#include <vector>
 
-#include <al/graphics/al_Shapes.hpp>
+#include <al/graphics/al_BufferObject.hpp>
+#include <al/graphics/al_Graphics.hpp>
+#include <al/graphics/al_Shader.hpp>
+#include <al/graphics/al_VAOMesh.hpp>
 
 #include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/samples.hpp>
 #include <kelon/marimba/subtractive.hpp>
+#include <kelon/marimba/voice.hpp>
+#include <kelon/ring.hpp>
 
 namespace kelon {
 
 /// Structure representing the range of a marimba.
 using MarimbaRange = std::pair<const unsigned char, const unsigned char>;
 
+/// Rectangle drawn for a note, laid out as the instance attributes of
+/// `NoteBatch`'s shader.
+struct NoteInstance {
+    /// Position of the bottom left corner.
+    float x, y;
+    /// Size of the rectangle.
+    float width, height;
+    /// Color, including alpha.
+    al::Color color;
+};
+
+/**
+ * Collects the note rectangles of every voice over a frame and draws them in
+ * a single instanced call, stretching one shared unit quad over each.
+ * Graphics thread only.
+ */
+class NoteBatch {
+public:
+    /// Queue a rectangle for the current frame.
+    void add(const NoteInstance &n) { instances.push_back(n); }
+    /// Draw every queued rectangle, then start a new frame.
+    void draw(al::Graphics &g);
+
+private:
+    /// Rectangles queued this frame.
+    std::vector<NoteInstance> instances;
+
+    /// Whether the GPU resources have been created.
+    bool created = false;
+    /// Unit quad shared by every rectangle.
+    al::VAOMesh quad;
+    /// Per-instance rectangles and colors.
+    al::BufferObject buffer;
+    /// Shader placing the quad by instance.
+    al::ShaderProgram shader;
+
+    /// Create the GPU resources. Needs a graphics context.
+    void create();
+};
+
+/// The note batch every visualizer queues into.
+NoteBatch &noteBatch();
+
+/// Most voices published for drawing at once.
+const std::size_t MAX_VISUAL_VOICES = 256;
+
+/// Levels of every sounding voice after an audio block.
+struct LevelSnapshot {
+    /// Number of voices used.
+    std::size_t count = 0;
+    VoiceLevels voices[MAX_VISUAL_VOICES];
+};
+
+/// Snapshots handed from the audio thread to the graphics thread.
+using LevelSnapshots = TripleBuffer<LevelSnapshot>;
+
+/// Queue the visuals of every voice in a snapshot in `noteBatch`, for a
+/// window of the given size.
+void drawLevels(const LevelSnapshot &snapshot, const float windowWidth,
+                const float windowHeight);
+
 /// Visualizer for the marimba.
 class MarimbaVisualizer {
 protected:
     MarimbaVisualizer(const MarimbaRange *const);
     ~MarimbaVisualizer();
 
-    /// Draw the visual associated with a given note.
-    void drawNoteVisual(al::Graphics &g, const unsigned char midiNote,
-                        const float hardness, const float amplitude,
-                        const float windowWidth, const float windowHeight,
-                        const bool reverse) const;
-
-private:
-    /// Graphics mesh.
-    al::Mesh mesh;
+    /// Fill in the displayed range of `levels`.
+    void publishRange(VoiceLevels &levels) const;
 
 public:
     /// The range to visualize. Not owned by the instrument.
     const MarimbaRange *const playingRange;
-    /// Initialize this visualizer for a new voice.
-    void init();
 };
 
 /// ABC for visualizing additive marimbas.
@@ -44,8 +103,7 @@ public:
     AdditiveVisualizedMarimba(const AdditiveMarimbaParameters *const params,
                               const MarimbaRange *const range);
 
-    void init() override;
-    void onProcess(al::Graphics &g) override;
+    void publish(VoiceLevels &levels) override;
 };
 
 /// ABC for visualizing subtractive marimbas.
@@ -56,8 +114,16 @@ public:
         const SubtractiveMarimbaParameters *const params,
         const MarimbaRange *const range);
 
-    void init() override;
-    void onProcess(al::Graphics &g) override;
+    void publish(VoiceLevels &levels) override;
+};
+
+/// ABC for visualizing marimbas played from a sample bank.
+class SampledVisualizedMarimba : public SampledMarimbaBase,
+                                 protected MarimbaVisualizer {
+public:
+    SampledVisualizedMarimba(const AdditiveMarimbaParameters *const params,
+                             const MarimbaRange *const range);
+    void publish(VoiceLevels &levels) override;
 };
 
 }; // namespace kelon
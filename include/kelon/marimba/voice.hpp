@@ -0,0 +1,196 @@
+
+#ifndef KELON_MARIMBA_VOICE_H
+#define KELON_MARIMBA_VOICE_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <tuple>
+
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/spatial.hpp>
+
+namespace kelon {
+
+class ParallelRenderer;
+
+/// Default value, minimum and maximum of an internal trigger parameter.
+using ParameterDefaults =
+    std::tuple<const MarimbaParameter, const float, const float, const float>;
+
+/// Snapshot holding the default value of every parameter in `table`.
+template <std::size_t N>
+ParameterSnapshot defaults(const ParameterDefaults (&table)[N]) {
+    ParameterSnapshot snapshot;
+    for (const auto &values : table) {
+        snapshot[std::get<0>(values)] = std::get<1>(values);
+    }
+    return snapshot;
+}
+
+/// Most partials a voice reports for drawing.
+const std::size_t MAX_VISUAL_PARTIALS = 32;
+
+/// Levels of a sounding voice, published by the audio thread so the graphics
+/// thread can draw it without touching the voice.
+struct VoiceLevels {
+    /// Voice ID.
+    std::int32_t voice;
+    /// MIDI note the voice sounds.
+    std::uint8_t note;
+    /// Lowest and highest notes of the instrument's displayed range.
+    std::uint8_t low, high;
+    /// Number of partials used.
+    std::uint8_t partials;
+    /// MIDI note each partial is displayed at.
+    std::uint8_t notes[MAX_VISUAL_PARTIALS];
+    /// Level of each partial.
+    float levels[MAX_VISUAL_PARTIALS];
+    /// Bit `i` is set if partial `i` is an overtone, drawn hanging down.
+    std::uint32_t overtones;
+    /// Hardness of the strike.
+    float hardness;
+};
+
+/**
+ * Common base of the marimba voices. Owns the enum-indexed handles to the
+ * voice's internal trigger parameters.
+ *
+ * Voices render each block in chunks of up to `CHUNK_FRAMES` frames, one
+ * stage at a time, into the calling thread's `Scratch` buffers, then fade
+ * and pan the mono result into the output (see `block.hpp`): in stereo, or
+ * across a speaker layout.
+ */
+class MarimbaVoice : public al::SynthVoice {
+public:
+    /// Get the value of the given internal trigger parameter.
+    float value(const MarimbaParameter &p) const;
+    /// Set the value of the given internal trigger parameter.
+    void value(const MarimbaParameter &p, const float value);
+    /**
+     * Set the value of the given internal trigger parameter from frame
+     * `offset` of the block about to be rendered, so that a controller change
+     * lands on its frame rather than at the start of the block. Changes are
+     * scheduled in the order of their offsets. Audio thread only.
+     */
+    void schedule(const MarimbaParameter &p, const float value,
+                  const unsigned int offset);
+
+    /// Read every internal trigger parameter.
+    ParameterSnapshot snapshot() const;
+    /// Set every internal trigger parameter from a snapshot. Does not
+    /// allocate, unlike `al::SynthVoice::setTriggerParams`.
+    void assign(const ParameterSnapshot &snapshot);
+
+    /// Hand this voice's blocks to a parallel renderer. Null renders them in
+    /// place. The renderer is not owned by the voice.
+    void renderer(ParallelRenderer *const r);
+    /// Pan this voice across a speaker layout instead of in stereo. Null
+    /// pans in stereo. The layout is not owned by the voice.
+    void speakers(const SpeakerLayout *const layout) { spatial.layout(layout); }
+
+    /// Current loudness of the voice, for choosing which voice to steal.
+    virtual float loudness() const = 0;
+    /// Report the voice's levels for drawing. Audio thread only.
+    virtual void publish(VoiceLevels &levels) = 0;
+
+    /// Fade the voice out over `frames` frames to avoid a click, then free it.
+    void steal(const unsigned int frames);
+    /// Whether the voice is fading out to be freed.
+    bool stolen() const { return fadeStep > 0.f; }
+
+    /// Clear the declick fade and the scheduled changes, then strike the note
+    /// with `onStrike`. Runs on every trigger, so a voice freed mid-fade
+    /// never starts its next note faded, and the changes meant for its last
+    /// note are dropped: the new note is struck with them already made.
+    void onTriggerOn() final;
+
+    /// Order in which the voice was struck, set by `VoicePool`.
+    std::uint64_t order() const { return strikeOrder; }
+    /// Set the order in which the voice was struck.
+    void order(const std::uint64_t o) { strikeOrder = o; }
+
+protected:
+    /// Handles to the internal trigger parameters.
+    ParameterTable parameterTable;
+
+    /// Set the voice up for the note it is struck with.
+    virtual void onStrike() = 0;
+    /// Gains towards the speakers, if the voice pans across a layout.
+    SpatialGains spatial;
+
+    /**
+     * Offer this block to the voice's parallel renderer. Returns true if the
+     * renderer will call `onProcess` again later, in which case the voice
+     * should return without rendering.
+     */
+    bool defer(al::AudioIOData &io);
+
+    /**
+     * Apply the scheduled changes due by frame `frame` of the block. Returns
+     * true if any was applied. Every change must be applied by the end of
+     * the block it was scheduled in.
+     */
+    bool settle(const unsigned int frame);
+
+    /// Apply the declick fade to the next `frames` frames of the voice's
+    /// mono output and advance it. Does nothing unless the voice was stolen.
+    void fade(float *const mono, const unsigned int frames) {
+        if (!stolen()) {
+            return;
+        }
+        for (unsigned int i = 0; i < frames; i++) {
+            mono[i] *= std::fmax(fadeGain - float(i) * fadeStep, 0.f);
+        }
+        fadeGain = std::fmax(fadeGain - float(frames) * fadeStep, 0.f);
+    }
+    /**
+     * Free the voice if it was stolen and its fade has ended. Returns true if
+     * the voice was freed. Call at the end of `onProcess`.
+     */
+    bool faded();
+
+    /// Create the internal trigger parameters from a table of defaults.
+    template <std::size_t N>
+    void createParameters(const ParameterDefaults (&defaults)[N]) {
+        for (const auto &values : defaults) {
+            parameterTable.create(std::get<0>(values), *this,
+                                  std::get<1>(values), std::get<2>(values),
+                                  std::get<3>(values));
+        }
+    }
+
+private:
+    /// Most changes a voice holds for one block. Scheduling more applies the
+    /// held ones early.
+    static const std::size_t MAX_SCHEDULED = 8;
+
+    /// A parameter change waiting for its frame.
+    struct ScheduledValue {
+        MarimbaParameter parameter;
+        float value;
+        /// Frame of the block the change is made at.
+        unsigned int offset;
+    };
+
+    /// Changes waiting for their frames, in the order of their offsets.
+    ScheduledValue scheduled[MAX_SCHEDULED];
+    /// Number of changes waiting.
+    std::size_t scheduledCount = 0;
+
+    /// Renderer this voice's blocks are handed to. Not owned by the voice.
+    ParallelRenderer *parallelRenderer = nullptr;
+
+    /// Gain of the declick fade.
+    float fadeGain = 1.f;
+    /// Change in `fadeGain` per frame. Zero unless the voice was stolen.
+    float fadeStep = 0.f;
+    /// Order in which the voice was struck.
+    std::uint64_t strikeOrder = 0;
+};
+
+}; // namespace kelon
+
+#endif
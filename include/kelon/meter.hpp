@@ -0,0 +1,172 @@
+
+#ifndef KELON_METER_H
+#define KELON_METER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace kelon {
+
+/**
+ * Lock-free histogram of non-negative values in `BUCKETS` buckets of equal
+ * width. Values past the last bucket are counted in it. Any thread may
+ * record into it or read it.
+ */
+class Histogram {
+public:
+    /// Number of buckets.
+    static const std::size_t BUCKETS = 64;
+
+    /// Create a histogram whose buckets are `width` wide.
+    Histogram(const float width) : bucketWidth(width) {}
+
+    /// Count a value.
+    void record(const float value);
+    /// Forget every value.
+    void clear();
+
+    /// Width of each bucket.
+    float width() const { return bucketWidth; }
+    /// Number of values in a bucket.
+    std::uint64_t count(const std::size_t bucket) const {
+        return counts[bucket].load(std::memory_order_relaxed);
+    }
+    /// Number of values recorded.
+    std::uint64_t total() const;
+    /// Upper edge of the bucket holding the `p`th quantile, for `p` in [0,
+    /// 1]. Returns 0 if nothing has been recorded.
+    float quantile(const float p) const;
+
+private:
+    const float bucketWidth;
+    std::atomic<std::uint64_t> counts[BUCKETS] = {};
+};
+
+/// Kinds of voice the meter accounts for separately.
+enum class VoiceType : std::uint8_t {
+    Additive,
+    Subtractive,
+    Modal,
+    Sampled,
+};
+
+/// Number of voice types.
+const std::size_t VOICE_TYPES = 4;
+
+/// Get the name of this voice type.
+const std::string &name(const VoiceType &t);
+
+/**
+ * Where audio time goes. The audio callback reports its wall time against
+ * the block period, and voices report the time they spend rendering, from
+ * whichever thread renders them. Block loads and voice counts go into
+ * histograms, and blocks that overran their period, or came within
+ * `NEAR_MISS_LOAD` of it, are counted.
+ *
+ * Everything is lock-free; `begin` and `end` are audio thread only.
+ */
+class DspMeter {
+public:
+    /// Load above which a block counts as a near miss.
+    static constexpr float NEAR_MISS_LOAD = 0.9f;
+
+    DspMeter();
+
+    /// Whether voices report their render time.
+    bool enabled() const { return metering.load(std::memory_order_relaxed); }
+    /// Start or stop timing voices. Blocks are always timed.
+    void enabled(const bool e) { metering.store(e, std::memory_order_relaxed); }
+
+    /// Mark the start of an audio callback.
+    void begin() { start = std::chrono::steady_clock::now(); }
+    /// Mark the end of an audio callback that rendered `frames` frames.
+    void end(const unsigned int frames, const double sampleRate);
+
+    /// Add time a voice of type `t` spent rendering `frames` frames.
+    void voice(const VoiceType t, const std::int64_t nanoseconds,
+               const unsigned int frames);
+
+    /// Block wall time as a fraction of the block period.
+    const Histogram &loads() const { return loadHistogram; }
+    /// Voices rendered per block.
+    const Histogram &voices() const { return voiceHistogram; }
+
+    /// Blocks timed.
+    std::uint64_t blocks() const {
+        return blockCount.load(std::memory_order_relaxed);
+    }
+    /// Blocks that took longer than their period.
+    std::uint64_t misses() const {
+        return missCount.load(std::memory_order_relaxed);
+    }
+    /// Blocks that took more than `NEAR_MISS_LOAD` of their period.
+    std::uint64_t nearMisses() const {
+        return nearMissCount.load(std::memory_order_relaxed);
+    }
+    /// Load of the last block.
+    float load() const { return lastLoad.load(std::memory_order_relaxed); }
+    /// Highest block load seen.
+    float peak() const { return peakLoad.load(std::memory_order_relaxed); }
+
+    /// Total time voices of a type have spent rendering, in nanoseconds.
+    std::uint64_t nanoseconds(const VoiceType t) const {
+        return voiceTime[std::size_t(t)].load(std::memory_order_relaxed);
+    }
+    /// Total frames voices of a type have rendered.
+    std::uint64_t frames(const VoiceType t) const {
+        return voiceFrames[std::size_t(t)].load(std::memory_order_relaxed);
+    }
+
+    /// Forget everything measured so far.
+    void reset();
+
+    /// Write the CSV header matching `row`.
+    static void header(std::ostream &out);
+    /// Write the current totals as a CSV row, labelled with `seconds`.
+    void row(std::ostream &out, const double seconds) const;
+
+private:
+    std::atomic<bool> metering{true};
+
+    Histogram loadHistogram;
+    Histogram voiceHistogram;
+    std::atomic<std::uint64_t> blockCount{0};
+    std::atomic<std::uint64_t> missCount{0};
+    std::atomic<std::uint64_t> nearMissCount{0};
+    std::atomic<float> lastLoad{0.f};
+    std::atomic<float> peakLoad{0.f};
+    std::atomic<std::uint64_t> voiceTime[VOICE_TYPES] = {};
+    std::atomic<std::uint64_t> voiceFrames[VOICE_TYPES] = {};
+    /// Voices rendered so far in the current block.
+    std::atomic<unsigned int> blockVoices{0};
+
+    /// Start of the current callback.
+    std::chrono::steady_clock::time_point start;
+};
+
+/// The process-wide DSP meter.
+DspMeter &meter();
+
+/**
+ * Times a voice rendering a block, from construction to destruction, and
+ * reports it to `meter()`. Does nothing while the meter is disabled.
+ */
+class VoiceTimer {
+public:
+    VoiceTimer(const VoiceType t, const unsigned int f);
+    ~VoiceTimer();
+
+private:
+    const VoiceType type;
+    const unsigned int frames;
+    const bool timing;
+    std::chrono::steady_clock::time_point start;
+};
+
+}; // namespace kelon
+
+#endif
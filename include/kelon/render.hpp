@@ -0,0 +1,143 @@
+
+#ifndef KELON_RENDER_H
+#define KELON_RENDER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <al/io/al_AudioIOData.hpp>
+
+#include <kelon/marimba/voice.hpp>
+
+namespace kelon {
+
+/**
+ * Renders marimba voices on a persistent pool of worker threads.
+ *
+ * While `al::PolySynth::render` walks its voices, each `MarimbaVoice` bound
+ * to the renderer only records itself as a job. `finish` then splits the jobs
+ * into contiguous ranges, one per thread (the calling thread included). Each
+ * thread renders its range into its own preallocated buffers, and the buffers
+ * are summed into the output in thread order, so the mix is deterministic
+ * for a given thread count. Below `minimumVoices` jobs the voices are
+ * rendered serially in place.
+ *
+ * Rendering a block never allocates or locks. Idle workers spin for a
+ * bounded time, then yield, then sleep briefly. The calling thread never
+ * waits on a sleeping worker: once it has rendered its own range, it waits a
+ * bounded time for the workers to pick up theirs, and renders any range
+ * still waiting in place, into that worker's buffers.
+ */
+class ParallelRenderer {
+public:
+    /// Maximum number of voices deferred per block. Further voices render in
+    /// place.
+    static const std::size_t MAX_JOBS = 1024;
+
+    /**
+     * Create a renderer using `threads` threads in total, including the one
+     * calling `finish`. Fewer than two threads always renders serially.
+     */
+    ParallelRenderer(const unsigned int threads,
+                     const std::size_t minimumVoices = 8);
+    ~ParallelRenderer();
+
+    /**
+     * Allocate the per-thread buffers. Must be called before rendering, off
+     * the audio thread. Blocks of another size are rendered serially.
+     */
+    void prepare(const int framesPerBuffer, const int channels,
+                 const double framesPerSecond);
+
+    /// Number of threads, including the calling thread.
+    unsigned int threads() const { return workers.size() + 1; }
+    /// Number of jobs below which voices are rendered serially.
+    std::size_t minimumVoices() const { return minimum; }
+    /// Set the number of jobs below which voices are rendered serially.
+    void minimumVoices(const std::size_t voices) { minimum = voices; }
+
+    /**
+     * Record a voice's block for later rendering. Called from
+     * `MarimbaVoice::defer`. Returns false if the voice should render in
+     * place.
+     */
+    bool defer(MarimbaVoice &voice, const al::AudioIOData &io);
+
+    /// Render every deferred voice and mix it into `io`.
+    void finish(al::AudioIOData &io);
+
+private:
+    /// A voice's block waiting to be rendered.
+    struct Job {
+        MarimbaVoice *voice;
+        /// Frame the voice starts at.
+        int start;
+    };
+
+    /// Progress of a worker's share of the jobs.
+    enum class Share : std::uint8_t {
+        /// Waiting to be rendered by the worker or the calling thread.
+        Waiting,
+        /// Being rendered.
+        Claimed,
+        /// Rendered, or not part of the block.
+        Done,
+    };
+
+    /// A worker thread and its accumulation buffers.
+    struct Worker {
+        al::AudioIOData io;
+        std::thread thread;
+        /// Progress of the worker's share of the current block.
+        std::atomic<Share> share{Share::Done};
+    };
+
+    std::size_t minimum;
+
+    /// Jobs recorded this block.
+    Job jobs[MAX_JOBS];
+    std::size_t jobCount = 0;
+
+    /// Buffers of the calling thread.
+    al::AudioIOData io;
+    /// Worker threads.
+    std::vector<std::unique_ptr<Worker>> workers;
+    /// Block size the buffers were prepared for.
+    int preparedFrames = 0;
+    /// Channel count the buffers were prepared for.
+    int preparedChannels = 0;
+
+    /// Whether jobs are being rendered. Voices render in place meanwhile.
+    std::atomic<bool> dispatching{false};
+    /// Incremented to start a block on the workers.
+    std::atomic<unsigned int> generation{0};
+    /// Threads taking part in the current block, including the caller.
+    std::atomic<unsigned int> participants{0};
+    /// Set to stop the workers.
+    std::atomic<bool> stopping{false};
+
+    /// Render the share of jobs of thread `index` into `out`.
+    void renderShare(const unsigned int index, al::AudioIOData &out);
+    /// Render the share of worker `index`, counting from 1, into its buffers
+    /// unless another thread has claimed it.
+    void renderClaimed(const unsigned int index);
+    /// Whether a share of the first `count` threads still waits to be
+    /// claimed.
+    bool waiting(const unsigned int count) const;
+    /// Body of worker thread `index`, counting from 1.
+    void run(const unsigned int index);
+};
+
+/**
+ * Number of render threads to use: `KELON_THREADS` if it is set, otherwise
+ * the number of hardware threads.
+ */
+unsigned int defaultRenderThreads();
+
+}; // namespace kelon
+
+#endif
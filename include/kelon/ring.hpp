@@ -0,0 +1,184 @@
+
+#ifndef KELON_RING_H
+#define KELON_RING_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace kelon {
+
+/**
+ * Bounded single-producer, single-consumer ring buffer. Never locks or
+ * allocates, so it can be used on the audio thread. `N` must be a power of
+ * two; the ring holds up to `N` items.
+ */
+template <class T, std::size_t N> class SpscRing {
+    static_assert(N && !(N & (N - 1)), "Ring size must be a power of two.");
+
+public:
+    /// Add an item. Producer only. Returns false if the ring is full.
+    bool push(const T &item) {
+        const std::size_t t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        items[t & (N - 1)] = item;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// The oldest item, or null if the ring is empty. Consumer only.
+    const T *peek() const {
+        const std::size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &items[h & (N - 1)];
+    }
+
+    /// Remove the oldest item. Consumer only. Returns false if the ring is
+    /// empty.
+    bool pop(T &item) {
+        const T *const front = peek();
+        if (!front) {
+            return false;
+        }
+        item = *front;
+        head.store(head.load(std::memory_order_relaxed) + 1,
+                   std::memory_order_release);
+        return true;
+    }
+
+    /// Number of items in the ring. Only exact from the producer or consumer.
+    std::size_t size() const {
+        return tail.load(std::memory_order_acquire) -
+               head.load(std::memory_order_acquire);
+    }
+
+private:
+    T items[N];
+    /// Index of the next item to read. Written by the consumer.
+    alignas(64) std::atomic<std::size_t> head{0};
+    /// Index of the next item to write. Written by the producer.
+    alignas(64) std::atomic<std::size_t> tail{0};
+};
+
+/**
+ * Bounded multi-producer, single-consumer ring buffer. Producers claim slots
+ * with a compare-and-swap and never block or allocate. `N` must be a power of
+ * two.
+ */
+template <class T, std::size_t N> class MpscRing {
+    static_assert(N && !(N & (N - 1)), "Ring size must be a power of two.");
+
+public:
+    MpscRing() {
+        for (std::size_t i = 0; i < N; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    /// Add an item. Returns false if the ring is full.
+    bool push(const T &item) {
+        std::size_t position = tail.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[position & (N - 1)];
+            const std::size_t sequence =
+                cell->sequence.load(std::memory_order_acquire);
+            const std::ptrdiff_t difference =
+                std::ptrdiff_t(sequence) - std::ptrdiff_t(position);
+            if (difference == 0) {
+                if (tail.compare_exchange_weak(position, position + 1,
+                                               std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->item = item;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// Remove the oldest item. Consumer only. Returns false if the ring is
+    /// empty.
+    bool pop(T &item) {
+        const std::size_t position = head.load(std::memory_order_relaxed);
+        Cell &cell = cells[position & (N - 1)];
+        if (cell.sequence.load(std::memory_order_acquire) != position + 1) {
+            return false;
+        }
+        item = cell.item;
+        cell.sequence.store(position + N, std::memory_order_release);
+        head.store(position + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    struct Cell {
+        /// Position the cell is ready for.
+        std::atomic<std::size_t> sequence;
+        T item;
+    };
+
+    Cell cells[N];
+    /// Index of the next item to read. Written by the consumer.
+    alignas(64) std::atomic<std::size_t> head{0};
+    /// Index of the next item to write. Claimed by producers.
+    alignas(64) std::atomic<std::size_t> tail{0};
+};
+
+/**
+ * Hands the latest complete value from a single producer to a single
+ * consumer without locks. The producer fills `back` and publishes it; the
+ * consumer reads whichever value was published last, skipping any published
+ * in between. Neither side ever waits for the other.
+ */
+template <class T> class TripleBuffer {
+public:
+    /// Buffer to fill with the next value. Producer only.
+    T &back() { return buffers[backIndex]; }
+    /// Make `back` the latest value and move on to another buffer. Producer
+    /// only.
+    void publish() {
+        backIndex = middle.exchange(backIndex | FRESH,
+                                    std::memory_order_acq_rel) &
+                    INDEX;
+    }
+
+    /**
+     * Latest published value, or a default-constructed one if nothing has
+     * been published. Consumer only. The reference stays valid until the
+     * next call.
+     */
+    const T &latest() {
+        if (middle.load(std::memory_order_relaxed) & FRESH) {
+            frontIndex =
+                middle.exchange(frontIndex, std::memory_order_acq_rel) & INDEX;
+        }
+        return buffers[frontIndex];
+    }
+
+private:
+    /// Bits of `middle` holding a buffer index.
+    static const unsigned int INDEX = 3;
+    /// Bit of `middle` set when it holds a value not yet read.
+    static const unsigned int FRESH = 4;
+
+    T buffers[3];
+    /// Buffer being filled. Owned by the producer.
+    unsigned int backIndex = 0;
+    /// Buffer between the producer and the consumer, and whether it is
+    /// fresh.
+    alignas(64) std::atomic<unsigned int> middle{1};
+    /// Buffer being read. Owned by the consumer.
+    alignas(64) unsigned int frontIndex = 2;
+};
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,57 @@
+
+#ifndef KELON_SCORE_H
+#define KELON_SCORE_H
+
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace kelon {
+
+/// A note struck in a score.
+struct ScoreNote {
+    /// Time the note is struck, in seconds from the start of the score.
+    double time;
+    /// MIDI note.
+    unsigned char note;
+    /// Velocity from 0 to 1, setting the amplitude. Negative to keep the
+    /// amplitude in `parameters`.
+    float velocity;
+    /// Values of the instrument's internal trigger parameters, in the order
+    /// of its table of defaults. May be shorter than the table, or empty to
+    /// use the defaults.
+    std::vector<float> parameters;
+};
+
+/// Notes of a piece, in the order they are struck.
+struct Score {
+    std::vector<ScoreNote> notes;
+
+    /// Sort the notes by time, keeping notes struck together in order.
+    void sort();
+};
+
+/**
+ * Read the note-ons of a standard MIDI file into a score, following its
+ * tempo map. Every channel is read. Returns false if the file is malformed.
+ */
+bool parseMidi(std::istream &in, Score &score);
+
+/**
+ * Read a text sequence written by `al::SynthSequencer` or
+ * `al::SynthRecorder` into a score. Each `+ time id synth parameters...`
+ * event strikes the MIDI note `id` with the given parameters. `@` events
+ * carry no note and are skipped; other lines are ignored. Returns false if
+ * an event is malformed.
+ */
+bool parseSequence(std::istream &in, Score &score);
+
+/**
+ * Load a score from a MIDI file (`.mid` or `.midi`) or a text sequence
+ * (anything else). Returns false if the file cannot be read.
+ */
+bool loadScore(const std::string &path, Score &score);
+
+}; // namespace kelon
+
+#endif
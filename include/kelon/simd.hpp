@@ -0,0 +1,166 @@
+
+#ifndef KELON_SIMD_H
+#define KELON_SIMD_H
+
+#include <cstddef>
+
+#if defined(__AVX512F__) || defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace kelon {
+
+/**
+ * Thin wrappers over the widest float vector the build targets. The ISA is
+ * chosen at compile time from the compiler's target macros (see
+ * `KELON_NATIVE_ARCH` in `CMakeLists.txt`); without SSE2 every operation is
+ * scalar. Loads and stores are unaligned.
+ */
+namespace simd {
+
+#if defined(__AVX512F__)
+
+/// Vector of `WIDTH` floats.
+using vfloat = __m512;
+/// Number of floats per vector.
+constexpr std::size_t WIDTH = 16;
+
+inline vfloat load(const float *const p) { return _mm512_loadu_ps(p); }
+inline void store(float *const p, const vfloat v) { _mm512_storeu_ps(p, v); }
+inline vfloat set(const float f) { return _mm512_set1_ps(f); }
+inline vfloat add(const vfloat a, const vfloat b) {
+    return _mm512_add_ps(a, b);
+}
+inline vfloat sub(const vfloat a, const vfloat b) {
+    return _mm512_sub_ps(a, b);
+}
+inline vfloat mul(const vfloat a, const vfloat b) {
+    return _mm512_mul_ps(a, b);
+}
+inline vfloat max(const vfloat a, const vfloat b) {
+    return _mm512_max_ps(a, b);
+}
+inline vfloat abs(const vfloat v) { return _mm512_abs_ps(v); }
+/// Subtract one from every lane that is at least one.
+inline vfloat wrap(const vfloat v) {
+    const vfloat one = set(1.f);
+    return _mm512_mask_sub_ps(v, _mm512_cmp_ps_mask(v, one, _CMP_GE_OQ), v,
+                              one);
+}
+/// Sum the lanes of a vector.
+inline float sum(const vfloat v) { return _mm512_reduce_add_ps(v); }
+
+#elif defined(__AVX__)
+
+/// Vector of `WIDTH` floats.
+using vfloat = __m256;
+/// Number of floats per vector.
+constexpr std::size_t WIDTH = 8;
+
+inline vfloat load(const float *const p) { return _mm256_loadu_ps(p); }
+inline void store(float *const p, const vfloat v) { _mm256_storeu_ps(p, v); }
+inline vfloat set(const float f) { return _mm256_set1_ps(f); }
+inline vfloat add(const vfloat a, const vfloat b) {
+    return _mm256_add_ps(a, b);
+}
+inline vfloat sub(const vfloat a, const vfloat b) {
+    return _mm256_sub_ps(a, b);
+}
+inline vfloat mul(const vfloat a, const vfloat b) {
+    return _mm256_mul_ps(a, b);
+}
+inline vfloat max(const vfloat a, const vfloat b) {
+    return _mm256_max_ps(a, b);
+}
+inline vfloat abs(const vfloat v) {
+    return _mm256_andnot_ps(_mm256_set1_ps(-0.f), v);
+}
+/// Subtract one from every lane that is at least one.
+inline vfloat wrap(const vfloat v) {
+    const vfloat one = set(1.f);
+    return _mm256_sub_ps(
+        v, _mm256_and_ps(_mm256_cmp_ps(v, one, _CMP_GE_OQ), one));
+}
+/// Sum the lanes of a vector.
+inline float sum(const vfloat v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v),
+                          _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+#elif defined(__SSE2__)
+
+/// Vector of `WIDTH` floats.
+using vfloat = __m128;
+/// Number of floats per vector.
+constexpr std::size_t WIDTH = 4;
+
+inline vfloat load(const float *const p) { return _mm_loadu_ps(p); }
+inline void store(float *const p, const vfloat v) { _mm_storeu_ps(p, v); }
+inline vfloat set(const float f) { return _mm_set1_ps(f); }
+inline vfloat add(const vfloat a, const vfloat b) { return _mm_add_ps(a, b); }
+inline vfloat sub(const vfloat a, const vfloat b) { return _mm_sub_ps(a, b); }
+inline vfloat mul(const vfloat a, const vfloat b) { return _mm_mul_ps(a, b); }
+inline vfloat max(const vfloat a, const vfloat b) { return _mm_max_ps(a, b); }
+inline vfloat abs(const vfloat v) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+}
+/// Subtract one from every lane that is at least one.
+inline vfloat wrap(const vfloat v) {
+    const vfloat one = set(1.f);
+    return _mm_sub_ps(v, _mm_and_ps(_mm_cmpge_ps(v, one), one));
+}
+/// Sum the lanes of a vector.
+inline float sum(const vfloat v) {
+    __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+#else
+
+/// Vector of `WIDTH` floats.
+using vfloat = float;
+/// Number of floats per vector.
+constexpr std::size_t WIDTH = 1;
+
+inline vfloat load(const float *const p) { return *p; }
+inline void store(float *const p, const vfloat v) { *p = v; }
+inline vfloat set(const float f) { return f; }
+inline vfloat add(const vfloat a, const vfloat b) { return a + b; }
+inline vfloat sub(const vfloat a, const vfloat b) { return a - b; }
+inline vfloat mul(const vfloat a, const vfloat b) { return a * b; }
+inline vfloat max(const vfloat a, const vfloat b) { return a > b ? a : b; }
+inline vfloat abs(const vfloat v) { return v < 0.f ? -v : v; }
+/// Subtract one from every lane that is at least one.
+inline vfloat wrap(const vfloat v) { return v >= 1.f ? v - 1.f : v; }
+/// Sum the lanes of a vector.
+inline float sum(const vfloat v) { return v; }
+
+#endif
+
+/**
+ * Sine of `2 * pi * phase` for phases in [0, 1). Folds the phase onto a
+ * triangle wave and evaluates a 9th-order odd polynomial; the error is below
+ * 4e-6.
+ */
+inline vfloat sine(const vfloat phase) {
+    const vfloat r = wrap(add(phase, set(0.25f)));
+    const vfloat y =
+        sub(set(1.f), mul(set(4.f), abs(sub(r, set(0.5f)))));
+    const vfloat y2 = mul(y, y);
+    vfloat p = set(1.6044118478735982e-4f);
+    p = add(mul(p, y2), set(-4.6817541353186881e-3f));
+    p = add(mul(p, y2), set(7.9692626246167046e-2f));
+    p = add(mul(p, y2), set(-6.4596409750624625e-1f));
+    p = add(mul(p, y2), set(1.5707963267948966f));
+    return mul(p, y);
+}
+
+}; // namespace simd
+
+}; // namespace kelon
+
+#endif
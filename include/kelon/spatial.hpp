@@ -0,0 +1,133 @@
+
+#ifndef KELON_SPATIAL_H
+#define KELON_SPATIAL_H
+
+#include <cmath>
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include <al/io/al_AudioIOData.hpp>
+
+namespace kelon {
+
+/// Most speakers a layout may have.
+const std::size_t MAX_SPEAKERS = 64;
+/// Azimuth span of the pan unless a layout sets it, in degrees: a pan of -1
+/// or 1 points hard left or right, as in stereo.
+const float DEFAULT_PAN_SPREAD = 180.f;
+/// Fall in level per doubling of distance from a source unless a layout sets
+/// it, in dB.
+const float DEFAULT_ROLLOFF = 6.f;
+/// Spatial blur of a source, in the units of speaker distances. Keeps the
+/// gains finite when a source sits on a speaker.
+const float SPATIAL_BLUR = 0.2f;
+
+/// A speaker of a layout.
+struct Speaker {
+    /// Output channel of the speaker.
+    unsigned int channel;
+    /// Position, with x to the right, y to the front and z up.
+    float x, y, z;
+};
+
+/**
+ * Positions of the speakers of an array, read from a layout file, and the
+ * distance-based amplitude panning (DBAP) of sources across them.
+ *
+ * A layout file holds one entry per line. Blank lines and lines starting with
+ * `#` are skipped.
+ *
+ *     # channel, azimuth and elevation in degrees, and distance (1)
+ *     speaker 0 -30 0
+ *     speaker 1 30 0 1.2
+ *     # azimuth span of the pan, in degrees
+ *     spread 360
+ *     # fall in level per doubling of distance, in dB
+ *     rolloff 6
+ *
+ * Azimuths run clockwise from the front, so positive azimuths are to the
+ * right, as positive pans are.
+ */
+class SpeakerLayout {
+public:
+    /// Whether the layout has no speakers, in which case voices pan in
+    /// stereo.
+    bool empty() const { return speakerList.empty(); }
+    /// Number of speakers.
+    std::size_t size() const { return speakerList.size(); }
+    /// Output channels the layout needs: one past its highest channel.
+    unsigned int channels() const;
+    /// Get the speakers.
+    const std::vector<Speaker> &speakers() const { return speakerList; }
+
+    /// Azimuth span of the pan, in degrees.
+    float spread() const { return panSpread; }
+    /// Fall in level per doubling of distance, in dB.
+    float rolloff() const { return rolloffDb; }
+
+    /**
+     * Write the gain of each speaker towards a source to `out`, which holds
+     * `size()` gains. The source is at a pan's azimuth, scaled by the
+     * spread, and at a distance from the centre of the layout. The gains
+     * fall with the distance of each speaker from the source and keep the
+     * power constant.
+     */
+    void gains(const float pan, const float distance, float *const out) const;
+
+private:
+    std::vector<Speaker> speakerList;
+    float panSpread = DEFAULT_PAN_SPREAD;
+    float rolloffDb = DEFAULT_ROLLOFF;
+
+    friend bool parseLayout(std::istream &in, SpeakerLayout &layout);
+};
+
+/// Read a speaker layout. Returns false, leaving the layout unchanged, if the
+/// layout cannot be read or has no speakers.
+bool parseLayout(std::istream &in, SpeakerLayout &layout);
+/// Read a speaker layout from a file. Returns false if it cannot be read.
+bool loadLayout(const std::string &path, SpeakerLayout &layout);
+
+/**
+ * Gains of a voice towards each speaker of a layout. They are computed once
+ * per block, and only when the source moves, then ramped to across the
+ * block, so panning a voice costs O(speakers) per block and mixing it is a
+ * multiply-accumulate per speaker.
+ */
+class SpatialGains {
+public:
+    /// Pan across a layout. Null pans in stereo. The layout is not owned.
+    void layout(const SpeakerLayout *const l) { speakerLayout = l; }
+    /// Whether a layout is set.
+    bool active() const { return speakerLayout != nullptr; }
+
+    /// Start the next block at the source's gains, rather than ramping to
+    /// them. Call when a note is struck.
+    void reset();
+    /// Aim the gains at a source for the next `frames` frames, and ramp to
+    /// them from where the last block ended.
+    void aim(const float pan, const float distance, const unsigned int frames);
+    /// Add `frames` frames of `mono` to the speakers' channels, starting at
+    /// frame `start` of the output, and advance the ramps.
+    void accumulate(const float *const mono, const unsigned int frames,
+                    al::AudioIOData &io, const unsigned int start);
+
+private:
+    const SpeakerLayout *speakerLayout = nullptr;
+    /// Gain of each speaker, ramping towards `targets`.
+    float current[MAX_SPEAKERS] = {};
+    /// Gain of each speaker at the end of the block.
+    float targets[MAX_SPEAKERS] = {};
+    /// Change in each gain per frame.
+    float steps[MAX_SPEAKERS] = {};
+    /// Whether any gain changes over the block.
+    bool ramping = false;
+    /// Source `targets` was computed for. NaN until the first block.
+    float sourcePan = NAN, sourceDistance = NAN;
+};
+
+}; // namespace kelon
+
+#endif
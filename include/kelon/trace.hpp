@@ -0,0 +1,133 @@
+
+#ifndef KELON_TRACE_H
+#define KELON_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include <kelon/ring.hpp>
+
+namespace kelon {
+
+/// Verbosity of a trace record. Lower levels are more severe.
+enum class TraceLevel : std::uint8_t {
+    Error,
+    Warning,
+    Info,
+    Debug,
+};
+
+/// What a trace record reports.
+enum class TraceEvent : std::uint8_t {
+    /// A voice was triggered.
+    VoiceTrigger,
+    /// A voice rendered a block.
+    VoiceProcess,
+    /// A voice freed itself.
+    VoiceFree,
+    /// A voice was stolen for another note.
+    VoiceSteal,
+    /// A note was dropped because no voice was free.
+    NoteDropped,
+    /// The load governor dropped a quality tier.
+    QualityDrop,
+    /// The load governor climbed back a quality tier.
+    QualityRecover,
+    /// The ring was full and records were dropped.
+    Dropped,
+};
+
+/// Get the name of this trace level.
+const std::string &name(const TraceLevel &l);
+/// Get the name of this trace event.
+const std::string &name(const TraceEvent &e);
+/// Parse a trace level name. Returns false if the name is unknown.
+bool parse(const std::string &s, TraceLevel &l);
+
+/// Fixed-size binary trace record.
+struct TraceRecord {
+    /// Time on the event clock, in nanoseconds.
+    std::int64_t timestamp;
+    /// Voice ID.
+    std::int32_t voice;
+    /// Frequency being played, a count for `Dropped` records, or the load
+    /// for quality records.
+    float frequency;
+    TraceLevel level;
+    TraceEvent event;
+    /// MIDI note.
+    std::uint8_t note;
+};
+
+/**
+ * Real-time safe diagnostics. Any thread, including the audio thread and
+ * render workers, records into a lock-free ring; records beyond the current
+ * verbosity are discarded before touching the ring. A background thread
+ * drains the ring to a file.
+ */
+class Tracer {
+public:
+    Tracer();
+    ~Tracer();
+
+    /// Set the most verbose level that is recorded.
+    void level(const TraceLevel l);
+    /// Get the most verbose level that is recorded.
+    TraceLevel level() const;
+    /// Whether records at the given level are kept.
+    bool enabled(const TraceLevel l) const {
+        return std::uint8_t(l) <= verbosity.load(std::memory_order_relaxed);
+    }
+
+    /// Record an event. Never blocks; drops the record if the ring is full.
+    void record(const TraceLevel l, const TraceEvent e, const int voice,
+                const unsigned char note, const float frequency);
+
+    /**
+     * Start draining records to `out`, which is not owned by the tracer.
+     * Does nothing if the tracer is already running.
+     */
+    void start(std::FILE *const out);
+    /// Start draining records to the file at `path`. Returns false if the
+    /// file could not be opened.
+    bool start(const std::string &path);
+    /// Drain the remaining records and stop the background thread.
+    void stop();
+
+private:
+    MpscRing<TraceRecord, 4096> ring;
+    std::atomic<std::uint8_t> verbosity;
+    /// Records dropped since the last drain.
+    std::atomic<std::uint32_t> dropped{0};
+
+    std::thread drainer;
+    std::atomic<bool> running{false};
+    /// Output of the drainer.
+    std::FILE *output = nullptr;
+    /// Whether `output` was opened by the tracer.
+    bool ownsOutput = false;
+
+    /// Write every waiting record. Returns the number written.
+    std::size_t drain();
+    /// Body of the background thread.
+    void run();
+};
+
+/// The process-wide tracer.
+Tracer &tracer();
+
+/// Record an event on the process-wide tracer.
+inline void trace(const TraceLevel l, const TraceEvent e, const int voice,
+                  const unsigned char note, const float frequency) {
+    Tracer &t = tracer();
+    if (t.enabled(l)) {
+        t.record(l, e, voice, note, frequency);
+    }
+}
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,53 @@
+
+#ifndef KELON_TUNING_H
+#define KELON_TUNING_H
+
+#include <array>
+#include <cstddef>
+#include <istream>
+#include <string>
+
+namespace kelon {
+
+/**
+ * Frequency of every MIDI note. Defaults to twelve-tone equal temperament
+ * with A4 at 440 Hz.
+ */
+class TuningTable {
+public:
+    /// Number of MIDI notes.
+    static const std::size_t NOTES = 128;
+
+    /// Create an equal-tempered table.
+    TuningTable();
+
+    /// Get the frequency of a MIDI note.
+    float frequency(const unsigned char note) const {
+        return frequencies[note % NOTES];
+    }
+    /// Set the frequency of a MIDI note.
+    void frequency(const unsigned char note, const float freq) {
+        frequencies[note % NOTES] = freq;
+    }
+
+private:
+    std::array<float, NOTES> frequencies;
+};
+
+/**
+ * Read a Scala scale (`.scl`) into a tuning table. Degree 0 of the scale sounds
+ * at `baseNote`, tuned to `baseFrequency`, and the last degree of the scale is
+ * its period. Returns false, leaving the table unchanged, if the scale cannot
+ * be read.
+ */
+bool parseScala(std::istream &in, TuningTable &table,
+                const unsigned char baseNote = 60,
+                const float baseFrequency = 261.625565f);
+/// Read a Scala scale from a file. Returns false if it cannot be read.
+bool loadScala(const std::string &path, TuningTable &table,
+               const unsigned char baseNote = 60,
+               const float baseFrequency = 261.625565f);
+
+}; // namespace kelon
+
+#endif
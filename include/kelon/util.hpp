@@ -2,6 +2,8 @@
 #ifndef KELON_UTIL_H
 #define KELON_UTIL_H
 
+#include <mutex>
+
 namespace kelon {
 
 const unsigned char C2 = 36;
@@ -22,6 +24,14 @@ float reduceRange(const float f);
 /// Simulate the decay of a marimba.
 float marimbaDecay(const unsigned char midiNote, const float baseDecay);
 
+/**
+ * Lock held while Gamma generators are constructed or destroyed off the
+ * audio thread. Gamma registers every generator with the global sampling
+ * domain when it is constructed and unregisters it when it is destroyed,
+ * which is not thread-safe, so every thread doing either shares this lock.
+ */
+std::mutex &gammaAllocation();
+
 }; // namespace kelon
 
 #endif
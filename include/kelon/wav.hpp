@@ -0,0 +1,74 @@
+
+#ifndef KELON_WAV_H
+#define KELON_WAV_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace kelon {
+
+/// Encoding of the samples in a WAV file.
+enum class SampleFormat : std::uint8_t {
+    /// 16-bit integer PCM.
+    Pcm16,
+    /// 24-bit integer PCM.
+    Pcm24,
+    /// 32-bit IEEE float.
+    Float32,
+};
+
+/// Get the name of this sample format.
+const std::string &name(const SampleFormat &f);
+/// Parse a sample format name. Returns false if the name is unknown.
+bool parse(const std::string &s, SampleFormat &f);
+
+/**
+ * Streams interleaved frames to a WAV file through a buffer. Space for an
+ * RF64 `ds64` chunk is reserved up front, so files that outgrow the 4 GiB
+ * limit of RIFF are turned into RF64 when they are closed.
+ */
+class WavWriter {
+public:
+    /// Size of the write buffer, in bytes.
+    static const std::size_t BUFFER_BYTES = 1 << 20;
+
+    ~WavWriter();
+
+    /// Create a file and write its header. Returns false if the file cannot
+    /// be created.
+    bool open(const std::string &path, const unsigned int channels,
+              const unsigned int sampleRate, const SampleFormat format);
+    /// Append `frames` interleaved frames. Samples are clipped to [-1, 1] for
+    /// integer formats. Returns false if writing fails.
+    bool write(const float *const samples, const std::size_t frames);
+    /// Write out the buffer and finish the header. Returns false if writing
+    /// fails.
+    bool close();
+
+    /// Number of frames written so far.
+    std::uint64_t frames() const { return frameCount; }
+
+private:
+    std::FILE *file = nullptr;
+    unsigned int channelCount = 0;
+    SampleFormat sampleFormat = SampleFormat::Pcm24;
+    /// Bytes per sample.
+    unsigned int sampleBytes = 0;
+    std::uint64_t frameCount = 0;
+    /// Offset of the first sample in the file.
+    long dataOffset = 0;
+
+    /// Encoded samples not yet written.
+    std::vector<unsigned char> buffer;
+    /// Whether a write has failed.
+    bool failed = false;
+
+    /// Write out the buffer.
+    bool flush();
+};
+
+}; // namespace kelon
+
+#endif
@@ -1,19 +1,342 @@
 
 #include "app.hpp"
 
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
+
+#include <kelon/control.hpp>
+#include <kelon/cull.hpp>
+#include <kelon/governor.hpp>
+#include <kelon/marimba/plan.hpp>
+#include <kelon/meter.hpp>
+#include <kelon/trace.hpp>
 
 namespace kelon {
 
-void App::triggerNote(const unsigned char note) {
-    synthManager.triggerOn(note);
+/// Voices sounding at once unless `KELON_POLYPHONY` is set.
+const unsigned int DEFAULT_POLYPHONY = 64;
+/// Seconds between rows of the DSP meter's CSV file.
+const double METER_INTERVAL = 1.;
+
+void App::triggerNote(const std::uint8_t channel, const unsigned char note,
+                      const float velocity, const int offset) {
+    const Instrument instrument = ensemble.route(channel);
+
+    // Each note carries its own velocity, so the parameters are only read.
+    // The marimba plays the control panel, or the preset chosen in its
+    // place.
+    ParameterSnapshot params = ensemble.parameters(instrument);
+    if (instrument == Instrument::Marimba) {
+        params = synthManager.voice()->snapshot();
+        if (const PresetRecord *const p =
+                preset.load(std::memory_order_acquire)) {
+            p->apply(params);
+        }
+    }
+
+    // Play additive notes from their instrument's sample bank once it has
+    // been rendered for these parameters, and synthesize them until then.
+    MarimbaVoice *voice = nullptr;
+    SampleLoader *const loader =
+        std::size_t(instrument) < SAMPLED_INSTRUMENTS &&
+                samples[std::size_t(instrument)].started()
+            ? &samples[std::size_t(instrument)]
+            : nullptr;
+    const SampleBank *const bank = loader ? loader->bank() : nullptr;
+    if (loader) {
+        loader->request(params);
+    }
+    if (bank && bank->matches(params)) {
+        voice = ensemble.acquire(instrument, note, bank);
+    } else if (ensemble.banked(instrument)) {
+        // The instrument's voice bank plays the note with the rest of its
+        // notes, after the synth.
+        params[MarimbaParameter::Amplitude] = velocity;
+        ensemble.strike(instrument, note, params, offset);
+        return;
+    } else {
+        voice = ensemble.acquire(instrument, note);
+    }
+    if (!voice) {
+        // Every voice of the instrument is fading out.
+        return;
+    }
+
+    voice->assign(params);
+    voice->value(MarimbaParameter::Amplitude, velocity);
+    voice->renderer(&renderer);
+    voice->speakers(layout.empty() ? nullptr : &layout);
+    // Like `al::PolySynth::getVoice` in `acquire`, this takes one of the
+    // synth's mutexes. Only the audio thread takes them, so they are never
+    // contended and never block.
+    synthManager.synth().triggerOn(voice, offset, note);
+}
+
+void App::processEvents(al::AudioIOData &io) {
+    const std::int64_t blockStart = eventClock();
+    const double sampleRate = io.framesPerSecond();
+    const int frames = io.framesPerBuffer();
+
+    if (!previousBlockStart) {
+        previousBlockStart =
+            blockStart - std::int64_t(frames * 1e9 / sampleRate);
+    }
+
+    // Merge both queues in arrival order, leaving events that arrived after
+    // this block started for the next one.
+    while (true) {
+        const NoteEvent *const midi = midiEvents.peek();
+        const NoteEvent *const key = keyboardEvents.peek();
+        if (!midi && !key) {
+            break;
+        }
+
+        EventQueue &queue =
+            !key || (midi && midi->timestamp <= key->timestamp)
+                ? midiEvents
+                : keyboardEvents;
+        if (queue.peek()->timestamp >= blockStart) {
+            break;
+        }
+
+        NoteEvent e;
+        queue.pop(e);
+        processEvent(e, frameOffset(e.timestamp, previousBlockStart,
+                                    sampleRate, frames));
+    }
+
+    previousBlockStart = blockStart;
+}
+
+void App::processEvent(const NoteEvent &e, const int offset) {
+    auto *const voice = synthManager.voice();
+
+    switch (e.type) {
+    case NoteEvent::Type::NoteOn:
+        triggerNote(e.channel, e.number, e.value, offset);
+        break;
+    case NoteEvent::Type::NoteOff:
+        synthManager.triggerOff(e.number);
+        break;
+    case NoteEvent::Type::Control: {
+        MarimbaParameter parameter;
+        switch (e.number) {
+        case 7:
+            parameter = MarimbaParameter::Hardness;
+            break;
+        case 11:
+            parameter = MarimbaParameter::Brightness;
+            break;
+        default:
+            return;
+        }
+
+        // Controller changes affect the channel's instrument: notes struck
+        // after them, through its parameters, and sounding notes from the
+        // change's frame, gliding to the new value over a control period.
+        // The marimba's parameters are the template voice's.
+        const Instrument instrument = ensemble.route(e.channel);
+        if (instrument == Instrument::Marimba) {
+            voice->value(parameter, e.value);
+        }
+        ensemble.value(instrument, parameter, e.value, offset);
+        break;
+    }
+    case NoteEvent::Type::Program:
+        // Programs beyond the bank leave the preset alone.
+        if (e.number < presets.size()) {
+            preset.store(&presets[e.number], std::memory_order_release);
+        }
+        break;
+    }
 }
 
 void App::onCreate() {
+    // Start real-time safe diagnostics. `KELON_TRACE` sets the verbosity and
+    // `KELON_TRACE_FILE` redirects them from stderr to a file.
+    TraceLevel level;
+    const char *const verbosity = std::getenv("KELON_TRACE");
+    if (verbosity && parse(verbosity, level)) {
+        tracer().level(level);
+    }
+    const char *const path = std::getenv("KELON_TRACE_FILE");
+    if (!path || !tracer().start(path)) {
+        tracer().start(stderr);
+    }
+
+    // Retune the additive and modal instruments to the Scala scale in
+    // `KELON_TUNING`.
+    const char *const scale = std::getenv("KELON_TUNING");
+    bool tuned = false;
+    if (scale) {
+        if (loadScala(scale, tuning)) {
+            tuned = true;
+            AdditiveMarimba::PARAMETERS->plans->tuning(&tuning);
+            AdditiveXylophone::PARAMETERS->plans->tuning(&tuning);
+            EnsembleModalMarimba::PARAMETERS->tuning->store(
+                &tuning, std::memory_order_release);
+            std::cerr << "Loaded tuning from " << scale << "." << std::endl;
+        } else {
+            std::cerr << "Could not read tuning from " << scale << "."
+                      << std::endl;
+        }
+    }
+
+    // Map the binary preset bank in `KELON_PRESETS`, compiled from text
+    // presets by `kelon-presets`.
+    const char *const bank = std::getenv("KELON_PRESETS");
+    if (bank) {
+        if (presets.open(bank)) {
+            std::cerr << "Loaded " << presets.size() << " presets from "
+                      << bank << "." << std::endl;
+        } else {
+            std::cerr << "Could not read presets from " << bank << "."
+                      << std::endl;
+        }
+    }
+
+    // `KELON_CONTROL_PERIOD` sets how many frames pass between envelope and
+    // parameter updates.
+    const char *const period = std::getenv("KELON_CONTROL_PERIOD");
+    if (period && std::atoi(period) > 0) {
+        controlPeriod(std::atoi(period));
+    }
+
+    // `KELON_CULL_DB` sets how far below the mix a partial or voice may fall
+    // before it stops being rendered.
+    const char *const cull = std::getenv("KELON_CULL_DB");
+    if (cull) {
+        culler().threshold(std::atof(cull));
+    }
+
+    // `KELON_LIMITER` sets the level the master bus is limited to, in dBFS,
+    // or takes the limiter out of the master bus if it is `off`.
+    const char *const ceiling = std::getenv("KELON_LIMITER");
+    if (ceiling) {
+        if (std::string(ceiling) == "off") {
+            limiting = false;
+        } else {
+            limiter.threshold(std::atof(ceiling));
+        }
+    }
+
+    // `KELON_METER_FILE` logs the DSP meter as CSV.
+    const char *const log = std::getenv("KELON_METER_FILE");
+    if (log) {
+        meterFile.open(log);
+        if (meterFile.is_open()) {
+            DspMeter::header(meterFile);
+        } else {
+            std::cerr << "Could not open " << log << "." << std::endl;
+        }
+    }
+
+    // `KELON_QUALITY` holds a quality tier instead of letting the load
+    // governor choose one.
+    QualityTier quality;
+    const char *const tier = std::getenv("KELON_QUALITY");
+    if (tier && parse(tier, quality)) {
+        governor().tier(quality);
+        governor().enabled(false);
+    }
+
+    // Allocate every voice before audio starts. `KELON_POLYPHONY` caps the
+    // voices sounding at once and `KELON_STEAL` chooses which voice a note
+    // beyond the cap steals.
+    const char *const polyphony = std::getenv("KELON_POLYPHONY");
+    const unsigned int cap = polyphony && std::atoi(polyphony) > 0
+                                 ? std::atoi(polyphony)
+                                 : DEFAULT_POLYPHONY;
+    StealPolicy policy;
+    const char *const steal = std::getenv("KELON_STEAL");
+    if (steal && parse(steal, policy)) {
+        ensemble.policy(policy);
+    }
+    // `KELON_SAMPLES` plays the additive instruments from sample banks
+    // cached in the directory it names.
+    const char *const cache = std::getenv("KELON_SAMPLES");
+    // `KELON_ENGINE=bank` synthesizes the additive instruments with a voice
+    // bank each instead of a voice per note. The banks pan in stereo, so
+    // they are not used with a speaker layout.
+    AdditiveEngine engine = AdditiveEngine::Voices;
+    const char *const engineName = std::getenv("KELON_ENGINE");
+    if (engineName && !parse(engineName, engine)) {
+        std::cerr << "Unknown engine " << engineName << "." << std::endl;
+    }
+    if (engine == AdditiveEngine::Bank && !layout.empty()) {
+        std::cerr << "Voice banks pan in stereo only: synthesizing the "
+                     "additive instruments with voices."
+                  << std::endl;
+        engine = AdditiveEngine::Voices;
+    }
+    // Keep spare voices for notes struck while stolen voices fade out. Each
+    // instrument gets its own voices.
+    ensemble.allocate(cap, cap / 8 > 4 ? cap / 8 : 4, cache != nullptr,
+                      engine == AdditiveEngine::Bank);
+
+    // `KELON_CHANNELS` routes MIDI channels 1, 2, ... to the instruments in
+    // a comma-separated list, e.g. `marimba,xylophone,subtractive`.
+    const char *const channels = std::getenv("KELON_CHANNELS");
+    if (channels) {
+        std::stringstream list(channels);
+        std::string item;
+        for (std::uint8_t c = 0;
+             c < MIDI_CHANNELS && std::getline(list, item, ','); c++) {
+            Instrument instrument;
+            if (parse(item, instrument)) {
+                ensemble.route(c, instrument);
+            } else {
+                std::cerr << "Unknown instrument " << item << "." << std::endl;
+            }
+        }
+    }
+
     // Disable keyboard navigation.
     navControl().active(false);
     // Set Gamma sampling rate from Allolib app's audio.
     gam::sampleRate(audioIO().framesPerSecond());
+
+    // Start loading the sample banks, rendered at the Gamma sampling rate.
+    // `KELON_SAMPLE_LAYERS` sets the velocity layers rendered per note, and
+    // `KELON_SAMPLE_CACHE_MB` the megabytes of banks the cache keeps.
+    if (cache) {
+        const char *const count = std::getenv("KELON_SAMPLE_LAYERS");
+        const unsigned int layers = count && std::atoi(count) > 0
+                                        ? std::atoi(count)
+                                        : DEFAULT_VELOCITY_LAYERS;
+        const char *const size = std::getenv("KELON_SAMPLE_CACHE_MB");
+        const std::uint64_t megabytes = size && std::atoll(size) > 0
+                                            ? std::atoll(size)
+                                            : DEFAULT_SAMPLE_CACHE_MB;
+        const TuningTable *const table = tuned ? &tuning : nullptr;
+        samples[std::size_t(Instrument::Marimba)].start(
+            AdditiveMarimba::PARAMETERS, cache, table, layers,
+            megabytes << 20);
+        samples[std::size_t(Instrument::Xylophone)].start(
+            AdditiveXylophone::PARAMETERS, cache, table, layers,
+            megabytes << 20);
+        // Render the banks of the default parameters before the first note.
+        // Audio has not started, so this thread may request them.
+        samples[std::size_t(Instrument::Marimba)].request(
+            synthManager.voice()->snapshot());
+        samples[std::size_t(Instrument::Xylophone)].request(
+            ensemble.parameters(Instrument::Xylophone));
+        std::cerr << "Playing the additive instruments from sample banks in "
+                  << cache << "." << std::endl;
+    }
+    // Allocate the parallel renderer's buffers before audio starts.
+    renderer.prepare(audioIO().framesPerBuffer(), audioIO().channelsOut(),
+                     audioIO().framesPerSecond());
+    // Allocate the limiter's delay lines before audio starts.
+    if (limiting) {
+        limiter.prepare(audioIO().framesPerSecond(), audioIO().channelsOut());
+        if (!Limiter::available()) {
+            std::cerr << "Built without SimpleCompressor: the master bus is "
+                         "metered but not limited."
+                      << std::endl;
+        }
+    }
 }
 
 void App::onInit() {
@@ -43,12 +366,46 @@ void App::onResize(const int w, const int h) {
     value(MarimbaParameter::VisualHeight, *voice, h);
 }
 
-void App::onSound(al::AudioIOData &io) { synthManager.render(io); }
+void App::onSound(al::AudioIOData &io) {
+    meter().begin();
+    processEvents(io);
+    synthManager.render(io);
+    // Render the voices deferred by `synthManager` across cores.
+    renderer.finish(io);
+    // Render the notes of the additive instruments' voice banks, if any.
+    ensemble.render(io);
+    // Track the mix level that decides which voices are audible.
+    culler().measure(io);
+    // Limit the master bus, after the cull level is measured from the mix
+    // the voices actually make.
+    limiter.process(io);
+    publishLevels();
+    // Time the block, then thin the voices if it came close to its
+    // deadline.
+    meter().end(io.framesPerBuffer(), io.framesPerSecond());
+    governor().update(meter().load(), io.framesPerBuffer(),
+                      io.framesPerSecond());
+}
+
+void App::publishLevels() {
+    LevelSnapshot &snapshot = levels.back();
+    snapshot.count = 0;
+    for (al::SynthVoice *voice = synthManager.synth().getActiveVoices();
+         voice && snapshot.count < MAX_VISUAL_VOICES; voice = voice->next) {
+        if (voice->active()) {
+            static_cast<MarimbaVoice *>(voice)->publish(
+                snapshot.voices[snapshot.count++]);
+        }
+    }
+    levels.publish();
+}
 
 void App::onDraw(al::Graphics &g) {
     g.clear();
     g.camera(al::Viewpoint::ORTHO_FOR_2D);
-    synthManager.render(g);
+    // Draw the voices as of the latest audio block, in one call.
+    drawLevels(levels.latest(), width(), height());
+    noteBatch().draw(g);
     al::imguiDraw();
 }
 
@@ -58,10 +415,147 @@ void App::onAnimate(const double _dt) {
     // Draw synth control panel.
     synthManager.drawFields();
     synthManager.drawPresets();
+    drawMeter();
+    drawPresetBank();
+    drawChannels();
+    drawLimiter();
     synthManager.drawSynthSequencer();
     synthManager.drawSynthRecorder();
 
+    // Draw culling controls.
+    ImGui::Begin("Culling");
+    float threshold = culler().threshold();
+    if (ImGui::SliderFloat("Threshold (dB)", &threshold, ABSOLUTE_CULL_FLOOR,
+                           0.f)) {
+        culler().threshold(threshold);
+    }
+    ImGui::Text("Partials culled: %llu",
+                (unsigned long long)culler().culledPartials());
+    ImGui::Text("Voices culled: %llu",
+                (unsigned long long)culler().culledVoices());
+    ImGui::End();
+
+    // Draw the load governor's state.
+    ImGui::Begin("Load");
+    ImGui::Text("Callback load: %.0f%%", meter().load() * 100.f);
+    bool governing = governor().enabled();
+    if (ImGui::Checkbox("Adapt quality", &governing)) {
+        governor().enabled(governing);
+    }
+    for (std::size_t t = 0; t < QUALITY_TIERS; t++) {
+        const QualityTier tier = QualityTier(t);
+        ImGui::Text("%s %s: %.1f s", tier == governor().tier() ? ">" : " ",
+                    name(tier).c_str(), governor().seconds(tier));
+    }
+    ImGui::End();
+
     al::imguiEndFrame();
+
+    // Log the DSP meter.
+    meterTime += _dt;
+    if (meterFile.is_open() && meterTime >= meterNext) {
+        meter().row(meterFile, meterTime);
+        meterFile.flush();
+        meterNext = meterTime + METER_INTERVAL;
+    }
+}
+
+void App::drawMeter() {
+    const DspMeter &m = meter();
+
+    ImGui::Separator();
+    ImGui::Text("DSP load: %3.0f%% (peak %3.0f%%)", m.load() * 100.f,
+                m.peak() * 100.f);
+    ImGui::Text("Load p50 %.0f%%, p99 %.0f%%", m.loads().quantile(0.5f) * 100.f,
+                m.loads().quantile(0.99f) * 100.f);
+    ImGui::Text("Deadline misses: %llu, within %.0f%%: %llu",
+                (unsigned long long)m.misses(),
+                (1.f - DspMeter::NEAR_MISS_LOAD) * 100.f,
+                (unsigned long long)m.nearMisses());
+
+    float loads[Histogram::BUCKETS];
+    for (std::size_t i = 0; i < Histogram::BUCKETS; i++) {
+        loads[i] = m.loads().count(i);
+    }
+    ImGui::PlotHistogram("Block load", loads, Histogram::BUCKETS);
+    ImGui::Text("Voices per block p50 %.0f, p99 %.0f",
+                m.voices().quantile(0.5f), m.voices().quantile(0.99f));
+
+    // Time per frame rendered by each voice type.
+    for (std::size_t t = 0; t < VOICE_TYPES; t++) {
+        const VoiceType type = VoiceType(t);
+        if (m.frames(type)) {
+            ImGui::Text("%s: %.1f ns/frame, %.2f s total", name(type).c_str(),
+                        double(m.nanoseconds(type)) / m.frames(type),
+                        m.nanoseconds(type) * 1e-9);
+        }
+    }
+}
+
+void App::drawPresetBank() {
+    if (!presets.size()) {
+        return;
+    }
+
+    ImGui::Begin("Preset bank");
+    const PresetRecord *const current =
+        preset.load(std::memory_order_acquire);
+    if (ImGui::RadioButton("Control panel", !current)) {
+        preset.store(nullptr, std::memory_order_release);
+    }
+    for (std::size_t i = 0; i < presets.size(); i++) {
+        const PresetRecord *const p = &presets[i];
+        if (ImGui::RadioButton(p->name, current == p)) {
+            preset.store(p, std::memory_order_release);
+        }
+    }
+    ImGui::End();
+}
+
+void App::drawChannels() {
+    const char *names[INSTRUMENTS];
+    for (std::size_t i = 0; i < INSTRUMENTS; i++) {
+        names[i] = name(Instrument(i)).c_str();
+    }
+
+    ImGui::Begin("Channels");
+    for (std::uint8_t c = 0; c < MIDI_CHANNELS; c++) {
+        const std::string label = "Channel " + std::to_string(c + 1);
+        int instrument = int(ensemble.route(c));
+        if (ImGui::Combo(label.c_str(), &instrument, names, INSTRUMENTS)) {
+            ensemble.route(c, Instrument(instrument));
+        }
+    }
+    ImGui::End();
+}
+
+void App::drawLimiter() {
+    if (!limiting) {
+        return;
+    }
+
+    ImGui::Begin("Limiter");
+    if (!Limiter::available()) {
+        ImGui::Text("Built without SimpleCompressor: metering only");
+    }
+    bool enabled = limiter.enabled();
+    if (ImGui::Checkbox("Limit", &enabled)) {
+        limiter.enabled(enabled);
+    }
+    float threshold = limiter.threshold();
+    if (ImGui::SliderFloat("Threshold (dBFS)", &threshold, -24.f, 0.f)) {
+        limiter.threshold(threshold);
+    }
+    ImGui::Text("Input peak: %.1f dBFS", limiter.inputLevel());
+    ImGui::Text("Gain reduction: %.1f dB (peak %.1f dB)", limiter.reduction(),
+                limiter.peakReduction());
+    ImGui::Text("Blocks limited: %llu",
+                (unsigned long long)limiter.limitedBlocks());
+    ImGui::Text("Latency: %u frames", limiter.latency());
+    if (ImGui::Button("Reset peak")) {
+        limiter.resetPeak();
+    }
+    ImGui::End();
 }
 
 bool App::onKeyDown(const al::Keyboard &k) {
@@ -81,8 +575,12 @@ bool App::onKeyDown(const al::Keyboard &k) {
         break;
     default:
         if (('a' <= key && 'z' >= key) || ('0' <= key && '9' >= key)) {
-            triggerNote(al::asciiToMIDI(key) +
-                        12 * keyboardParameters.octaveOffset);
+            const unsigned char note =
+                al::asciiToMIDI(key) + 12 * keyboardParameters.octaveOffset;
+            keyboardEvents.push(
+                {NoteEvent::Type::NoteOn, 0, note,
+                 value(MarimbaParameter::Amplitude, *synthManager.voice()),
+                 eventClock()});
         }
     }
 
@@ -94,47 +592,48 @@ bool App::onKeyUp(const al::Keyboard &k) {
     if (('a' <= key && 'z' >= key) || ('0' <= key && '9' >= key)) {
         const int midiNote = al::asciiToMIDI(key);
         if (midiNote > 0) {
-            synthManager.triggerOff(midiNote);
+            keyboardEvents.push({NoteEvent::Type::NoteOff, 0,
+                                 std::uint8_t(midiNote), 0.f, eventClock()});
         }
     }
     return true;
 }
 
 void App::onMIDIMessage(const al::MIDIMessage &m) {
-    auto *const voice = synthManager.voice();
+    // Runs on the MIDI thread: only timestamp the event and queue it for the
+    // audio thread.
+    const std::int64_t timestamp = eventClock();
     const unsigned char midiNote = m.noteNumber();
 
     switch (m.type()) {
     case al::MIDIByte::NOTE_ON: {
         const double velocity = m.velocity();
         if (midiNote > 0 && velocity > 0.001) {
-            value(MarimbaParameter::Amplitude, *voice, velocity);
-            triggerNote(midiNote);
+            midiEvents.push({NoteEvent::Type::NoteOn, m.channel(), midiNote,
+                             float(velocity), timestamp});
         }
         break;
     }
     case al::MIDIByte::NOTE_OFF:
-        synthManager.triggerOff(midiNote);
+        midiEvents.push({NoteEvent::Type::NoteOff, m.channel(), midiNote, 0.f,
+                         timestamp});
         break;
-    case al::MIDIByte::CONTROL_CHANGE: {
-        const double controlValue = m.controlValue();
-        switch (m.controlNumber()) {
-        case 7:
-            value(MarimbaParameter::Hardness, *voice, controlValue);
-            break;
-        case 11:
-            value(MarimbaParameter::Brightness, *voice, controlValue);
-            break;
-        case 14:
-            break;
-        case 15:
-            break;
-        }
+    case al::MIDIByte::CONTROL_CHANGE:
+        midiEvents.push({NoteEvent::Type::Control, m.channel(),
+                         m.controlNumber(), float(m.controlValue()),
+                         timestamp});
+        break;
+    case al::MIDIByte::PROGRAM_CHANGE:
+        // The program number is the first data byte.
+        midiEvents.push({NoteEvent::Type::Program, m.channel(), midiNote, 0.f,
+                         timestamp});
         break;
-    }
     }
 }
 
-void App::onExit() { al::imguiShutdown(); }
+void App::onExit() {
+    al::imguiShutdown();
+    tracer().stop();
+}
 
 }; // namespace kelon
\ No newline at end of file
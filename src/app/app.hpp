@@ -2,10 +2,24 @@
 #ifndef KELON_APP_H
 #define KELON_APP_H
 
+#include <array>
+#include <atomic>
+#include <fstream>
+
 #include <al/app/al_App.hpp>
 #include <al/ui/al_ControlGUI.hpp>
 
+#include <kelon/event.hpp>
+#include <kelon/limiter.hpp>
+#include <kelon/marimba/ensemble.hpp>
 #include <kelon/marimba/instruments.hpp>
+#include <kelon/marimba/pool.hpp>
+#include <kelon/marimba/preset.hpp>
+#include <kelon/marimba/samples.hpp>
+#include <kelon/marimba/visualization.hpp>
+#include <kelon/render.hpp>
+#include <kelon/spatial.hpp>
+#include <kelon/tuning.hpp>
 
 namespace kelon {
 
@@ -17,17 +31,87 @@ struct KeyboardParameters {
 /// Marimba demo application.
 class App : public al::App, al::MIDIMessageHandler {
 private:
+    /// Renders voices across cores.
+    ParallelRenderer renderer{defaultRenderThreads()};
+
     /// Manages synth voices and their associated graphics.
     al::SynthGUIManager<AdditiveMarimba> synthManager{"kelon"};
 
+    /// Instruments playing through `synthManager`'s synth, routed by MIDI
+    /// channel, with their preallocated voices. The marimba takes its
+    /// parameters from the control panel.
+    Ensemble ensemble{synthManager.synth()};
+
+    /// Look-ahead limiter on the master bus, unless `KELON_LIMITER` is
+    /// `off`.
+    Limiter limiter;
+    /// Whether the master bus goes through `limiter`.
+    bool limiting = true;
+
+    /// Speaker layout the voices pan across, or empty to pan in stereo.
+    SpeakerLayout layout;
+
     /// MIDI input.
     RtMidiIn midiIn;
 
+    /// Tuning loaded from `KELON_TUNING`, if any.
+    TuningTable tuning;
+
+    /// Loaders keeping sample banks of the additive instruments, if
+    /// `KELON_SAMPLES` is set. Notes of an additive instrument are played
+    /// from its bank once the bank matches their parameters.
+    std::array<SampleLoader, SAMPLED_INSTRUMENTS> samples;
+
+    /// Binary preset bank mapped from `KELON_PRESETS`, if any.
+    PresetBank presets;
+    /// Preset of the bank that struck notes take their parameters from,
+    /// instead of the control panel's. Null to use the control panel. The
+    /// pointer is swapped whole, so a change never applies partially.
+    std::atomic<const PresetRecord *> preset{nullptr};
+
     /// Keyboard parameters.
     KeyboardParameters keyboardParameters{};
 
-    /// Trigger a given MIDI note.
-    void triggerNote(const unsigned char note);
+    /// Events from the MIDI thread.
+    EventQueue midiEvents;
+    /// Events from the computer keyboard.
+    EventQueue keyboardEvents;
+    /// Start time of the previous audio block, on the event clock.
+    std::int64_t previousBlockStart = 0;
+
+    /// Voice levels handed from the audio thread to the graphics thread.
+    LevelSnapshots levels;
+
+    /// CSV log of the DSP meter, if `KELON_METER_FILE` is set.
+    std::ofstream meterFile;
+    /// Seconds since the first frame was animated.
+    double meterTime = 0.;
+    /// Time the next row is logged at.
+    double meterNext = 0.;
+
+    /// Trigger a given MIDI note on the instrument of a channel at a frame
+    /// of the current block. Audio thread only.
+    void triggerNote(const std::uint8_t channel, const unsigned char note,
+                     const float velocity, const int offset);
+
+    /// Apply the queued events that arrived before this block. Audio thread
+    /// only.
+    void processEvents(al::AudioIOData &io);
+    /// Apply a single event at a frame of the current block.
+    void processEvent(const NoteEvent &e, const int offset);
+
+    /// Publish the levels of every sounding voice for drawing. Audio thread
+    /// only.
+    void publishLevels();
+
+    /// Draw the DSP meter into the control panel.
+    void drawMeter();
+    /// Draw the preset bank's window.
+    void drawPresetBank();
+    /// Draw the window routing MIDI channels to instruments.
+    void drawChannels();
+    /// Draw the limiter's window.
+    void drawLimiter();
 
     void onCreate() override;
     void onInit() override;
@@ -39,6 +123,12 @@ private:
     bool onKeyUp(const al::Keyboard &k) override;
     void onMIDIMessage(const al::MIDIMessage &m) override;
     void onExit() override;
+
+public:
+    /// Pan the voices across a speaker layout instead of in stereo. Call
+    /// before the app starts, with audio configured for the layout's
+    /// channels.
+    void speakers(const SpeakerLayout &l) { layout = l; }
 };
 
 }; // namespace kelon
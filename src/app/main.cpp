@@ -1,11 +1,71 @@
 #include "app.hpp"
 
-int main() {
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+/// Frames per audio block unless `--block` or `KELON_BLOCK` is set.
+const unsigned int DEFAULT_BLOCK_SIZE = 512;
+/// Frames per audio block in low-latency mode: 1.3 ms at 48 kHz.
+const unsigned int LOW_LATENCY_BLOCK_SIZE = 64;
+
+/// Print usage information.
+static void usage(const char *const program) {
+    std::cerr << "Usage: " << program << " [options]\n\n"
+              << "  -b, --block FRAMES  frames per audio block (512, or "
+                 "KELON_BLOCK)\n"
+              << "  -l, --low-latency   use " << LOW_LATENCY_BLOCK_SIZE
+              << "-frame blocks\n"
+              << "  -s, --speakers FILE pan across the speaker layout in FILE "
+                 "(stereo, or\n"
+              << "                      KELON_SPEAKERS)\n";
+}
+
+int main(int argc, char **argv) {
+    unsigned int blockSize = DEFAULT_BLOCK_SIZE;
+    const char *const block = std::getenv("KELON_BLOCK");
+    if (block && std::atoi(block) > 0) {
+        blockSize = std::atoi(block);
+    }
+    const char *speakers = std::getenv("KELON_SPEAKERS");
+
+    for (int i = 1; i < argc; i++) {
+        const char *const arg = argv[i];
+        if (!std::strcmp(arg, "-l") || !std::strcmp(arg, "--low-latency")) {
+            blockSize = LOW_LATENCY_BLOCK_SIZE;
+        } else if ((!std::strcmp(arg, "-b") || !std::strcmp(arg, "--block")) &&
+                   i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+            blockSize = std::atoi(argv[++i]);
+        } else if ((!std::strcmp(arg, "-s") ||
+                    !std::strcmp(arg, "--speakers")) &&
+                   i + 1 < argc) {
+            speakers = argv[++i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // Open an output channel for every speaker of the layout, or two for
+    // stereo.
+    kelon::SpeakerLayout layout;
+    if (speakers && *speakers && !kelon::loadLayout(speakers, layout)) {
+        std::cerr << "Could not read speaker layout " << speakers << "."
+                  << std::endl;
+        return 1;
+    }
+    const unsigned int channels = layout.empty() ? 2 : layout.channels();
+
     kelon::App app;
 
     app.dimensions(1200, 900);
 
-    app.configureAudio(48000., 512, 2, 0);
+    app.speakers(layout);
+    app.configureAudio(48000., blockSize, channels, 0);
+    if (!layout.empty()) {
+        std::cerr << "Panning across " << layout.size() << " speakers on "
+                  << channels << " channels." << std::endl;
+    }
     app.start();
 
     return 0;
@@ -0,0 +1,328 @@
+
+#include "bench.hpp"
+
+#include <chrono>
+#include <map>
+#include <memory>
+
+#include <al/io/al_AudioIOData.hpp>
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/cull.hpp>
+#include <kelon/marimba/bank.hpp>
+#include <kelon/marimba/instruments.hpp>
+#include <kelon/render.hpp>
+
+namespace kelon {
+
+/// Mapping of benchmarked instruments to their identifiers.
+const std::map<BenchInstrument, std::string> BENCH_INSTRUMENT_NAMES = {
+    {BenchInstrument::AdditiveMarimba, "additive_marimba"},
+    {BenchInstrument::AdditiveXylophone, "additive_xylophone"},
+    {BenchInstrument::SubtractiveMarimba, "subtractive_marimba"},
+    {BenchInstrument::BankMarimba, "bank_marimba"},
+    {BenchInstrument::BankXylophone, "bank_xylophone"},
+    {BenchInstrument::ModalMarimba3, "modal_marimba_3"},
+    {BenchInstrument::ModalMarimba8, "modal_marimba_8"},
+    {BenchInstrument::ModalMarimba16, "modal_marimba_16"},
+    {BenchInstrument::ModalMarimba32, "modal_marimba_32"},
+};
+
+const std::string &name(const BenchInstrument &i) {
+    return BENCH_INSTRUMENT_NAMES.at(i);
+}
+
+bool parse(const std::string &s, BenchInstrument &i) {
+    for (const auto &entry : BENCH_INSTRUMENT_NAMES) {
+        if (entry.second == s) {
+            i = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Count the voices currently in the active list of `synth`.
+static unsigned int activeVoices(al::PolySynth &synth) {
+    unsigned int count = 0;
+    for (al::SynthVoice *voice = synth.getActiveVoices(); voice;
+         voice = voice->next) {
+        if (voice->active()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/// Set up the output buffers of an offline block.
+static void configure(al::AudioIOData &io, const double sampleRate,
+                      const unsigned int blockSize) {
+    io.framesPerSecond(sampleRate);
+    io.framesPerBuffer(blockSize);
+    io.channelsIn(0);
+    io.channelsOut(2);
+}
+
+/// Add a rendered block to the running totals of `result`.
+static void accumulate(BenchResult &result, const al::AudioIOData &io,
+                       const unsigned int blockSize,
+                       const unsigned int rendered,
+                       unsigned long &voiceFrames) {
+    voiceFrames += (unsigned long)rendered * blockSize;
+    if (rendered > result.peakVoices) {
+        result.peakVoices = rendered;
+    }
+
+    for (int channel = 0; channel < 2; channel++) {
+        const float *const buffer = io.outBuffer(channel);
+        for (unsigned int frame = 0; frame < blockSize; frame++) {
+            result.checksum += buffer[frame];
+        }
+    }
+}
+
+/// Fill in the derived measurements of `result`.
+static void finish(BenchResult &result, const unsigned long blocks,
+                   const std::chrono::steady_clock::duration elapsed,
+                   const unsigned long voiceFrames) {
+    result.frames = blocks * result.blockSize;
+    result.wallTime = std::chrono::duration<double>(elapsed).count();
+    result.nsPerSampleVoice =
+        voiceFrames ? result.wallTime * 1e9 / voiceFrames : 0.;
+    result.realTimeFactor =
+        result.wallTime / (result.frames / result.sampleRate);
+}
+
+/// Whether an instrument is rendered by an `AdditiveVoiceBank`.
+static bool isBank(const BenchInstrument instrument) {
+    return instrument == BenchInstrument::BankMarimba ||
+           instrument == BenchInstrument::BankXylophone;
+}
+
+template <class TVoice>
+static BenchResult runCase(const BenchInstrument instrument,
+                           const double sampleRate,
+                           const unsigned int blockSize,
+                           const unsigned int polyphony,
+                           const unsigned int threads,
+                           const BenchConfig &config) {
+    gam::sampleRate(sampleRate);
+
+    al::PolySynth synth;
+    // Allocate and initialize every voice before timing starts.
+    synth.allocatePolyphony<TVoice>(polyphony);
+
+    al::AudioIOData io;
+    configure(io, sampleRate, blockSize);
+
+    // Start the workers before timing starts, too.
+    std::unique_ptr<ParallelRenderer> renderer;
+    if (threads > 1) {
+        renderer.reset(new ParallelRenderer(threads));
+        renderer->prepare(blockSize, 2, sampleRate);
+    }
+
+    const unsigned long blocks =
+        (unsigned long)(config.seconds * sampleRate / blockSize) + 1;
+    const unsigned int noteCount = config.highNote - config.lowNote + 1;
+
+    BenchResult result{};
+    result.instrument = instrument;
+    result.sampleRate = sampleRate;
+    result.blockSize = blockSize;
+    result.polyphony = polyphony;
+    result.threads = threads;
+    unsigned long voiceFrames = 0;
+    unsigned int nextNote = 0;
+
+    std::chrono::steady_clock::duration elapsed{};
+    for (unsigned long block = 0; block < blocks; block++) {
+        // Keep the requested number of voices sounding, striking new notes
+        // as old ones decay.
+        const unsigned int active = activeVoices(synth);
+        for (unsigned int i = active; i < polyphony; i++) {
+            auto *const voice = synth.getVoice<TVoice>();
+            const int note = config.lowNote + nextNote++ % noteCount;
+            voice->renderer(renderer.get());
+            synth.triggerOn(voice, 0, note);
+        }
+
+        io.zeroOut();
+        io.frame(0);
+
+        const auto start = std::chrono::steady_clock::now();
+        synth.render(io);
+        if (renderer) {
+            renderer->finish(io);
+        }
+        elapsed += std::chrono::steady_clock::now() - start;
+        culler().measure(io);
+
+        accumulate(result, io, blockSize, activeVoices(synth), voiceFrames);
+    }
+
+    finish(result, blocks, elapsed, voiceFrames);
+    return result;
+}
+
+/// Render a benchmark case through an `AdditiveVoiceBank`.
+static BenchResult runBankCase(const BenchInstrument instrument,
+                               const AdditiveMarimbaParameters *const params,
+                               const double sampleRate,
+                               const unsigned int blockSize,
+                               const unsigned int polyphony,
+                               const BenchConfig &config) {
+    gam::sampleRate(sampleRate);
+
+    // The bank holds every partial inline, so keep it off the stack.
+    std::unique_ptr<AdditiveVoiceBank> bank(new AdditiveVoiceBank(params));
+    const ParameterSnapshot snapshot =
+        defaults(params->internalTriggerParameters);
+
+    al::AudioIOData io;
+    configure(io, sampleRate, blockSize);
+
+    const unsigned long blocks =
+        (unsigned long)(config.seconds * sampleRate / blockSize) + 1;
+    const unsigned int noteCount = config.highNote - config.lowNote + 1;
+
+    BenchResult result{};
+    result.instrument = instrument;
+    result.sampleRate = sampleRate;
+    result.blockSize = blockSize;
+    result.polyphony = polyphony;
+    result.threads = 1;
+    unsigned long voiceFrames = 0;
+    unsigned int nextNote = 0;
+
+    std::chrono::steady_clock::duration elapsed{};
+    for (unsigned long block = 0; block < blocks; block++) {
+        for (std::size_t i = bank->activeVoices(); i < polyphony; i++) {
+            if (!bank->trigger(config.lowNote + nextNote++ % noteCount,
+                               snapshot)) {
+                break;
+            }
+        }
+
+        io.zeroOut();
+        io.frame(0);
+
+        const auto start = std::chrono::steady_clock::now();
+        bank->render(io);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        accumulate(result, io, blockSize, bank->activeVoices(), voiceFrames);
+    }
+
+    finish(result, blocks, elapsed, voiceFrames);
+    return result;
+}
+
+BenchResult runBenchCase(const BenchInstrument instrument,
+                         const double sampleRate, const unsigned int blockSize,
+                         const unsigned int polyphony,
+                         const unsigned int threads,
+                         const BenchConfig &config) {
+    switch (instrument) {
+    case BenchInstrument::AdditiveXylophone:
+        return runCase<AdditiveXylophone>(instrument, sampleRate, blockSize,
+                                          polyphony, threads, config);
+    case BenchInstrument::SubtractiveMarimba:
+        return runCase<SubtractiveMarimba>(instrument, sampleRate, blockSize,
+                                           polyphony, threads, config);
+    case BenchInstrument::BankMarimba:
+        return runBankCase(instrument, AdditiveMarimba::PARAMETERS, sampleRate,
+                           blockSize, polyphony, config);
+    case BenchInstrument::BankXylophone:
+        return runBankCase(instrument, AdditiveXylophone::PARAMETERS,
+                           sampleRate, blockSize, polyphony, config);
+    case BenchInstrument::ModalMarimba3:
+        return runCase<ModalMarimba<3>>(instrument, sampleRate, blockSize,
+                                        polyphony, threads, config);
+    case BenchInstrument::ModalMarimba8:
+        return runCase<ModalMarimba<8>>(instrument, sampleRate, blockSize,
+                                        polyphony, threads, config);
+    case BenchInstrument::ModalMarimba16:
+        return runCase<ModalMarimba<16>>(instrument, sampleRate, blockSize,
+                                         polyphony, threads, config);
+    case BenchInstrument::ModalMarimba32:
+        return runCase<ModalMarimba<32>>(instrument, sampleRate, blockSize,
+                                         polyphony, threads, config);
+    case BenchInstrument::AdditiveMarimba:
+    default:
+        return runCase<AdditiveMarimba>(instrument, sampleRate, blockSize,
+                                        polyphony, threads, config);
+    }
+}
+
+/// Write the column names of the CSV output.
+static void writeCSVHeader(std::ostream &out) {
+    out << "instrument,sample_rate,block_size,polyphony,threads,frames,"
+           "wall_time,ns_per_sample_voice,realtime_factor,peak_voices,"
+           "checksum\n";
+}
+
+/// Write a result as a row of CSV.
+static void writeCSV(std::ostream &out, const BenchResult &r) {
+    out << name(r.instrument) << ',' << r.sampleRate << ',' << r.blockSize
+        << ',' << r.polyphony << ',' << r.threads << ',' << r.frames << ','
+        << r.wallTime << ','
+        << r.nsPerSampleVoice << ',' << r.realTimeFactor << ','
+        << r.peakVoices << ',' << r.checksum << '\n';
+}
+
+/// Write a result as a JSON object.
+static void writeJSON(std::ostream &out, const BenchResult &r) {
+    out << "  {\"instrument\": \"" << name(r.instrument)
+        << "\", \"sample_rate\": " << r.sampleRate
+        << ", \"block_size\": " << r.blockSize
+        << ", \"polyphony\": " << r.polyphony
+        << ", \"threads\": " << r.threads << ", \"frames\": " << r.frames
+        << ", \"wall_time\": " << r.wallTime
+        << ", \"ns_per_sample_voice\": " << r.nsPerSampleVoice
+        << ", \"realtime_factor\": " << r.realTimeFactor
+        << ", \"peak_voices\": " << r.peakVoices
+        << ", \"checksum\": " << r.checksum << "}";
+}
+
+void runBench(const BenchConfig &config, std::ostream &out) {
+    bool first = true;
+    if (config.json) {
+        out << "[\n";
+    } else {
+        writeCSVHeader(out);
+    }
+
+    for (const auto instrument : config.instruments) {
+        for (const auto sampleRate : config.sampleRates) {
+            for (const auto blockSize : config.blockSizes) {
+                for (const auto polyphony : config.polyphony) {
+                    for (const auto threads : config.threads) {
+                        if (isBank(instrument) &&
+                            threads != config.threads.front()) {
+                            // Banks ignore the thread count.
+                            continue;
+                        }
+                        const BenchResult result =
+                            runBenchCase(instrument, sampleRate, blockSize,
+                                         polyphony, threads, config);
+                        if (config.json) {
+                            out << (first ? "" : ",\n");
+                            writeJSON(out, result);
+                        } else {
+                            writeCSV(out, result);
+                        }
+                        out.flush();
+                        first = false;
+                    }
+                }
+            }
+        }
+    }
+
+    if (config.json) {
+        out << "\n]\n";
+    }
+}
+
+}; // namespace kelon
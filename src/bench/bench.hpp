@@ -0,0 +1,98 @@
+
+#ifndef KELON_BENCH_H
+#define KELON_BENCH_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace kelon {
+
+/// Instruments that can be benchmarked.
+enum class BenchInstrument {
+    AdditiveMarimba,
+    AdditiveXylophone,
+    SubtractiveMarimba,
+    /// `AdditiveMarimba` rendered by an `AdditiveVoiceBank`.
+    BankMarimba,
+    /// `AdditiveXylophone` rendered by an `AdditiveVoiceBank`.
+    BankXylophone,
+    /// `ModalMarimba` with 3, 8, 16 and 32 modes.
+    ModalMarimba3,
+    ModalMarimba8,
+    ModalMarimba16,
+    ModalMarimba32,
+};
+
+/// Get the name of this benchmarked instrument.
+const std::string &name(const BenchInstrument &i);
+/// Parse a benchmarked instrument name. Returns false if the name is unknown.
+bool parse(const std::string &s, BenchInstrument &i);
+
+/// Parameter sweep for a benchmark run.
+struct BenchConfig {
+    /// Instruments to render.
+    std::vector<BenchInstrument> instruments{
+        BenchInstrument::AdditiveMarimba,
+        BenchInstrument::AdditiveXylophone,
+        BenchInstrument::SubtractiveMarimba,
+        BenchInstrument::BankMarimba,
+        BenchInstrument::BankXylophone,
+        BenchInstrument::ModalMarimba3,
+        BenchInstrument::ModalMarimba8,
+        BenchInstrument::ModalMarimba16,
+        BenchInstrument::ModalMarimba32,
+    };
+    /// Number of simultaneous voices to keep sounding.
+    std::vector<unsigned int> polyphony{1, 4, 16, 64, 256};
+    /// Frames per block.
+    std::vector<unsigned int> blockSizes{32, 64, 128, 256, 512, 1024};
+    /// Sampling rates.
+    std::vector<double> sampleRates{48000.};
+    /// Render threads. One renders serially. Voice banks always render on a
+    /// single thread.
+    std::vector<unsigned int> threads{1};
+    /// Lowest and highest MIDI note to strike.
+    unsigned char lowNote = 36;
+    unsigned char highNote = 96;
+    /// Length of rendered audio per case, in seconds.
+    double seconds = 2.;
+    /// Print JSON instead of CSV.
+    bool json = false;
+};
+
+/// Measurements for a single benchmark case.
+struct BenchResult {
+    BenchInstrument instrument;
+    double sampleRate;
+    unsigned int blockSize;
+    unsigned int polyphony;
+    unsigned int threads;
+    /// Rendered frames.
+    unsigned long frames;
+    /// Wall time spent rendering, in seconds.
+    double wallTime;
+    /// Average time per frame per active voice, in nanoseconds.
+    double nsPerSampleVoice;
+    /// Wall time divided by rendered audio time. Must stay below 1 to render
+    /// in real time.
+    double realTimeFactor;
+    /// Largest number of voices active in a single block.
+    unsigned int peakVoices;
+    /// Sum of the rendered output. Keeps the rendering from being optimized
+    /// away.
+    double checksum;
+};
+
+/// Render a single benchmark case offline.
+BenchResult runBenchCase(const BenchInstrument instrument,
+                         const double sampleRate, const unsigned int blockSize,
+                         const unsigned int polyphony,
+                         const unsigned int threads, const BenchConfig &config);
+
+/// Run every case in the sweep, writing each result as soon as it is ready.
+void runBench(const BenchConfig &config, std::ostream &out);
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,130 @@
+#include "bench.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <kelon/control.hpp>
+#include <kelon/cull.hpp>
+#include <kelon/governor.hpp>
+
+/// Print usage information.
+static void usage(const char *const program) {
+    std::cerr
+        << "Usage: " << program << " [options]\n"
+        << "Render marimba voices offline and report their cost.\n\n"
+        << "  -i, --instruments LIST  additive_marimba,additive_xylophone,"
+           "subtractive_marimba,\n"
+        << "                          bank_marimba,bank_xylophone,"
+           "modal_marimba_3,\n"
+        << "                          modal_marimba_8,modal_marimba_16,"
+           "modal_marimba_32\n"
+        << "  -p, --polyphony LIST    voices kept sounding (1,4,16,64,256)\n"
+        << "  -b, --blocks LIST       frames per block "
+           "(32,64,128,256,512,1024)\n"
+        << "  -r, --rates LIST        sampling rates (48000)\n"
+        << "  -t, --threads LIST      render threads, 1 for serial (1)\n"
+        << "  -n, --notes LOW:HIGH    MIDI note range (36:96)\n"
+        << "  -s, --seconds SECONDS   audio rendered per case (2)\n"
+        << "  -k, --control FRAMES    frames between control-rate updates "
+           "(32)\n"
+        << "  -c, --cull DB           culling threshold below the mix (-60)\n"
+        << "  -q, --quality TIER      full, no_second_overtone or fundamental "
+           "(full)\n"
+        << "  -j, --json              print JSON instead of CSV\n"
+        << "  -h, --help              print this help\n";
+}
+
+/// Split a comma-separated list.
+template <class T> static std::vector<T> parseList(const char *const arg) {
+    std::vector<T> values;
+    std::stringstream stream(arg);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        std::stringstream itemStream(item);
+        T value;
+        itemStream >> value;
+        values.push_back(value);
+    }
+    return values;
+}
+
+int main(int argc, char **argv) {
+    kelon::BenchConfig config;
+
+    for (int i = 1; i < argc; i++) {
+        const char *const arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (!std::strcmp(arg, "-j") || !std::strcmp(arg, "--json")) {
+            config.json = true;
+        } else if (!hasValue) {
+            usage(argv[0]);
+            return 1;
+        } else if (!std::strcmp(arg, "-i") ||
+                   !std::strcmp(arg, "--instruments")) {
+            config.instruments.clear();
+            for (const auto &name : parseList<std::string>(argv[++i])) {
+                kelon::BenchInstrument instrument;
+                if (!kelon::parse(name, instrument)) {
+                    std::cerr << "Unknown instrument " << name << "."
+                              << std::endl;
+                    return 1;
+                }
+                config.instruments.push_back(instrument);
+            }
+        } else if (!std::strcmp(arg, "-p") ||
+                   !std::strcmp(arg, "--polyphony")) {
+            config.polyphony = parseList<unsigned int>(argv[++i]);
+        } else if (!std::strcmp(arg, "-b") || !std::strcmp(arg, "--blocks")) {
+            // Blocks of no frames would never advance.
+            config.blockSizes.clear();
+            for (const int size : parseList<int>(argv[++i])) {
+                if (size <= 0) {
+                    usage(argv[0]);
+                    return 1;
+                }
+                config.blockSizes.push_back(size);
+            }
+        } else if (!std::strcmp(arg, "-r") || !std::strcmp(arg, "--rates")) {
+            config.sampleRates = parseList<double>(argv[++i]);
+        } else if (!std::strcmp(arg, "-t") || !std::strcmp(arg, "--threads")) {
+            config.threads = parseList<unsigned int>(argv[++i]);
+        } else if (!std::strcmp(arg, "-n") || !std::strcmp(arg, "--notes")) {
+            unsigned int low, high;
+            char separator;
+            std::stringstream stream(argv[++i]);
+            if (!(stream >> low >> separator >> high) || separator != ':' ||
+                low > high || high > 127) {
+                usage(argv[0]);
+                return 1;
+            }
+            config.lowNote = low;
+            config.highNote = high;
+        } else if (!std::strcmp(arg, "-s") || !std::strcmp(arg, "--seconds")) {
+            config.seconds = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "-k") || !std::strcmp(arg, "--control")) {
+            kelon::controlPeriod(std::atoi(argv[++i]));
+        } else if (!std::strcmp(arg, "-c") || !std::strcmp(arg, "--cull")) {
+            kelon::culler().threshold(std::atof(argv[++i]));
+        } else if (!std::strcmp(arg, "-q") || !std::strcmp(arg, "--quality")) {
+            kelon::QualityTier tier;
+            if (!kelon::parse(argv[++i], tier)) {
+                std::cerr << "Unknown quality tier " << argv[i] << "."
+                          << std::endl;
+                return 1;
+            }
+            kelon::governor().tier(tier);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    kelon::runBench(config, std::cout);
+
+    return 0;
+}
@@ -0,0 +1,644 @@
+#include "diff.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <map>
+#include <memory>
+
+#include <al/io/al_AudioIOData.hpp>
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/control.hpp>
+#include <kelon/governor.hpp>
+#include <kelon/marimba/bank.hpp>
+#include <kelon/marimba/instruments.hpp>
+#include <kelon/marimba/samples.hpp>
+#include <kelon/marimba/strike.hpp>
+#include <kelon/render.hpp>
+#include <kelon/util.hpp>
+#include <kelon/wav.hpp>
+
+#include "reference.hpp"
+
+namespace kelon {
+
+/// Mapping of scripts to their identifiers.
+const std::map<DiffScript, std::string> DIFF_SCRIPT_NAMES = {
+    {DiffScript::Scale, "scale"},
+    {DiffScript::Velocities, "velocities"},
+    {DiffScript::Chords, "chords"},
+    {DiffScript::Rolls, "rolls"},
+};
+
+const std::string &name(const DiffScript &s) {
+    return DIFF_SCRIPT_NAMES.at(s);
+}
+
+bool parse(const std::string &s, DiffScript &script) {
+    for (const auto &entry : DIFF_SCRIPT_NAMES) {
+        if (entry.second == s) {
+            script = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Mapping of engines to their identifiers.
+const std::map<DiffEngine, std::string> DIFF_ENGINE_NAMES = {
+    {DiffEngine::Voices, "voices"},
+    {DiffEngine::Bank, "bank"},
+};
+
+const std::string &name(const DiffEngine &e) {
+    return DIFF_ENGINE_NAMES.at(e);
+}
+
+bool parse(const std::string &s, DiffEngine &engine) {
+    for (const auto &entry : DIFF_ENGINE_NAMES) {
+        if (entry.second == s) {
+            engine = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Mapping of reference sets to their identifiers.
+const std::map<DiffReference, std::string> DIFF_REFERENCE_NAMES = {
+    {DiffReference::Baseline, "baseline"},
+    {DiffReference::Revised, "revised"},
+};
+
+const std::string &name(const DiffReference &r) {
+    return DIFF_REFERENCE_NAMES.at(r);
+}
+
+bool parse(const std::string &s, DiffReference &reference) {
+    for (const auto &entry : DIFF_REFERENCE_NAMES) {
+        if (entry.second == s) {
+            reference = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Frames over which the short-term RMS is measured.
+const unsigned int ENVELOPE_FRAMES = 512;
+/// Frames per spectrum. Spectra overlap by half.
+const unsigned int SPECTRUM_FRAMES = 2048;
+/// Level relative to the loudest window below which a window is too quiet to
+/// compare, in dB.
+const float QUIET_DB = -60.f;
+/// Level relative to the strongest bin of a spectrum below which bins are
+/// compared as equal, in dB.
+const float SPECTRAL_FLOOR_DB = -80.f;
+
+/// Next value of a fixed linear congruential generator, so scripts are the
+/// same on every platform.
+static std::uint32_t next(std::uint32_t &state) {
+    state = state * 1664525u + 1013904223u;
+    return state >> 8;
+}
+
+Score script(const DiffScript s) {
+    Score score;
+    std::uint32_t state = 1;
+    switch (s) {
+    case DiffScript::Scale:
+        for (unsigned char note = C2; note <= C7; note++) {
+            const float velocity = 0.25f + 0.25f * ((note - C2) % 4);
+            score.notes.push_back({0.25 * (note - C2), note, velocity, {}});
+        }
+        break;
+    case DiffScript::Velocities:
+        for (unsigned int v = 0; v < 16; v++) {
+            score.notes.push_back({double(v), C4, (v + 1) / 16.f, {}});
+        }
+        break;
+    case DiffScript::Chords:
+        for (unsigned int chord = 0; chord < 24; chord++) {
+            for (unsigned int n = 0; n < 16; n++) {
+                const unsigned char note = C2 + next(state) % (C7 - C2 + 1);
+                const float velocity = 0.3f + 0.7f * (next(state) % 1000) /
+                                                  1000.f;
+                score.notes.push_back({0.5 * chord, note, velocity, {}});
+            }
+        }
+        break;
+    case DiffScript::Rolls:
+        for (unsigned int stroke = 0; stroke < 100; stroke++) {
+            const unsigned char notes[4] = {C4, C4 + 4, C4 + 7, C6};
+            score.notes.push_back({0.06 * stroke, notes[stroke % 4],
+                                   stroke % 2 ? 0.6f : 0.9f, {}});
+        }
+        break;
+    }
+    return score;
+}
+
+/// Place the notes of a score on the timeline with the parameters of an
+/// instrument.
+static std::vector<Strike> place(const Score &score,
+                                 const Instrument instrument,
+                                 const double sampleRate) {
+    switch (instrument) {
+    case Instrument::Xylophone:
+        return place(score,
+                     AdditiveXylophone::PARAMETERS->internalTriggerParameters,
+                     sampleRate);
+    case Instrument::Subtractive:
+        return place(score,
+                     SubtractiveMarimba::PARAMETERS->internalTriggerParameters,
+                     sampleRate);
+    case Instrument::Modal:
+        return place(
+            score, EnsembleModalMarimba::PARAMETERS->internalTriggerParameters,
+            sampleRate);
+    case Instrument::Marimba:
+    default:
+        return place(score,
+                     AdditiveMarimba::PARAMETERS->internalTriggerParameters,
+                     sampleRate);
+    }
+}
+
+/// Render the timeline through reference voices into interleaved stereo
+/// frames, in blocks like the engine.
+static void renderReference(const std::vector<Strike> &strikes,
+                            const Instrument instrument,
+                            const DiffConfig &config,
+                            std::vector<float> &out) {
+    const unsigned int blockSize = config.blockSize;
+    // The bank steps its envelopes every frame rather than every control
+    // period.
+    const unsigned int period =
+        config.engine == DiffEngine::Bank ? 1 : controlPeriod();
+    const std::uint64_t stop =
+        strikes.back().frame +
+        std::uint64_t(config.maxTail * config.sampleRate);
+
+    std::vector<float> left(blockSize), right(blockSize);
+    std::vector<std::unique_ptr<ReferenceVoice>> voices;
+    auto next = strikes.begin();
+    out.clear();
+    for (std::uint64_t frame = 0; frame < stop; frame += blockSize) {
+        std::fill(left.begin(), left.end(), 0.f);
+        std::fill(right.begin(), right.end(), 0.f);
+
+        // Sounding voices render the whole block, and new ones from the
+        // frame they are struck at.
+        for (auto &voice : voices) {
+            voice->render(left.data(), right.data(), blockSize);
+        }
+        for (; next != strikes.end() && next->frame < frame + blockSize;
+             ++next) {
+            const unsigned int offset = next->frame - frame;
+            voices.push_back(
+                referenceVoice(instrument, config.reference, period));
+            voices.back()->strike(next->note, next->params);
+            voices.back()->render(left.data() + offset,
+                                  right.data() + offset, blockSize - offset);
+        }
+        voices.erase(std::remove_if(voices.begin(), voices.end(),
+                                    [](const std::unique_ptr<ReferenceVoice>
+                                           &voice) { return voice->done(); }),
+                     voices.end());
+
+        for (unsigned int i = 0; i < blockSize; i++) {
+            out.push_back(left[i]);
+            out.push_back(right[i]);
+        }
+        if (next == strikes.end() && voices.empty()) {
+            // The script has rung out.
+            break;
+        }
+    }
+}
+
+/// Get a free voice of an instrument from a synth.
+static MarimbaVoice *voice(al::PolySynth &synth, const Instrument instrument,
+                           const bool sampled) {
+    switch (instrument) {
+    case Instrument::Xylophone:
+        return sampled ? static_cast<MarimbaVoice *>(
+                             synth.getVoice<SampledXylophone>())
+                       : synth.getVoice<AdditiveXylophone>();
+    case Instrument::Subtractive:
+        return synth.getVoice<SubtractiveMarimba>();
+    case Instrument::Modal:
+        return synth.getVoice<EnsembleModalMarimba>();
+    case Instrument::Marimba:
+    default:
+        return sampled ? static_cast<MarimbaVoice *>(
+                             synth.getVoice<SampledMarimba>())
+                       : synth.getVoice<AdditiveMarimba>();
+    }
+}
+
+/// Whether any voice of a synth is sounding.
+static bool sounding(al::PolySynth &synth) {
+    for (al::SynthVoice *v = synth.getActiveVoices(); v; v = v->next) {
+        if (v->active()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Render the timeline through the engine into interleaved stereo frames.
+/// Notes whose parameters match `bank`, if any, are played from it.
+static void renderEngine(const std::vector<Strike> &strikes,
+                         const Instrument instrument, const DiffConfig &config,
+                         const SampleBank *const bank,
+                         std::vector<float> &out) {
+    const unsigned int blockSize = config.blockSize;
+    const std::uint64_t stop =
+        strikes.back().frame +
+        std::uint64_t(config.maxTail * config.sampleRate);
+
+    al::PolySynth synth;
+    ParallelRenderer renderer(config.threads);
+    renderer.prepare(blockSize, 2, config.sampleRate);
+
+    al::AudioIOData io;
+    io.framesPerSecond(config.sampleRate);
+    io.framesPerBuffer(blockSize);
+    io.channelsIn(0);
+    io.channelsOut(2);
+
+    auto next = strikes.begin();
+    out.clear();
+    for (std::uint64_t frame = 0; frame < stop; frame += blockSize) {
+        for (; next != strikes.end() && next->frame < frame + blockSize;
+             ++next) {
+            const bool sampled = bank && bank->matches(next->params);
+            MarimbaVoice *const v = voice(synth, instrument, sampled);
+            if (sampled) {
+                static_cast<SampledMarimbaBase *>(v)->bank(bank);
+            }
+            v->renderer(&renderer);
+            v->assign(next->params);
+            synth.triggerOn(v, int(next->frame - frame), next->note);
+        }
+
+        io.zeroOut();
+        io.frame(0);
+        synth.render(io);
+        renderer.finish(io);
+
+        const float *const left = io.outBuffer(0);
+        const float *const right = io.outBuffer(1);
+        for (unsigned int i = 0; i < blockSize; i++) {
+            out.push_back(left[i]);
+            out.push_back(right[i]);
+        }
+        if (next == strikes.end() && !sounding(synth)) {
+            // The script has rung out.
+            break;
+        }
+    }
+}
+
+/// Render the timeline through an `AdditiveVoiceBank` into interleaved
+/// stereo frames. The bank renders up to each note's frame before striking
+/// it, so notes start where the engine's voices would.
+static void renderBank(const std::vector<Strike> &strikes,
+                       const Instrument instrument, const DiffConfig &config,
+                       std::vector<float> &out) {
+    const unsigned int blockSize = config.blockSize;
+    const std::uint64_t stop =
+        strikes.back().frame +
+        std::uint64_t(config.maxTail * config.sampleRate);
+
+    // The bank holds every partial inline, so keep it off the stack.
+    std::unique_ptr<AdditiveVoiceBank> bank(
+        new AdditiveVoiceBank(instrument == Instrument::Xylophone
+                                  ? AdditiveXylophone::PARAMETERS
+                                  : AdditiveMarimba::PARAMETERS));
+
+    al::AudioIOData io;
+    io.framesPerSecond(config.sampleRate);
+    io.framesPerBuffer(blockSize);
+    io.channelsIn(0);
+    io.channelsOut(2);
+
+    auto next = strikes.begin();
+    out.clear();
+    for (std::uint64_t frame = 0; frame < stop; frame += blockSize) {
+        io.zeroOut();
+        unsigned int rendered = 0;
+        for (; next != strikes.end() && next->frame < frame + blockSize;
+             ++next) {
+            const unsigned int offset = next->frame - frame;
+            bank->render(io, rendered, offset);
+            rendered = offset;
+            bank->trigger(next->note, next->params);
+        }
+        bank->render(io, rendered, blockSize);
+
+        const float *const left = io.outBuffer(0);
+        const float *const right = io.outBuffer(1);
+        for (unsigned int i = 0; i < blockSize; i++) {
+            out.push_back(left[i]);
+            out.push_back(right[i]);
+        }
+        if (next == strikes.end() && !bank->activeVoices()) {
+            // The script has rung out.
+            break;
+        }
+    }
+}
+
+/// Holds the governor at a tier while alive, and restores its tier and
+/// whether it moves between tiers when destroyed.
+class HeldTier {
+public:
+    HeldTier(const QualityTier t)
+        : tier(governor().tier()), enabled(governor().enabled()) {
+        governor().enabled(false);
+        governor().tier(t);
+    }
+    ~HeldTier() {
+        governor().tier(tier);
+        governor().enabled(enabled);
+    }
+
+private:
+    const QualityTier tier;
+    const bool enabled;
+};
+
+/// Transform `x`, whose size is a power of two, in place.
+static void fft(std::vector<std::complex<float>> &x) {
+    const std::size_t n = x.size();
+    for (std::size_t i = 1, j = 0; i < n; i++) {
+        std::size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1) {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j) {
+            std::swap(x[i], x[j]);
+        }
+    }
+    for (std::size_t length = 2; length <= n; length <<= 1) {
+        const float angle = -2.f * float(M_PI) / length;
+        const std::complex<float> step(std::cos(angle), std::sin(angle));
+        for (std::size_t i = 0; i < n; i += length) {
+            std::complex<float> w(1.f);
+            for (std::size_t k = 0; k < length / 2; k++) {
+                const std::complex<float> even = x[i + k];
+                const std::complex<float> odd = x[i + k + length / 2] * w;
+                x[i + k] = even + odd;
+                x[i + k + length / 2] = even - odd;
+                w *= step;
+            }
+        }
+    }
+}
+
+/// Magnitude spectrum of `SPECTRUM_FRAMES` frames of a signal, windowed.
+static void spectrum(const float *const signal, std::vector<float> &out) {
+    std::vector<std::complex<float>> bins(SPECTRUM_FRAMES);
+    for (unsigned int i = 0; i < SPECTRUM_FRAMES; i++) {
+        const float hann =
+            0.5f - 0.5f * std::cos(2.f * float(M_PI) * i / SPECTRUM_FRAMES);
+        bins[i] = signal[i] * hann;
+    }
+    fft(bins);
+    out.resize(SPECTRUM_FRAMES / 2);
+    for (unsigned int k = 0; k < SPECTRUM_FRAMES / 2; k++) {
+        out[k] = std::abs(bins[k]);
+    }
+}
+
+/// Level of `a` relative to `b`, in dB.
+static float ratioDb(const float a, const float b) {
+    return 20.f * std::log10(a / b);
+}
+
+/// Mean log-spectral distance of two signals over their non-silent windows,
+/// in dB.
+static float spectralDistance(const std::vector<float> &reference,
+                              const std::vector<float> &engine) {
+    const std::size_t length = reference.size();
+    if (length < SPECTRUM_FRAMES) {
+        return 0.f;
+    }
+    const std::size_t hop = SPECTRUM_FRAMES / 2;
+
+    // Only windows within `QUIET_DB` of the loudest are compared.
+    std::vector<float> energies;
+    for (std::size_t start = 0; start + SPECTRUM_FRAMES <= length;
+         start += hop) {
+        float energy = 0.f;
+        for (std::size_t i = 0; i < SPECTRUM_FRAMES; i++) {
+            energy += reference[start + i] * reference[start + i];
+        }
+        energies.push_back(energy);
+    }
+    const float loudest = *std::max_element(energies.begin(), energies.end());
+    const float quiet = loudest * std::pow(10.f, QUIET_DB / 10.f);
+
+    std::vector<float> r, e;
+    double total = 0.;
+    std::size_t windows = 0;
+    for (std::size_t w = 0; w < energies.size(); w++) {
+        if (energies[w] <= quiet || energies[w] == 0.f) {
+            continue;
+        }
+        spectrum(reference.data() + w * hop, r);
+        spectrum(engine.data() + w * hop, e);
+        const float floor = *std::max_element(r.begin(), r.end()) *
+                            std::pow(10.f, SPECTRAL_FLOOR_DB / 20.f);
+        double sum = 0.;
+        for (std::size_t k = 0; k < r.size(); k++) {
+            const float d =
+                ratioDb(std::fmax(e[k], floor), std::fmax(r[k], floor));
+            sum += d * d;
+        }
+        total += std::sqrt(sum / r.size());
+        windows++;
+    }
+    return windows ? float(total / windows) : 0.f;
+}
+
+/// Largest difference of the short-term RMS of two signals over the
+/// non-silent windows of the reference, in dB.
+static float envelopeDistance(const std::vector<float> &reference,
+                              const std::vector<float> &engine) {
+    std::vector<float> r, e;
+    for (std::size_t start = 0; start + ENVELOPE_FRAMES <= reference.size();
+         start += ENVELOPE_FRAMES) {
+        float sumR = 0.f, sumE = 0.f;
+        for (std::size_t i = start; i < start + ENVELOPE_FRAMES; i++) {
+            sumR += reference[i] * reference[i];
+            sumE += engine[i] * engine[i];
+        }
+        r.push_back(std::sqrt(sumR / ENVELOPE_FRAMES));
+        e.push_back(std::sqrt(sumE / ENVELOPE_FRAMES));
+    }
+    if (r.empty()) {
+        return 0.f;
+    }
+    const float quiet = *std::max_element(r.begin(), r.end()) *
+                        std::pow(10.f, QUIET_DB / 20.f);
+
+    float largest = 0.f;
+    for (std::size_t w = 0; w < r.size(); w++) {
+        if (r[w] > quiet && r[w] > 0.f) {
+            // A silent window of the engine counts as `QUIET_DB` down.
+            largest = std::fmax(
+                largest, std::fabs(ratioDb(std::fmax(e[w], quiet), r[w])));
+        }
+    }
+    return largest;
+}
+
+/// Mix interleaved stereo frames down to mono, padded to `frames`.
+static std::vector<float> mix(const std::vector<float> &samples,
+                              const std::size_t frames) {
+    std::vector<float> mono(frames, 0.f);
+    for (std::size_t i = 0; i < samples.size() / 2; i++) {
+        mono[i] = (samples[2 * i] + samples[2 * i + 1]) / 2.f;
+    }
+    return mono;
+}
+
+/// Write interleaved stereo frames to a WAV file. Returns false on failure.
+static bool write(const std::string &path, const std::vector<float> &samples,
+                  const double sampleRate) {
+    WavWriter wav;
+    return wav.open(path, 2, (unsigned int)sampleRate, SampleFormat::Float32) &&
+           wav.write(samples.data(), samples.size() / 2) && wav.close();
+}
+
+/// Time the fastest of `repeats` calls of `f`, in seconds.
+template <class F> static double fastest(const unsigned int repeats, F f) {
+    double best = 0.;
+    for (unsigned int r = 0; r < std::max(repeats, 1u); r++) {
+        const auto start = std::chrono::steady_clock::now();
+        f();
+        const double seconds = std::chrono::duration<double>(
+                                   std::chrono::steady_clock::now() - start)
+                                   .count();
+        best = r ? std::min(best, seconds) : seconds;
+    }
+    return best;
+}
+
+DiffResult runDiff(const Score &score, const std::string &label,
+                   const Instrument instrument, const DiffConfig &config) {
+    gam::sampleRate(config.sampleRate);
+    // The reference never thins, so neither may the engine. Culling is left
+    // on: no mix level is measured, so it only drops what falls below
+    // `ABSOLUTE_CULL_FLOOR`.
+    const HeldTier full(QualityTier::Full);
+
+    DiffResult result;
+    result.script = label;
+    result.instrument = instrument;
+    result.engine = config.engine;
+    result.reference = config.reference;
+
+    const std::vector<Strike> strikes =
+        place(score, instrument, config.sampleRate);
+    std::vector<float> reference, engine;
+    if (strikes.empty()) {
+        result.referenceFrames = result.engineFrames = 0;
+        result.peak = result.maxError = 0.f;
+        result.spectralDb = result.envelopeDb = 0.f;
+        result.referenceTime = result.engineTime = 0.;
+        result.passed = true;
+        return result;
+    }
+
+    // Sample banks are loaded, or rendered and cached, before timing.
+    std::unique_ptr<SampleBank> bank;
+    if (!config.samples.empty() &&
+        std::size_t(instrument) < SAMPLED_INSTRUMENTS) {
+        bank.reset(new SampleBank());
+        bank->load(config.samples,
+                   instrument == Instrument::Xylophone
+                       ? *AdditiveXylophone::PARAMETERS
+                       : *AdditiveMarimba::PARAMETERS,
+                   strikes.front().params, nullptr, DEFAULT_VELOCITY_LAYERS);
+    }
+
+    result.referenceTime = fastest(config.repeats, [&]() {
+        renderReference(strikes, instrument, config, reference);
+    });
+    result.engineTime = fastest(config.repeats, [&]() {
+        if (config.engine == DiffEngine::Bank) {
+            renderBank(strikes, instrument, config, engine);
+        } else {
+            renderEngine(strikes, instrument, config, bank.get(), engine);
+        }
+    });
+    result.referenceFrames = reference.size() / 2;
+    result.engineFrames = engine.size() / 2;
+
+    // Compare sample by sample, as if the shorter render went on silent.
+    const std::size_t frames =
+        std::max(result.referenceFrames, result.engineFrames);
+    result.peak = result.maxError = 0.f;
+    for (std::size_t i = 0; i < 2 * frames; i++) {
+        const float r = i < reference.size() ? reference[i] : 0.f;
+        const float e = i < engine.size() ? engine[i] : 0.f;
+        result.peak = std::fmax(result.peak, std::fabs(r));
+        result.maxError = std::fmax(result.maxError, std::fabs(e - r));
+    }
+    const std::vector<float> monoReference = mix(reference, frames);
+    const std::vector<float> monoEngine = mix(engine, frames);
+    result.spectralDb = spectralDistance(monoReference, monoEngine);
+    result.envelopeDb = envelopeDistance(monoReference, monoEngine);
+
+    const DiffTolerances &t = config.tolerances;
+    result.passed = result.maxError <= t.maxError &&
+                    result.spectralDb <= t.spectralDb &&
+                    result.envelopeDb <= t.envelopeDb;
+
+    if (!config.output.empty()) {
+        const std::string base = config.output + "/" +
+                                 label.substr(label.find_last_of('/') + 1) +
+                                 "-" + name(instrument) +
+                                 (config.engine == DiffEngine::Bank ? "-bank"
+                                                                    : "") +
+                                 (config.reference == DiffReference::Baseline
+                                      ? "-baseline"
+                                      : "");
+        write(base + "-reference.wav", reference, config.sampleRate);
+        write(base + "-engine.wav", engine, config.sampleRate);
+    }
+    return result;
+}
+
+void print(const DiffResult &result, std::ostream &out) {
+    char line[256];
+    std::snprintf(
+        line, sizeof line,
+        "%s %s%s%s: max error %.2g (%.0f dB below peak), spectral %.3f dB, "
+        "envelope %.3f dB, frames %llu/%llu, reference %.2f s, engine %.2f s "
+        "(%.1fx): %s",
+        result.script.c_str(), name(result.instrument).c_str(),
+        result.engine == DiffEngine::Bank ? " (bank)" : "",
+        result.reference == DiffReference::Baseline ? " (baseline)" : "",
+        result.maxError,
+        result.maxError > 0.f ? -ratioDb(result.maxError, result.peak)
+                              : INFINITY,
+        result.spectralDb, result.envelopeDb,
+        (unsigned long long)result.referenceFrames,
+        (unsigned long long)result.engineFrames, result.referenceTime,
+        result.engineTime,
+        result.engineTime > 0. ? result.referenceTime / result.engineTime
+                               : 0.,
+        result.passed ? "pass" : "FAIL");
+    out << line << std::endl;
+}
+
+}; // namespace kelon
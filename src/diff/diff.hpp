@@ -0,0 +1,152 @@
+#ifndef KELON_DIFF_H
+#define KELON_DIFF_H
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <kelon/marimba/ensemble.hpp>
+#include <kelon/score.hpp>
+
+namespace kelon {
+
+/// Built-in note scripts.
+enum class DiffScript {
+    /// Every note from C2 to C7 in turn, at rising velocities.
+    Scale,
+    /// One note at sixteen velocities.
+    Velocities,
+    /// Dense chords, with up to 64 notes sounding.
+    Chords,
+    /// Fast repeated notes, each struck while the last still rings.
+    Rolls,
+};
+
+/// Number of built-in scripts.
+const std::size_t DIFF_SCRIPTS = std::size_t(DiffScript::Rolls) + 1;
+
+/// Get the name of this script.
+const std::string &name(const DiffScript &s);
+/// Parse a script name. Returns false if the name is unknown.
+bool parse(const std::string &s, DiffScript &script);
+
+/// Get the notes of a built-in script.
+Score script(const DiffScript s);
+
+/// Engines held to the references.
+enum class DiffEngine {
+    /// Voices of a `PolySynth`, as the app plays them.
+    Voices,
+    /// An `AdditiveVoiceBank`, which only plays the additive instruments.
+    Bank,
+};
+
+/// Get the name of this engine.
+const std::string &name(const DiffEngine &e);
+/// Parse an engine name. Returns false if the name is unknown.
+bool parse(const std::string &s, DiffEngine &engine);
+
+/// Sets of reference voices the engine is held to.
+enum class DiffReference {
+    /// The voices as first written: per-sample Gamma envelopes, `gam::Pan`,
+    /// free-running oscillator phases and unseeded noise.
+    Baseline,
+    /// The voices as their sound was since meant to change: control-rate
+    /// envelopes, an equal-power pan and phases reset on every strike for
+    /// the additive instruments, and harmonics kept below Nyquist and noise
+    /// seeded per note for the subtractive marimba.
+    Revised,
+};
+
+/// Get the name of this reference set.
+const std::string &name(const DiffReference &r);
+/// Parse a reference set name. Returns false if the name is unknown.
+bool parse(const std::string &s, DiffReference &reference);
+
+/// Differences a render of the engine may have from the reference and still
+/// pass.
+struct DiffTolerances {
+    /// Largest difference of any sample.
+    float maxError = 1e-3f;
+    /// Mean log-spectral distance of the mixes, in dB.
+    float spectralDb = 0.5f;
+    /// Largest difference of the mixes' short-term RMS, in dB.
+    float envelopeDb = 0.1f;
+};
+
+/// Tolerances against the baseline references, just wide enough for the
+/// engine's known departures from them. The baseline frees a voice once its
+/// envelope follower reads silence after a block, which cuts off notes
+/// struck near the end of a block or too quietly for the follower to rise,
+/// and its subtractive noise is not seeded, so new departures are all these
+/// can catch.
+const DiffTolerances BASELINE_TOLERANCES = {0.5f, 8.5f, 45.f};
+
+/// Settings of a comparison.
+struct DiffConfig {
+    /// Instruments to compare.
+    std::vector<Instrument> instruments{
+        Instrument::Marimba,
+        Instrument::Xylophone,
+        Instrument::Subtractive,
+        Instrument::Modal,
+    };
+    /// Engine rendering the instruments.
+    DiffEngine engine = DiffEngine::Voices;
+    /// References the engine is held to.
+    DiffReference reference = DiffReference::Revised;
+    /// Sampling rate.
+    double sampleRate = 48000.;
+    /// Frames per block.
+    unsigned int blockSize = 64;
+    /// Render threads of the engine. One renders serially.
+    unsigned int threads = 1;
+    /// Directory of the sample banks the engine plays the additive
+    /// instruments from, or empty to synthesize them.
+    std::string samples;
+    /// Times each side renders a script. The fastest render is timed.
+    unsigned int repeats = 1;
+    /// Directory both renders of each comparison are written to as WAV
+    /// files, or empty.
+    std::string output;
+    /// Longest a script may ring on after its last note, in seconds.
+    double maxTail = 30.;
+    DiffTolerances tolerances;
+};
+
+/// Outcome of a comparison.
+struct DiffResult {
+    /// Name of the script.
+    std::string script;
+    Instrument instrument;
+    DiffEngine engine;
+    DiffReference reference;
+    /// Frames until the last voice of each side ended.
+    std::uint64_t referenceFrames, engineFrames;
+    /// Peak of the reference.
+    float peak;
+    /// Largest difference of any sample.
+    float maxError;
+    /// Mean log-spectral distance of the mixes, in dB.
+    float spectralDb;
+    /// Largest difference of the mixes' short-term RMS, in dB.
+    float envelopeDb;
+    /// Wall time of the fastest render of each side, in seconds.
+    double referenceTime, engineTime;
+    /// Whether every difference is within the tolerances.
+    bool passed;
+};
+
+/// Render a score through the reference and the engine, and compare the
+/// renders. `label` names the score in the result and the WAV files. The
+/// engine renders at full quality; the governor is restored afterwards.
+DiffResult runDiff(const Score &score, const std::string &label,
+                   const Instrument instrument, const DiffConfig &config);
+
+/// Write a result as a line of text.
+void print(const DiffResult &result, std::ostream &out);
+
+}; // namespace kelon
+
+#endif
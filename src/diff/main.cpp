@@ -0,0 +1,177 @@
+#include "diff.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#include <kelon/control.hpp>
+
+/// Print usage information.
+static void usage(const char *const program) {
+    std::cerr
+        << "Usage: " << program << " [options] [SCRIPT|SCORE]...\n"
+        << "Render note scripts through frozen reference voices and through "
+           "the engine,\n"
+        << "and compare them. SCRIPT is scale, velocities, chords or rolls "
+           "(all of them);\n"
+        << "SCORE is a MIDI file or a synth sequence. Exits with 1 if any "
+           "comparison fails.\n\n"
+        << "  -i, --instruments LIST  marimba,xylophone,subtractive,modal "
+           "(all)\n"
+        << "  -g, --engine NAME       voices, or bank for the additive "
+           "instruments\n"
+        << "                          (voices)\n"
+        << "  -c, --reference NAME    revised, or baseline for the voices "
+           "as first\n"
+        << "                          written (revised)\n"
+        << "  -r, --rate RATE         sampling rate (48000)\n"
+        << "  -b, --block FRAMES      frames per block (64)\n"
+        << "  -k, --control FRAMES    frames between control-rate updates "
+           "(32)\n"
+        << "  -t, --threads COUNT     engine render threads, 1 for serial "
+           "(1)\n"
+        << "  -s, --samples DIR       play the additive instruments from "
+           "sample banks\n"
+        << "                          cached in DIR\n"
+        << "  -n, --repeat COUNT      renders per side, the fastest timed "
+           "(1)\n"
+        << "  -o, --output DIR        write both renders to DIR as WAV files\n"
+        << "  -l, --tail SECONDS      longest ring after the last note (30)\n"
+        << "  -e, --max-error VALUE   largest sample difference (0.001)\n"
+        << "  -f, --spectral-db DB    mean log-spectral distance (0.5)\n"
+        << "  -v, --envelope-db DB    largest short-term RMS difference "
+           "(0.1)\n";
+}
+
+int main(int argc, char **argv) {
+    kelon::DiffConfig config;
+    std::vector<std::string> scores;
+    // Tolerances given on the command line, or negative for the defaults of
+    // the references chosen.
+    float maxError = -1.f, spectralDb = -1.f, envelopeDb = -1.f;
+
+    for (int i = 1; i < argc; i++) {
+        const char *const arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg[0] != '-') {
+            scores.push_back(arg);
+        } else if (!hasValue) {
+            usage(argv[0]);
+            return 1;
+        } else if (!std::strcmp(arg, "-i") ||
+                   !std::strcmp(arg, "--instruments")) {
+            config.instruments.clear();
+            std::stringstream list(argv[++i]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                kelon::Instrument instrument;
+                if (!kelon::parse(item, instrument)) {
+                    std::cerr << "Unknown instrument " << item << "."
+                              << std::endl;
+                    return 1;
+                }
+                config.instruments.push_back(instrument);
+            }
+        } else if (!std::strcmp(arg, "-g") || !std::strcmp(arg, "--engine")) {
+            if (!kelon::parse(argv[++i], config.engine)) {
+                std::cerr << "Unknown engine " << argv[i] << "." << std::endl;
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "-c") ||
+                   !std::strcmp(arg, "--reference")) {
+            if (!kelon::parse(argv[++i], config.reference)) {
+                std::cerr << "Unknown reference " << argv[i] << "."
+                          << std::endl;
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "-r") || !std::strcmp(arg, "--rate")) {
+            config.sampleRate = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "-b") || !std::strcmp(arg, "--block")) {
+            config.blockSize = std::atoi(argv[++i]);
+        } else if (!std::strcmp(arg, "-k") || !std::strcmp(arg, "--control")) {
+            kelon::controlPeriod(std::atoi(argv[++i]));
+        } else if (!std::strcmp(arg, "-t") || !std::strcmp(arg, "--threads")) {
+            config.threads = std::atoi(argv[++i]);
+        } else if (!std::strcmp(arg, "-s") || !std::strcmp(arg, "--samples")) {
+            config.samples = argv[++i];
+        } else if (!std::strcmp(arg, "-n") || !std::strcmp(arg, "--repeat")) {
+            config.repeats = std::atoi(argv[++i]);
+        } else if (!std::strcmp(arg, "-o") || !std::strcmp(arg, "--output")) {
+            config.output = argv[++i];
+        } else if (!std::strcmp(arg, "-l") || !std::strcmp(arg, "--tail")) {
+            config.maxTail = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "-e") ||
+                   !std::strcmp(arg, "--max-error")) {
+            maxError = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "-f") ||
+                   !std::strcmp(arg, "--spectral-db")) {
+            spectralDb = std::atof(argv[++i]);
+        } else if (!std::strcmp(arg, "-v") ||
+                   !std::strcmp(arg, "--envelope-db")) {
+            envelopeDb = std::atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.sampleRate <= 0. || !config.blockSize || !config.threads ||
+        !config.repeats) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (config.reference == kelon::DiffReference::Baseline) {
+        config.tolerances = kelon::BASELINE_TOLERANCES;
+    }
+    if (maxError >= 0.f) {
+        config.tolerances.maxError = maxError;
+    }
+    if (spectralDb >= 0.f) {
+        config.tolerances.spectralDb = spectralDb;
+    }
+    if (envelopeDb >= 0.f) {
+        config.tolerances.envelopeDb = envelopeDb;
+    }
+    if (config.engine == kelon::DiffEngine::Bank) {
+        // The bank only plays the additive instruments.
+        auto &instruments = config.instruments;
+        instruments.erase(
+            std::remove_if(instruments.begin(), instruments.end(),
+                           [](const kelon::Instrument i) {
+                               return std::size_t(i) >=
+                                      kelon::SAMPLED_INSTRUMENTS;
+                           }),
+            instruments.end());
+        if (instruments.empty()) {
+            std::cerr << "The bank only plays the marimba and xylophone."
+                      << std::endl;
+            return 1;
+        }
+    }
+    if (scores.empty()) {
+        for (std::size_t s = 0; s < kelon::DIFF_SCRIPTS; s++) {
+            scores.push_back(kelon::name(kelon::DiffScript(s)));
+        }
+    }
+
+    bool passed = true;
+    for (const std::string &label : scores) {
+        kelon::Score score;
+        kelon::DiffScript script;
+        if (kelon::parse(label, script)) {
+            score = kelon::script(script);
+        } else if (!kelon::loadScore(label, score)) {
+            std::cerr << "Could not read score " << label << "." << std::endl;
+            return 1;
+        }
+        for (const kelon::Instrument instrument : config.instruments) {
+            const kelon::DiffResult result =
+                kelon::runDiff(score, label, instrument, config);
+            kelon::print(result, std::cout);
+            passed = passed && result.passed;
+        }
+    }
+
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,413 @@
+#include "reference.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <kelon/marimba/instruments.hpp>
+#include <kelon/util.hpp>
+
+namespace kelon {
+
+/// Envelope levels of both instruments.
+static const float LEVELS[4] = {0.f, 1.f, 0.2f, 0.f};
+
+ReferenceAdditive::ReferenceAdditive(
+    const AdditiveMarimbaParameters *const params)
+    : parameters(params) {
+    for (auto &envelope : envelopes) {
+        envelope.curve(0.f);
+        envelope.levels(LEVELS[0], LEVELS[1], LEVELS[2], LEVELS[3]);
+    }
+}
+
+void ReferenceAdditive::strike(const unsigned char n,
+                               const ParameterSnapshot &params) {
+    note = n;
+    values = params;
+    for (auto &envelope : envelopes) {
+        envelope.reset();
+    }
+}
+
+void ReferenceAdditive::render(float *const left, float *const right,
+                               const unsigned int frames) {
+    const float hardness = values[MarimbaParameter::Hardness];
+    const float freq = midiNoteToFreq(note);
+    const float brightness = values[MarimbaParameter::Brightness] / 48.f;
+    const float location = 1.f - float(note - C6) / float(C8 - C6);
+    const float harmonics[PARTIALS] = {
+        1,
+        values[MarimbaParameter::FirstOvertone],
+        values[MarimbaParameter::SecondOvertone],
+    };
+    const float attackTime = values[MarimbaParameter::AttackTime];
+    const float decayTime = values[MarimbaParameter::DecayTime];
+    const float releaseTime = std::fmax(
+        marimbaDecay(note, values[MarimbaParameter::ReleaseTime]), 0.15f);
+
+    for (std::size_t i = 0; i < PARTIALS; i++) {
+        oscillators[i].freq(freq * harmonics[i]);
+        gam::real *const lengths = envelopes[i].lengths();
+        lengths[0] = attackTime / harmonics[i];
+        lengths[1] = decayTime / harmonics[i];
+        lengths[2] = releaseTime / harmonics[i];
+    }
+
+    const float scaledHardness = hardness / parameters->scaleHardness;
+    pan.pos(values[MarimbaParameter::Pan]);
+
+    for (unsigned int f = 0; f < frames; f++) {
+        const float samples[PARTIALS] = {
+            float(oscillators[0]() * envelopes[0]()),
+            float(oscillators[1]() * envelopes[1]() * scaledHardness *
+                  (1 - brightness)),
+            float(oscillators[2]() * envelopes[2]() * scaledHardness *
+                  brightness * std::fmin(location, 1)),
+        };
+        for (std::size_t i = 0; i < PARTIALS; i++) {
+            followers[i](samples[i]);
+        }
+
+        float l, r;
+        pan((samples[0] + samples[1] + samples[2]) *
+                values[MarimbaParameter::Amplitude] /
+                parameters->scaleAmplitude,
+            l, r);
+        left[f] += l;
+        right[f] += r;
+    }
+}
+
+float ReferenceAdditiveRevised::Envelope::advance(float frames) {
+    while (segment < 3 && position + frames >= lengths[segment]) {
+        frames -= lengths[segment] - position;
+        position = 0.f;
+        segment++;
+    }
+    if (segment == 3) {
+        return LEVELS[3];
+    }
+    position += frames;
+    return LEVELS[segment] + (LEVELS[segment + 1] - LEVELS[segment]) *
+                                 (position / lengths[segment]);
+}
+
+ReferenceAdditiveRevised::ReferenceAdditiveRevised(
+    const AdditiveMarimbaParameters *const params, const unsigned int p)
+    : parameters(params), period(p) {}
+
+void ReferenceAdditiveRevised::strike(const unsigned char note,
+                               const ParameterSnapshot &params) {
+    const float frequency = midiNoteToFreq(note);
+    const float harmonics[PARTIALS] = {
+        1.f,
+        params[MarimbaParameter::FirstOvertone],
+        params[MarimbaParameter::SecondOvertone],
+    };
+    const float release = std::fmax(
+        marimbaDecay(note, params[MarimbaParameter::ReleaseTime]), 0.15f);
+
+    // Partial gains from hardness and brightness.
+    const float brightness = params[MarimbaParameter::Brightness] / 48.f;
+    const float hardness =
+        params[MarimbaParameter::Hardness] / parameters->scaleHardness;
+    const float location = 1.f - float(int(note) - C6) / float(C8 - C6);
+    partials[0] = 1.f;
+    partials[1] = hardness * (1 - brightness);
+    partials[2] = hardness * brightness * std::fmin(location, 1.f);
+
+    const float sampleRate = gam::sampleRate();
+    finished = true;
+    for (std::size_t i = 0; i < PARTIALS; i++) {
+        oscillators[i].phase(0.f);
+        oscillators[i].freq(frequency * harmonics[i]);
+        envelopes[i].lengths[0] =
+            params[MarimbaParameter::AttackTime] / harmonics[i] * sampleRate;
+        envelopes[i].lengths[1] =
+            params[MarimbaParameter::DecayTime] / harmonics[i] * sampleRate;
+        envelopes[i].lengths[2] = release / harmonics[i] * sampleRate;
+        envelopes[i].segment = 0;
+        envelopes[i].position = 0.f;
+        gains[i] = targets[i] = steps[i] = 0.f;
+        live[i] = frequency * harmonics[i] > 0.f;
+        finished = finished && !live[i];
+    }
+
+    amplitude =
+        params[MarimbaParameter::Amplitude] / parameters->scaleAmplitude;
+
+    // Equal-power pan.
+    const float angle =
+        (std::fmax(std::fmin(params[MarimbaParameter::Pan], 1.f), -1.f) +
+         1.f) *
+        float(M_PI) / 4.f;
+    panLeft = std::cos(angle);
+    panRight = std::sin(angle);
+
+    tickFrames = 0;
+}
+
+void ReferenceAdditiveRevised::tick() {
+    bool sounding = false;
+    for (std::size_t i = 0; i < PARTIALS; i++) {
+        if (!live[i]) {
+            continue;
+        }
+        gains[i] = targets[i];
+        targets[i] = envelopes[i].advance(period) * partials[i] * amplitude;
+        if (envelopes[i].done() && gains[i] == 0.f) {
+            // The partial has ended.
+            live[i] = false;
+            gains[i] = targets[i] = steps[i] = 0.f;
+            continue;
+        }
+        steps[i] = (targets[i] - gains[i]) / period;
+        sounding = true;
+    }
+    finished = !sounding;
+    tickFrames = period;
+}
+
+void ReferenceAdditiveRevised::render(float *const left, float *const right,
+                               const unsigned int frames) {
+    for (unsigned int f = 0; f < frames; f++) {
+        if (!tickFrames) {
+            tick();
+        }
+        float sample = 0.f;
+        for (std::size_t i = 0; i < PARTIALS; i++) {
+            if (live[i]) {
+                sample += oscillators[i]() * gains[i];
+                gains[i] += steps[i];
+            }
+        }
+        left[f] += sample * panLeft;
+        right[f] += sample * panRight;
+        tickFrames--;
+    }
+}
+
+/// Seed of the noise generator, offset by the note.
+static const std::uint32_t NOISE_SEED = 0x6b656c6f;
+/// Share of noise in the source.
+static const float NOISE_MIX = 0.1f;
+/// Most harmonics of the oscillator.
+static const float HARMONICS = 12.f;
+/// Frequency above which harmonics are left out, in Hz.
+static const float HARMONIC_CUTOFF = 16000.f;
+
+ReferenceSubtractive::ReferenceSubtractive() {
+    envelope.curve(0.f);
+    envelope.levels(LEVELS[0], LEVELS[1], LEVELS[2], LEVELS[3]);
+    oscillator.harmonics(HARMONICS);
+}
+
+void ReferenceSubtractive::strike(const unsigned char n,
+                                  const ParameterSnapshot &params) {
+    note = n;
+    values = params;
+    envelope.reset();
+}
+
+void ReferenceSubtractive::render(float *const left, float *const right,
+                                  const unsigned int frames) {
+    oscillator.freq(midiNoteToFreq(note));
+    gam::real *const lengths = envelope.lengths();
+    lengths[0] = values[MarimbaParameter::AttackTime];
+    lengths[1] = values[MarimbaParameter::DecayTime];
+    lengths[2] = marimbaDecay(note, values[MarimbaParameter::ReleaseTime]);
+    comb.set(values[MarimbaParameter::Delay],
+             values[MarimbaParameter::Feedforward],
+             values[MarimbaParameter::Feedback]);
+    comb.freq(freqToMidiNote(note));
+    pan.pos(values[MarimbaParameter::Pan]);
+
+    for (unsigned int f = 0; f < frames; f++) {
+        float sample = oscillator() * (1 - NOISE_MIX) + noise() * NOISE_MIX;
+        sample = comb() * sample * envelope() *
+                 values[MarimbaParameter::Amplitude];
+        follower(sample);
+        float l, r;
+        pan(sample, l, r);
+        left[f] += l;
+        right[f] += r;
+    }
+}
+
+ReferenceSubtractiveRevised::ReferenceSubtractiveRevised() {
+    envelope.curve(0.f);
+    envelope.levels(LEVELS[0], LEVELS[1], LEVELS[2], LEVELS[3]);
+    oscillator.harmonics(HARMONICS);
+}
+
+void ReferenceSubtractiveRevised::strike(const unsigned char note,
+                                  const ParameterSnapshot &params) {
+    const float frequency = midiNoteToFreq(note);
+    oscillator.freq(frequency);
+    envelope.reset();
+    oscillator.phase(0.f);
+    noise.seed(NOISE_SEED + note);
+    comb.zero();
+    follower.lpf.zero();
+
+    gam::real *const lengths = envelope.lengths();
+    lengths[0] = params[MarimbaParameter::AttackTime];
+    lengths[1] = params[MarimbaParameter::DecayTime];
+    lengths[2] = marimbaDecay(note, params[MarimbaParameter::ReleaseTime]);
+    comb.set(params[MarimbaParameter::Delay],
+             params[MarimbaParameter::Feedforward],
+             params[MarimbaParameter::Feedback]);
+    comb.freq(freqToMidiNote(note));
+    pan.pos(params[MarimbaParameter::Pan]);
+
+    // Only the harmonics below Nyquist and the cutoff.
+    const float cutoff =
+        std::fmin(HARMONIC_CUTOFF, float(gam::sampleRate()) / 2.f);
+    const float h =
+        std::fmin(HARMONICS, std::fmax(std::floor(cutoff / frequency), 1.f));
+    if (h != HARMONICS) {
+        oscillator.harmonics(h);
+    }
+
+    amplitude = params[MarimbaParameter::Amplitude];
+}
+
+void ReferenceSubtractiveRevised::render(float *const left, float *const right,
+                                  const unsigned int frames) {
+    for (unsigned int f = 0; f < frames; f++) {
+        float sample =
+            oscillator() * (1 - NOISE_MIX) + noise() * NOISE_MIX;
+        sample = comb() * sample;
+        sample = sample * envelope() * amplitude;
+        follower(sample);
+        float l, r;
+        pan(sample, l, r);
+        left[f] += l;
+        right[f] += r;
+    }
+}
+
+/// Energy of the resonators below which a modal voice ends.
+static const float MODAL_FLOOR = 1e-9f;
+
+ReferenceModal::ReferenceModal(const ModalMarimbaParameters *const params,
+                               const std::size_t modes)
+    : parameters(params),
+      stateReal(std::min(modes, params->modeCount), 0.f),
+      stateImag(stateReal.size(), 0.f), poleReal(stateReal.size(), 0.f),
+      poleImag(stateReal.size(), 0.f) {}
+
+void ReferenceModal::strike(const unsigned char note,
+                            const ParameterSnapshot &params) {
+    const float frequency = midiNoteToFreq(note);
+    const float sampleRate = gam::sampleRate();
+    const float hardness =
+        params[MarimbaParameter::Hardness] / parameters->scaleHardness;
+    const float tilt = params[MarimbaParameter::Brightness] - 1.f;
+    const float decay = std::fmax(
+        marimbaDecay(note, params[MarimbaParameter::ReleaseTime]), 0.15f);
+
+    // The overtones tune the second and third modes, and the rest follow
+    // the third.
+    const float tuned[3] = {
+        1.f,
+        params[MarimbaParameter::FirstOvertone],
+        params[MarimbaParameter::SecondOvertone],
+    };
+    const float stretch = parameters->modeCount > 2 && tuned[2] > 0.f
+                              ? tuned[2] / parameters->modes[2].ratio
+                              : 1.f;
+
+    for (std::size_t k = 0; k < stateReal.size(); k++) {
+        const MarimbaMode &mode = parameters->modes[k];
+        const float ratio = k < 3 ? tuned[k] : mode.ratio * stretch;
+        const float modeFrequency = frequency * ratio;
+        stateReal[k] = stateImag[k] = poleReal[k] = poleImag[k] = 0.f;
+        if (ratio <= 0.f || modeFrequency >= sampleRate / 2.f) {
+            continue;
+        }
+        // Fall by 60 dB over the mode's decay time.
+        const float radius = std::exp(-std::log(1000.f) /
+                                      (decay * mode.decay * sampleRate));
+        const float angle = 2.f * float(M_PI) * modeFrequency / sampleRate;
+        poleReal[k] = radius * std::cos(angle);
+        poleImag[k] = radius * std::sin(angle);
+        stateReal[k] =
+            k ? mode.gain * hardness * std::pow(ratio, tilt) : mode.gain;
+    }
+
+    amplitude =
+        params[MarimbaParameter::Amplitude] / parameters->scaleAmplitude;
+    const float attackTime = params[MarimbaParameter::AttackTime];
+    attack = 0.f;
+    attackStep = attackTime > 0.f ? 1.f / (attackTime * sampleRate) : 1.f;
+    pan.pos(params[MarimbaParameter::Pan]);
+}
+
+void ReferenceModal::render(float *const left, float *const right,
+                            const unsigned int frames) {
+    for (unsigned int f = 0; f < frames; f++) {
+        float sample = 0.f;
+        for (std::size_t k = 0; k < stateReal.size(); k++) {
+            const float re =
+                stateReal[k] * poleReal[k] - stateImag[k] * poleImag[k];
+            const float im =
+                stateReal[k] * poleImag[k] + stateImag[k] * poleReal[k];
+            stateReal[k] = re;
+            stateImag[k] = im;
+            sample += im;
+        }
+        sample *= amplitude * attack;
+        attack = std::fmin(attack + attackStep, 1.f);
+
+        float l, r;
+        pan(sample, l, r);
+        left[f] += l;
+        right[f] += r;
+    }
+}
+
+bool ReferenceModal::done() const {
+    float energy = 0.f;
+    for (std::size_t k = 0; k < stateReal.size(); k++) {
+        energy += stateReal[k] * stateReal[k] + stateImag[k] * stateImag[k];
+    }
+    return energy < MODAL_FLOOR;
+}
+
+std::unique_ptr<ReferenceVoice> referenceVoice(const Instrument i,
+                                               const DiffReference r,
+                                               const unsigned int period) {
+    const bool baseline = r == DiffReference::Baseline;
+    switch (i) {
+    case Instrument::Xylophone:
+        if (baseline) {
+            return std::unique_ptr<ReferenceVoice>(
+                new ReferenceAdditive(AdditiveXylophone::PARAMETERS));
+        }
+        return std::unique_ptr<ReferenceVoice>(new ReferenceAdditiveRevised(
+            AdditiveXylophone::PARAMETERS, period));
+    case Instrument::Subtractive:
+        if (baseline) {
+            return std::unique_ptr<ReferenceVoice>(new ReferenceSubtractive());
+        }
+        return std::unique_ptr<ReferenceVoice>(
+            new ReferenceSubtractiveRevised());
+    case Instrument::Modal:
+        // The modal marimba came after the baseline, so both sets share it.
+        return std::unique_ptr<ReferenceVoice>(
+            new ReferenceModal(EnsembleModalMarimba::PARAMETERS,
+                               EnsembleModalMarimba::MODE_COUNT));
+    case Instrument::Marimba:
+    default:
+        if (baseline) {
+            return std::unique_ptr<ReferenceVoice>(
+                new ReferenceAdditive(AdditiveMarimba::PARAMETERS));
+        }
+        return std::unique_ptr<ReferenceVoice>(new ReferenceAdditiveRevised(
+            AdditiveMarimba::PARAMETERS, period));
+    }
+}
+
+}; // namespace kelon
@@ -0,0 +1,223 @@
+#ifndef KELON_REFERENCE_H
+#define KELON_REFERENCE_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include <Gamma/Analysis.h>
+#include <Gamma/Delay.h>
+#include <Gamma/Effects.h>
+#include <Gamma/Envelope.h>
+#include <Gamma/Oscillator.h>
+
+#include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/ensemble.hpp>
+#include <kelon/marimba/modal.hpp>
+#include <kelon/marimba/parameter.hpp>
+#include <kelon/marimba/subtractive.hpp>
+
+#include "diff.hpp"
+
+namespace kelon {
+
+/**
+ * Frozen copy of how a voice renders, one sample at a time in plain scalar
+ * code, without chunks, SIMD, plan caches, parallel rendering, culling or
+ * thinning. `kelon-diff` checks the engine against it.
+ *
+ * Do not change a reference to follow the engine: it is what the engine is
+ * held to. Only change it when the sound of an instrument is meant to
+ * change, and say so.
+ */
+class ReferenceVoice {
+public:
+    virtual ~ReferenceVoice() = default;
+
+    /// Strike a note with the parameters of a whole note. Needs the Gamma
+    /// sampling rate to be set.
+    virtual void strike(const unsigned char note,
+                        const ParameterSnapshot &params) = 0;
+    /// Add the next `frames` frames of the voice to the left and right
+    /// channels.
+    virtual void render(float *const left, float *const right,
+                        const unsigned int frames) = 0;
+    /// Whether the voice has ended. Checked after every block, as the
+    /// engine's voices free themselves at the end of a block.
+    virtual bool done() const = 0;
+};
+
+/// `AdditiveMarimbaBase` as first written, less its debug output: each
+/// partial's `gam::Env<3>` runs every sample, the oscillators run on from
+/// wherever they were, and `gam::Pan` splits the mix.
+class ReferenceAdditive : public ReferenceVoice {
+public:
+    /// Create a voice of an instrument. The parameters are not owned by the
+    /// voice.
+    ReferenceAdditive(const AdditiveMarimbaParameters *const params);
+
+    void strike(const unsigned char note,
+                const ParameterSnapshot &params) override;
+    void render(float *const left, float *const right,
+                const unsigned int frames) override;
+    bool done() const override { return followers[0].done(); }
+
+private:
+    static const std::size_t PARTIALS =
+        AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+
+    const AdditiveMarimbaParameters *const parameters;
+    /// Note struck, which the voice took as its id.
+    unsigned char note = 0;
+    /// Internal trigger parameters of the note.
+    ParameterSnapshot values;
+
+    gam::Sine<> oscillators[PARTIALS];
+    gam::Env<3> envelopes[PARTIALS];
+    gam::EnvFollow<> followers[PARTIALS];
+    gam::Pan<> pan;
+};
+
+/// `AdditiveMarimbaBase` as of its control-rate envelopes: each partial's
+/// envelope is evaluated once per control period, and its gain ramps
+/// linearly in between. Phases restart on every strike, and the pan is
+/// equal-power.
+class ReferenceAdditiveRevised : public ReferenceVoice {
+public:
+    /// Create a voice of an instrument. The parameters are not owned by the
+    /// voice.
+    ReferenceAdditiveRevised(const AdditiveMarimbaParameters *const params,
+                             const unsigned int period);
+
+    void strike(const unsigned char note,
+                const ParameterSnapshot &params) override;
+    void render(float *const left, float *const right,
+                const unsigned int frames) override;
+    bool done() const override { return finished; }
+
+private:
+    static const std::size_t PARTIALS =
+        AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+
+    /// Linear three-segment envelope, advanced a control period at a time.
+    struct Envelope {
+        float lengths[3];
+        std::size_t segment;
+        float position;
+
+        float advance(float frames);
+        bool done() const { return segment == 3; }
+    };
+
+    const AdditiveMarimbaParameters *const parameters;
+    /// Frames per control period.
+    const unsigned int period;
+
+    gam::Sine<> oscillators[PARTIALS];
+    Envelope envelopes[PARTIALS];
+    /// Gain of each partial from hardness and brightness.
+    float partials[PARTIALS];
+    /// Whether each partial is still rendered.
+    bool live[PARTIALS];
+    /// Gain of each partial, its target at the end of the control period,
+    /// and its change per frame.
+    float gains[PARTIALS], targets[PARTIALS], steps[PARTIALS];
+    /// Amplitude scaled by 1 / scaleAmplitude.
+    float amplitude = 0.f;
+    /// Left and right pan gains.
+    float panLeft = 0.f, panRight = 0.f;
+    /// Frames left in the control period.
+    unsigned int tickFrames = 0;
+    bool finished = true;
+
+    /// Start a control period.
+    void tick();
+};
+
+/// `SubtractiveMarimbaBase` as first written, less its debug output: a
+/// twelve-harmonic oscillator and noise through a comb filter and an
+/// envelope, carrying their state from one strike to the next.
+class ReferenceSubtractive : public ReferenceVoice {
+public:
+    ReferenceSubtractive();
+
+    void strike(const unsigned char note,
+                const ParameterSnapshot &params) override;
+    void render(float *const left, float *const right,
+                const unsigned int frames) override;
+    bool done() const override { return follower.done(); }
+
+private:
+    /// Note struck, which the voice took as its id.
+    unsigned char note = 0;
+    /// Internal trigger parameters of the note.
+    ParameterSnapshot values;
+
+    gam::DSF<> oscillator;
+    gam::NoiseWhite<> noise;
+    gam::Comb<> comb;
+    gam::Env<3> envelope;
+    gam::EnvFollow<> follower;
+    gam::Pan<> pan;
+};
+
+/// `SubtractiveMarimbaBase` with its harmonics kept below Nyquist and its
+/// noise seeded per note, every strike starting from silence.
+class ReferenceSubtractiveRevised : public ReferenceVoice {
+public:
+    ReferenceSubtractiveRevised();
+
+    void strike(const unsigned char note,
+                const ParameterSnapshot &params) override;
+    void render(float *const left, float *const right,
+                const unsigned int frames) override;
+    bool done() const override { return follower.done(); }
+
+private:
+    gam::DSF<> oscillator;
+    gam::NoiseWhite<> noise;
+    gam::Comb<> comb;
+    gam::Env<3> envelope;
+    gam::EnvFollow<> follower;
+    gam::Pan<> pan;
+
+    float amplitude = 0.f;
+};
+
+/// `ModalMarimbaBase`: damped complex resonators struck with an impulse,
+/// faded in over the attack.
+class ReferenceModal : public ReferenceVoice {
+public:
+    /// Create a voice of an instrument with up to `modes` modes. The
+    /// parameters are not owned by the voice.
+    ReferenceModal(const ModalMarimbaParameters *const params,
+                   const std::size_t modes);
+
+    void strike(const unsigned char note,
+                const ParameterSnapshot &params) override;
+    void render(float *const left, float *const right,
+                const unsigned int frames) override;
+    bool done() const override;
+
+private:
+    const ModalMarimbaParameters *const parameters;
+
+    /// State and pole of each resonator.
+    std::vector<float> stateReal, stateImag, poleReal, poleImag;
+    /// Amplitude scaled by 1 / scaleAmplitude.
+    float amplitude = 0.f;
+    /// Gain of the fade-in, and its change per frame.
+    float attack = 1.f, attackStep = 0.f;
+    gam::Pan<> pan;
+};
+
+/// Create a reference voice of an instrument from a set of references,
+/// with envelopes evaluated every `period` frames where they are at control
+/// rate.
+std::unique_ptr<ReferenceVoice> referenceVoice(const Instrument i,
+                                               const DiffReference r,
+                                               const unsigned int period);
+
+}; // namespace kelon
+
+#endif
@@ -0,0 +1,13 @@
+
+#include <kelon/block.hpp>
+
+namespace kelon {
+
+Scratch &scratch() {
+    // Voices render on the audio thread and the parallel renderer's workers,
+    // one at a time per thread.
+    static thread_local Scratch buffers;
+    return buffers;
+}
+
+}; // namespace kelon
@@ -0,0 +1,60 @@
+
+#include <kelon/control.hpp>
+
+#include <atomic>
+
+namespace kelon {
+
+/// Frames between control-rate updates.
+static std::atomic<unsigned int> period{32};
+
+unsigned int controlPeriod() { return period.load(std::memory_order_relaxed); }
+
+void controlPeriod(const unsigned int frames) {
+    period.store(frames < 1 ? 1
+                 : frames > MAX_CONTROL_PERIOD ? MAX_CONTROL_PERIOD
+                                               : frames,
+                 std::memory_order_relaxed);
+}
+
+void ControlEnvelope::levels(const float (&l)[SEGMENTS + 1]) {
+    for (std::size_t i = 0; i <= SEGMENTS; i++) {
+        breakpoints[i] = l[i];
+    }
+}
+
+void ControlEnvelope::lengths(const float attack, const float decay,
+                              const float release) {
+    segmentLengths[0] = attack;
+    segmentLengths[1] = decay;
+    segmentLengths[2] = release;
+}
+
+void ControlEnvelope::reset() {
+    segment = 0;
+    position = 0.f;
+    current = breakpoints[0];
+}
+
+float ControlEnvelope::advance(const float frames) {
+    float left = frames;
+
+    // Skip every segment that ends within `frames`.
+    while (segment < SEGMENTS && position + left >= segmentLengths[segment]) {
+        left -= segmentLengths[segment] - position;
+        position = 0.f;
+        segment++;
+    }
+
+    if (segment == SEGMENTS) {
+        current = breakpoints[SEGMENTS];
+    } else {
+        position += left;
+        const float t = position / segmentLengths[segment];
+        current = breakpoints[segment] +
+                  (breakpoints[segment + 1] - breakpoints[segment]) * t;
+    }
+    return current;
+}
+
+}; // namespace kelon
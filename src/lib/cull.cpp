@@ -0,0 +1,55 @@
+
+#include <kelon/cull.hpp>
+
+#include <cmath>
+
+namespace kelon {
+
+/// Masking threshold unless one is set.
+const float DEFAULT_CULL_THRESHOLD = -60.f;
+/// Factor the mix level falls by per second when the mix gets quieter.
+const float LEVEL_RELEASE = 0.01f;
+
+/// Convert decibels to a linear amplitude.
+static float amplitude(const float db) { return std::pow(10.f, db / 20.f); }
+
+Culler::Culler()
+    : thresholdDb(DEFAULT_CULL_THRESHOLD),
+      cullFloor(amplitude(ABSOLUTE_CULL_FLOOR)) {}
+
+void Culler::threshold(const float db) {
+    thresholdDb.store(db, std::memory_order_relaxed);
+    update();
+}
+
+void Culler::measure(const al::AudioIOData &io) {
+    const int frames = io.framesPerBuffer();
+    float peak = 0.f;
+    for (int channel = 0; channel < io.channelsOut(); channel++) {
+        const float *const buffer = io.outBuffer(channel);
+        for (int frame = 0; frame < frames; frame++) {
+            peak = std::fmax(peak, std::fabs(buffer[frame]));
+        }
+    }
+
+    // Follow rises at once and fall slowly, so a short gap does not cull the
+    // tails of every voice.
+    const float release =
+        std::pow(LEVEL_RELEASE, float(frames / io.framesPerSecond()));
+    mixLevel.store(std::fmax(peak, level() * release),
+                   std::memory_order_relaxed);
+    update();
+}
+
+void Culler::update() {
+    cullFloor.store(std::fmax(level() * amplitude(threshold()),
+                              amplitude(ABSOLUTE_CULL_FLOOR)),
+                    std::memory_order_relaxed);
+}
+
+Culler &culler() {
+    static Culler c;
+    return c;
+}
+
+}; // namespace kelon
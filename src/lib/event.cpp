@@ -0,0 +1,27 @@
+
+#include <kelon/event.hpp>
+
+#include <chrono>
+
+namespace kelon {
+
+std::int64_t eventClock() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int frameOffset(const std::int64_t timestamp,
+                const std::int64_t previousBlockStart, const double sampleRate,
+                const int frames) {
+    const double offset = (timestamp - previousBlockStart) * sampleRate / 1e9;
+    if (offset <= 0.) {
+        return 0;
+    }
+    if (offset >= frames - 1) {
+        return frames - 1;
+    }
+    return int(offset);
+}
+
+}; // namespace kelon
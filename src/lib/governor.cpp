@@ -0,0 +1,92 @@
+
+#include <kelon/governor.hpp>
+
+#include <map>
+
+#include <kelon/trace.hpp>
+
+namespace kelon {
+
+constexpr float LoadGovernor::DEGRADE_LOAD;
+constexpr float LoadGovernor::RECOVER_LOAD;
+constexpr float LoadGovernor::RECOVER_SECONDS;
+
+/// Mapping of quality tiers to their identifiers.
+const std::map<QualityTier, std::string> QUALITY_TIER_NAMES = {
+    {QualityTier::Full, "full"},
+    {QualityTier::NoSecondOvertone, "no_second_overtone"},
+    {QualityTier::Fundamental, "fundamental"},
+};
+
+const std::string &name(const QualityTier &t) {
+    return QUALITY_TIER_NAMES.at(t);
+}
+
+bool parse(const std::string &s, QualityTier &t) {
+    for (const auto &entry : QUALITY_TIER_NAMES) {
+        if (entry.second == s) {
+            t = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+void LoadGovernor::update(const float l, const unsigned int frames,
+                          const double sampleRate) {
+    rate.store(sampleRate, std::memory_order_relaxed);
+
+    const QualityTier t = tier();
+    tierFrames[std::size_t(t)].fetch_add(frames, std::memory_order_relaxed);
+
+    if (!enabled()) {
+        return;
+    }
+
+    overBlocks = l > DEGRADE_LOAD ? overBlocks + 1 : 0;
+    calmFrames = l < RECOVER_LOAD ? calmFrames + frames : 0.;
+
+    if (overBlocks >= DEGRADE_BLOCKS && t != QualityTier::Fundamental) {
+        // Drop a tier and give it time to take effect.
+        trace(TraceLevel::Warning, TraceEvent::QualityDrop, -1, 0, l);
+        current.store(QualityTier(std::size_t(t) + 1),
+                      std::memory_order_relaxed);
+        overBlocks = 0;
+        calmFrames = 0.;
+    } else if (calmFrames >= RECOVER_SECONDS * sampleRate &&
+               t != QualityTier::Full) {
+        trace(TraceLevel::Info, TraceEvent::QualityRecover, -1, 0, l);
+        current.store(QualityTier(std::size_t(t) - 1),
+                      std::memory_order_relaxed);
+        calmFrames = 0.;
+    }
+}
+
+void LoadGovernor::tier(const QualityTier t) {
+    current.store(t, std::memory_order_relaxed);
+}
+
+double LoadGovernor::seconds(const QualityTier t) const {
+    const double r = rate.load(std::memory_order_relaxed);
+    return r > 0. ? tierFrames[std::size_t(t)].load(std::memory_order_relaxed) /
+                        r
+                  : 0.;
+}
+
+std::size_t partialLimit(const QualityTier t) {
+    switch (t) {
+    case QualityTier::NoSecondOvertone:
+        return 2;
+    case QualityTier::Fundamental:
+        return 1;
+    default:
+        return 3;
+    }
+}
+
+LoadGovernor &governor() {
+    static LoadGovernor g;
+    return g;
+}
+
+}; // namespace kelon
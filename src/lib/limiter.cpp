@@ -0,0 +1,184 @@
+
+#include <kelon/limiter.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#ifdef KELON_SIMPLE_COMPRESSOR
+#include <GainReductionComputer.h>
+#include <LookAheadGainReduction.h>
+#endif
+
+#include <kelon/block.hpp>
+#include <kelon/simd.hpp>
+
+namespace kelon {
+
+/// Natural logarithm of the gain of one decibel.
+const float LOG_PER_DB = 0.11512925f;
+
+struct Limiter::Engine {
+#ifdef KELON_SIMPLE_COMPRESSOR
+    GainReductionComputer computer;
+    LookAheadGainReduction lookAhead;
+#endif
+    /// Threshold the gain computer was last set to.
+    float threshold = NAN;
+    /// Frames each channel is delayed by.
+    unsigned int delay = 0;
+    /// Delayed frames of each channel, followed by the chunk being delayed.
+    std::vector<std::vector<float>> history;
+    /// Side chain of a chunk.
+    std::vector<float> sidechain = std::vector<float>(CHUNK_FRAMES);
+    /// Gain of each frame of a chunk, first in dB, then linear.
+    std::vector<float> gains = std::vector<float>(CHUNK_FRAMES);
+};
+
+/// Raise `out` to the magnitude of a channel, frame by frame, and return the
+/// channel's peak.
+static float sidechain(const float *const in, const unsigned int frames,
+                       float *const out) {
+    simd::vfloat peaks = simd::set(0.f);
+    unsigned int i = 0;
+    for (; i + simd::WIDTH <= frames; i += simd::WIDTH) {
+        const simd::vfloat magnitude = simd::abs(simd::load(in + i));
+        simd::store(out + i, simd::max(simd::load(out + i), magnitude));
+        peaks = simd::max(peaks, magnitude);
+    }
+    float lanes[simd::WIDTH];
+    simd::store(lanes, peaks);
+    float peak = 0.f;
+    for (unsigned int l = 0; l < simd::WIDTH; l++) {
+        peak = std::max(peak, lanes[l]);
+    }
+    for (; i < frames; i++) {
+        out[i] = std::max(out[i], std::abs(in[i]));
+        peak = std::max(peak, std::abs(in[i]));
+    }
+    return peak;
+}
+
+/// Write `in` scaled by each frame's gain to `out`.
+static void applyGain(const float *const in, const float *const gains,
+                      const unsigned int frames, float *const out) {
+    unsigned int i = 0;
+    for (; i + simd::WIDTH <= frames; i += simd::WIDTH) {
+        simd::store(out + i,
+                    simd::mul(simd::load(in + i), simd::load(gains + i)));
+    }
+    for (; i < frames; i++) {
+        out[i] = in[i] * gains[i];
+    }
+}
+
+Limiter::Limiter() : blockLevel(-std::numeric_limits<float>::infinity()) {}
+
+Limiter::~Limiter() = default;
+
+bool Limiter::available() {
+#ifdef KELON_SIMPLE_COMPRESSOR
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Limiter::prepare(const double sampleRate, const unsigned int channels) {
+    std::unique_ptr<Engine> e(new Engine());
+#ifdef KELON_SIMPLE_COMPRESSOR
+    // An infinite ratio with no attack: the look-ahead ramp alone shapes
+    // the onset of gain reduction, and peaks never pass the threshold.
+    e->computer.prepare(sampleRate);
+    e->computer.setRatio(std::numeric_limits<float>::infinity());
+    e->computer.setKnee(0.f);
+    e->computer.setAttackTime(0.f);
+    e->computer.setReleaseTime(LIMITER_RELEASE);
+    e->computer.setMakeUpGain(0.f);
+    e->lookAhead.setDelayTime(LIMITER_LOOKAHEAD);
+    e->lookAhead.prepare(sampleRate, CHUNK_FRAMES);
+    e->delay = e->lookAhead.getDelayInSamples();
+#endif
+    e->history.assign(channels,
+                      std::vector<float>(e->delay + CHUNK_FRAMES, 0.f));
+    engine = std::move(e);
+}
+
+unsigned int Limiter::latency() const { return engine ? engine->delay : 0; }
+
+void Limiter::process(al::AudioIOData &io) {
+    if (!engine) {
+        return;
+    }
+    Engine &e = *engine;
+    const unsigned int frames = io.framesPerBuffer();
+    const unsigned int channels =
+        std::min(unsigned(io.channelsOut()), unsigned(e.history.size()));
+#ifdef KELON_SIMPLE_COMPRESSOR
+    const float t = threshold();
+    if (t != e.threshold) {
+        e.computer.setThreshold(t);
+        e.threshold = t;
+    }
+    const bool reducing = enabled();
+#endif
+
+    float peak = 0.f, gain = 0.f;
+    for (unsigned int start = 0; start < frames; start += CHUNK_FRAMES) {
+        const unsigned int n = std::min(frames - start, CHUNK_FRAMES);
+        clear(e.sidechain.data(), n);
+        for (unsigned int c = 0; c < channels; c++) {
+            peak = std::max(peak, sidechain(io.outBuffer(c) + start, n,
+                                            e.sidechain.data()));
+        }
+        bool scaling = false;
+#ifdef KELON_SIMPLE_COMPRESSOR
+        // Gain reduction in dB, ramped in ahead of the peaks it is for.
+        float *const gains = e.gains.data();
+        e.computer.computeGainInDecibelsFromSidechainSignal(
+            e.sidechain.data(), gains, n);
+        e.lookAhead.pushSamples(gains, n);
+        e.lookAhead.process();
+        e.lookAhead.readSamples(gains, n);
+        float least = 0.f;
+        for (unsigned int i = 0; i < n; i++) {
+            least = std::min(least, gains[i]);
+        }
+        gain = std::min(gain, least);
+        scaling = reducing && least < 0.f;
+        if (scaling) {
+            for (unsigned int i = 0; i < n; i++) {
+                gains[i] = std::exp(gains[i] * LOG_PER_DB);
+            }
+        }
+#endif
+        if (!e.delay && !scaling) {
+            continue;
+        }
+        // Delay each channel to line up with its gain, scaling it on the
+        // way out unless no frame of the chunk is reduced.
+        for (unsigned int c = 0; c < channels; c++) {
+            float *const history = e.history[c].data();
+            float *const out = io.outBuffer(c) + start;
+            std::copy(out, out + n, history + e.delay);
+            if (scaling) {
+                applyGain(history, e.gains.data(), n, out);
+            } else {
+                std::copy(history, history + n, out);
+            }
+            std::copy(history + n, history + n + e.delay, history);
+        }
+    }
+
+    blockLevel.store(20.f * std::log10(peak), std::memory_order_relaxed);
+    blockReduction.store(0.f - gain, std::memory_order_relaxed);
+    if (gain < 0.f) {
+        limited.fetch_add(1, std::memory_order_relaxed);
+        if (-gain > peakReduction()) {
+            maxReduction.store(-gain, std::memory_order_relaxed);
+        }
+    }
+}
+
+}; // namespace kelon
@@ -1,138 +1,294 @@
 
 #include <kelon/marimba/additive.hpp>
 
-#include <array>
-#include <numeric>
+#include <algorithm>
+#include <cmath>
 
-#include <kelon/util.hpp>
+#include <kelon/block.hpp>
+#include <kelon/cull.hpp>
+#include <kelon/governor.hpp>
+#include <kelon/marimba/plan.hpp>
+#include <kelon/meter.hpp>
+#include <kelon/trace.hpp>
 
 namespace kelon {
 
+constexpr float AdditiveMarimbaParameters::ENVELOPE_CURVE;
+constexpr float AdditiveMarimbaParameters::ENVELOPE_LEVELS[4];
+
 AdditiveMarimbaBase::AdditiveMarimbaBase(
     const AdditiveMarimbaParameters *const params)
-    : al::SynthVoice(), parameters(params) {}
+    : MarimbaVoice(), parameters(params) {
+    for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+         i++) {
+        levels[i] = gains[i] = targets[i] = steps[i] = partials[i] = 0.f;
+    }
+    for (std::size_t c = 0; c < 2; c++) {
+        panGains[c] = panTargets[c] = panSteps[c] = 0.f;
+    }
+    partialHardness = partialBrightness = panPosition = NAN;
+}
 
 AdditiveMarimbaBase::~AdditiveMarimbaBase() {}
 
 void AdditiveMarimbaBase::init() {
+    // `ControlEnvelope` is linear, matching `ENVELOPE_CURVE`.
     for (auto &env : envelopes) {
-        env.curve(AdditiveMarimbaParameters::ENVELOPE_CURVE);
-        env.levels(AdditiveMarimbaParameters::ENVELOPE_LEVELS[0],
-                   AdditiveMarimbaParameters::ENVELOPE_LEVELS[1],
-                   AdditiveMarimbaParameters::ENVELOPE_LEVELS[2],
-                   AdditiveMarimbaParameters::ENVELOPE_LEVELS[3]);
+        env.levels(AdditiveMarimbaParameters::ENVELOPE_LEVELS);
     }
 
     // Set up the main parameters of the voice.
-    for (const auto &values : parameters->internalTriggerParameters) {
-        create(std::get<0>(values), *this, std::get<1>(values),
-               std::get<2>(values), std::get<3>(values));
+    createParameters(parameters->internalTriggerParameters);
+}
+
+float AdditiveMarimbaBase::level(const std::size_t partial) const {
+    // The mean of a rectified sine, which an envelope follower measures.
+    return levels[partial] * 2.f / float(M_PI);
+}
+
+float AdditiveMarimbaBase::loudness() const {
+    float sum = 0.f;
+    for (const float target : targets) {
+        sum += target;
     }
+    return sum;
 }
 
-void AdditiveMarimbaBase::onProcess(al::AudioIOData &io) {
-    // Set values according to internal trigger parameter values.
-
-    /// Get the MIDI note we are playing from our voice ID.
-    const unsigned char note = id();
-    const float hardness = value(MarimbaParameter::Hardness);
-
-    const float freq = midiNoteToFreq(note);
-
-    /// Higher values favor the second overtone, while lower values favor the
-    /// first.
-    const float brightness = value(MarimbaParameter::Brightness) / 48.f;
-
-    /// Location as a percent distance from C6.
-    const float location = 1.f - float(note - C6) / float(C8 - C6);
-
-    /// Which harmonics to sound.
-    const float harmonics[AdditiveMarimbaParameters::OSCILLATOR_COUNT] = {
-        1,
-        value(MarimbaParameter::FirstOvertone),
-        value(MarimbaParameter::SecondOvertone),
-    };
-    // const float harmonics[AdditiveMarimbaParameters::OSCILLATOR_COUNT] =
-    //     parameters->_harmonics;
-
-    /// Attack time.
-    const float attackTime = value(MarimbaParameter::AttackTime);
-    /// Decay time.
-    const float decayTime = value(MarimbaParameter::DecayTime);
-    /// Release time. Modelled linearly using `marimbaDecay`.
-    const float releaseTime = std::fmax(
-        marimbaDecay(note, value(MarimbaParameter::ReleaseTime)), 0.15f);
+void AdditiveMarimbaBase::tick(const ParameterSnapshot &params) {
+    const unsigned int period = controlPeriod();
 
+    // The previous ramps have reached their targets. Start from the exact
+    // targets so rounding does not accumulate.
     for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
          i++) {
-        oscillators[i].freq(freq * harmonics[i]);
-        gam::real *const lengths = envelopes[i].lengths();
-        lengths[0] = attackTime / harmonics[i];
-        lengths[1] = decayTime / harmonics[i];
-        lengths[2] = releaseTime / harmonics[i];
-    }
-
-    /// Hardness scaled by 1 / scaleHardness.
-    const float scaledHardness = hardness / parameters->scaleHardness;
-
-    // Set the pan.
-    pan.pos(value(MarimbaParameter::Pan));
-
-    while (io()) {
-        // Generate a sample in mono.
-
-        const std::array<float, AdditiveMarimbaParameters::OSCILLATOR_COUNT>
-            samples = {
-                float(oscillators[0]() * envelopes[0]()),
-                float(oscillators[1]() * envelopes[1]() * scaledHardness *
-                      (1 - brightness)),
-                float(oscillators[2]() * envelopes[2]() * scaledHardness *
-                      brightness * std::fmin(location, 1)),
-            };
-
-        // Set the followers after the generated sample components.
-        for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
-             i++) {
-            followers[i](samples[i]);
+        gains[i] = targets[i];
+    }
+    panGains[0] = panTargets[0];
+    panGains[1] = panTargets[1];
+
+    // The partial gains and the pan only change with their parameters, so
+    // most periods reuse them.
+    const float hardness = params[MarimbaParameter::Hardness];
+    const float brightness = params[MarimbaParameter::Brightness];
+    if (hardness != partialHardness || brightness != partialBrightness) {
+        partialGains(*parameters, id(), hardness, brightness, partials);
+        partialHardness = hardness;
+        partialBrightness = brightness;
+    }
+    /// Amplitude scaled by 1 / scaleAmplitude.
+    const float scaledAmplitude =
+        params[MarimbaParameter::Amplitude] / parameters->scaleAmplitude;
+    /// Amplitude below which a partial is masked by the mix.
+    const float floor = adapting ? culler().floor() : 0.f;
+    /// Partials kept past the attack under the current load.
+    const std::size_t limit =
+        adapting ? partialLimit(governor().tier())
+                 : AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+
+    /// Combined gain of the remaining partials.
+    float total = 0.f;
+    /// Whether every remaining partial is past its attack.
+    bool decaying = true;
+
+    for (std::size_t j = 0; j < liveCount;) {
+        const std::size_t i = live[j];
+        levels[i] = envelopes[i].advance(period) * partials[i];
+        targets[i] = levels[i] * scaledAmplitude;
+
+        // Under load, ramp out the partials the tier leaves out once the
+        // note's attack has passed.
+        const bool thinned = i >= limit && envelopes[i].decaying();
+        if (thinned) {
+            levels[i] = targets[i] = 0.f;
         }
 
-        float sampleLeft;
-        float sampleRight;
+        const bool ended =
+            (envelopes[i].done() || thinned) && gains[i] == 0.f;
+        const bool masked = envelopes[i].decaying() && gains[i] < floor &&
+                            targets[i] < floor;
+        if (ended || masked) {
+            // Stop rendering the partial.
+            if (!ended) {
+                culler().partialCulled();
+            }
+            levels[i] = gains[i] = targets[i] = steps[i] = 0.f;
+            live[j] = live[--liveCount];
+            continue;
+        }
 
-        // Sum the samples and scale them down by `scaleAmplitude`. Split the
-        // generated mono sample into left and right.
-        pan(std::accumulate(samples.begin(), samples.end(), 0.f) *
-                value(MarimbaParameter::Amplitude) / parameters->scaleAmplitude,
-            sampleLeft, sampleRight);
+        steps[i] = (targets[i] - gains[i]) / period;
+        total += targets[i];
+        decaying = decaying && envelopes[i].decaying();
+        j++;
+    }
 
-        // Send the output samples to their respective channels.
-        io.out(0) += sampleLeft;
-        io.out(1) += sampleRight;
+    // Free the voice once every partial has ended, or once the partials
+    // together are masked by the mix.
+    if (!liveCount) {
+        finished = true;
+    } else if (decaying && total < floor) {
+        culler().voiceCulled();
+        finished = true;
     }
 
-    // The first sample will always be loudest, so we can just wait for the
-    // first envelope to be silent.
-    if (followers[0].done()) {
+    // Equal-power pan.
+    if (params[MarimbaParameter::Pan] != panPosition) {
+        panPosition = params[MarimbaParameter::Pan];
+        const float angle =
+            (std::fmax(std::fmin(panPosition, 1.f), -1.f) + 1.f) *
+            float(M_PI) / 4.f;
+        panTargets[0] = std::cos(angle);
+        panTargets[1] = std::sin(angle);
+    }
+    if (starting) {
+        // The first period of a note starts at the target pan.
+        panGains[0] = panTargets[0];
+        panGains[1] = panTargets[1];
+        starting = false;
+    }
+    panSteps[0] = (panTargets[0] - panGains[0]) / period;
+    panSteps[1] = (panTargets[1] - panGains[1]) / period;
+
+    tickFrames = period;
+}
+
+void AdditiveMarimbaBase::onProcess(al::AudioIOData &io) {
+    if (defer(io)) {
+        // The parallel renderer will render this block.
+        return;
+    }
+    // Account the time spent rendering to this voice type.
+    const VoiceTimer timer(VoiceType::Additive, io.framesPerBuffer());
+
+    // Set values according to internal trigger parameter values. They are
+    // read at most once per block, and only in blocks where a control period
+    // starts, so small blocks do not pay for them every time. Changes
+    // scheduled within the block are read again at the first control period
+    // starting at or after their frames, and glide in over it.
+    ParameterSnapshot params;
+    bool read = false;
+
+    float *const left = io.outBuffer(0);
+    float *const right = io.outBuffer(1);
+    const unsigned int frames = io.framesPerBuffer();
+    Scratch &buffers = scratch();
+    // `al::AudioIOData::frame` is one before the voice's start offset.
+    const unsigned int offset = io.frame() + 1;
+
+    // Across a speaker layout, the pan is read once per block and ramped to
+    // over the block instead.
+    const bool spatialized = spatial.active();
+    if (spatialized) {
+        spatial.aim(value(MarimbaParameter::Pan),
+                    value(MarimbaParameter::Distance),
+                    offset < frames ? frames - offset : 0);
+    }
+
+    for (unsigned int start = offset; start < frames;) {
+        const unsigned int chunk = std::min(frames - start, CHUNK_FRAMES);
+        clear(buffers.mono, chunk);
+
+        // Render the chunk a control period at a time: each partial's
+        // oscillator, then its gain ramp into the mono mix, then the pan
+        // ramps.
+        for (unsigned int frame = 0; frame < chunk;) {
+            if (!tickFrames) {
+                if (settle(start + frame) || !read) {
+                    params = parameterTable.snapshot();
+                    read = true;
+                }
+                tick(params);
+            }
+
+            const unsigned int span = std::min(chunk - frame, tickFrames);
+            for (std::size_t j = 0; j < liveCount; j++) {
+                const std::size_t i = live[j];
+                for (unsigned int k = 0; k < span; k++) {
+                    buffers.stage[k] = oscillators[i]();
+                }
+                accumulateRamp(buffers.mono + frame, buffers.stage, span,
+                               gains[i], steps[i]);
+                gains[i] += steps[i] * span;
+            }
+            if (!spatialized) {
+                ramp(buffers.left + frame, span, panGains[0], panSteps[0]);
+                ramp(buffers.right + frame, span, panGains[1], panSteps[1]);
+                panGains[0] += panSteps[0] * span;
+                panGains[1] += panSteps[1] * span;
+            }
+
+            frame += span;
+            tickFrames -= span;
+        }
+
+        // Fade out if stolen, then split the mono mix into left and right,
+        // or across the speakers.
+        fade(buffers.mono, chunk);
+        if (spatialized) {
+            spatial.accumulate(buffers.mono, chunk, io, start);
+        } else {
+            panAccumulate(buffers.mono, buffers.left, buffers.right, chunk,
+                          left + start, right + start);
+        }
+        start += chunk;
+    }
+    // Changes due after the block's last control period start the next
+    // block's.
+    settle(frames);
+
+    if (faded()) {
+        // The voice was stolen and has faded out.
+        return;
+    }
+    if (finished) {
         // Free the voice.
+        trace(TraceLevel::Debug, TraceEvent::VoiceFree, id(), id(),
+              plan.frequency);
         free();
     }
 }
 
-void AdditiveMarimbaBase::onTriggerOn() {
+void AdditiveMarimbaBase::onStrike() {
+    // The ID of the voice is the MIDI note it sounds.
+    VoicePlanCache *const cache = planCache ? planCache : parameters->plans;
+    plan = cache->plan(*parameters, id(), parameterTable.snapshot());
+
+    trace(TraceLevel::Debug, TraceEvent::VoiceTrigger, id(), id(),
+          plan.frequency);
+
+    const float sampleRate = gam::sampleRate();
     for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
          i++) {
+        // Start every note from the same phase, so a note sounds the same
+        // whichever voice plays it.
+        oscillators[i].phase(0.f);
+        oscillators[i].freq(plan.frequencies[i]);
+        envelopes[i].lengths(plan.lengths[i][0] * sampleRate,
+                             plan.lengths[i][1] * sampleRate,
+                             plan.lengths[i][2] * sampleRate);
         envelopes[i].reset();
+        levels[i] = targets[i] = 0.f;
     }
-}
 
-void AdditiveMarimbaBase::onTriggerOff() {}
+    // Render every partial with a frequency.
+    liveCount = 0;
+    for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+         i++) {
+        if (plan.frequencies[i] > 0.f) {
+            live[liveCount++] = i;
+        }
+    }
 
-float AdditiveMarimbaBase::value(const MarimbaParameter &p) {
-    return kelon::value(p, *this);
-}
+    // Recompute the partial gains and the pan in the first control period.
+    partialHardness = partialBrightness = panPosition = NAN;
+    spatial.reset();
 
-void AdditiveMarimbaBase::value(const MarimbaParameter &p, const float val) {
-    kelon::value(p, *this, val);
+    // Start a control period at the first frame.
+    tickFrames = 0;
+    starting = true;
+    finished = false;
 }
 
-}; // namespace kelon
\ No newline at end of file
+void AdditiveMarimbaBase::onTriggerOff() {}
+
+}; // namespace kelon
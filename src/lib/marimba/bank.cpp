@@ -0,0 +1,271 @@
+
+#include <kelon/marimba/bank.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <map>
+
+#include <kelon/marimba/plan.hpp>
+
+namespace kelon {
+
+/// Mapping of additive engines to their identifiers.
+const std::map<AdditiveEngine, std::string> ADDITIVE_ENGINE_NAMES = {
+    {AdditiveEngine::Voices, "voices"},
+    {AdditiveEngine::Bank, "bank"},
+};
+
+const std::string &name(const AdditiveEngine &e) {
+    return ADDITIVE_ENGINE_NAMES.at(e);
+}
+
+bool parse(const std::string &s, AdditiveEngine &e) {
+    for (const auto &entry : ADDITIVE_ENGINE_NAMES) {
+        if (entry.second == s) {
+            e = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Frames left in a segment that never ends.
+static const std::uint32_t FOREVER = std::numeric_limits<std::uint32_t>::max();
+/// Cycles per step of a fixed-point phase.
+static const float PHASE_UNIT = 1.f / 4294967296.f;
+
+AdditiveVoiceBank::AdditiveVoiceBank(
+    const AdditiveMarimbaParameters *const params)
+    : parameters(params) {
+    clear();
+}
+
+void AdditiveVoiceBank::clear() {
+    for (std::size_t i = 0; i < CAPACITY; i++) {
+        silence(i);
+    }
+    std::fill(std::begin(voicePartials), std::end(voicePartials), 0);
+    partialCount = 0;
+    voiceCount = 0;
+}
+
+bool AdditiveVoiceBank::trigger(const unsigned char note,
+                                const ParameterSnapshot &params) {
+    if (voiceCount == MAX_VOICES) {
+        return false;
+    }
+
+    // Find a free note slot.
+    std::size_t slot = 0;
+    while (voicePartials[slot]) {
+        slot++;
+    }
+
+    const float sampleRate = gam::sampleRate();
+    VoicePlanCache *const cache = planCache ? planCache : parameters->plans;
+    const VoicePlan &plan = cache->plan(*parameters, note, params);
+    const float scaledAmplitude =
+        params[MarimbaParameter::Amplitude] / parameters->scaleAmplitude;
+
+    // Equal-power pan.
+    const float angle =
+        (std::fmax(std::fmin(params[MarimbaParameter::Pan], 1.f), -1.f) + 1.f) *
+        float(M_PI) / 4.f;
+    const float left = std::cos(angle);
+    const float right = std::sin(angle);
+
+    for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+         i++) {
+        if (plan.frequencies[i] <= 0.f) {
+            // A zeroth harmonic has no envelope to run.
+            continue;
+        }
+
+        const std::size_t p = partialCount++;
+        const double increment = double(plan.frequencies[i]) / sampleRate;
+
+        phases[p] = 0;
+        steps[p] = std::uint32_t(
+            std::llround((increment - std::floor(increment)) * 4294967296.));
+        increments[p] = steps[p] * PHASE_UNIT;
+        for (std::size_t s = 0; s < SEGMENTS; s++) {
+            lengths[p][s] = plan.lengths[i][s] * sampleRate;
+        }
+        enter(p, 0, 0.f);
+        gainsLeft[p] = plan.gains[i] * scaledAmplitude * left;
+        gainsRight[p] = plan.gains[i] * scaledAmplitude * right;
+        owners[p] = slot;
+
+        voicePartials[slot]++;
+    }
+
+    if (voicePartials[slot]) {
+        voiceCount++;
+    }
+    return true;
+}
+
+void AdditiveVoiceBank::render(al::AudioIOData &io, const unsigned int begin,
+                               const unsigned int end) {
+    float *const outLeft = io.outBuffer(0);
+    float *const outRight = io.outBuffer(1);
+
+    for (std::size_t start = begin; start < end; start += CHUNK_FRAMES) {
+        const std::size_t length =
+            std::min<std::size_t>(end - start, CHUNK_FRAMES);
+        std::fill(lanesLeft, lanesLeft + length * simd::WIDTH, 0.f);
+        std::fill(lanesRight, lanesRight + length * simd::WIDTH, 0.f);
+
+        for (std::size_t group = 0; group < partialCount;
+             group += simd::WIDTH) {
+            float lanes[simd::WIDTH];
+            for (std::size_t k = 0; k < simd::WIDTH; k++) {
+                lanes[k] = phases[group + k] * PHASE_UNIT;
+            }
+            simd::vfloat phase = simd::load(lanes);
+            const simd::vfloat increment = simd::load(increments + group);
+            const simd::vfloat gainLeft = simd::load(gainsLeft + group);
+            const simd::vfloat gainRight = simd::load(gainsRight + group);
+
+            std::size_t frame = 0;
+            while (frame < length) {
+                // Render up to the next envelope breakpoint in this group.
+                std::size_t span = length - frame;
+                for (std::size_t k = group; k < group + simd::WIDTH; k++) {
+                    if (segments[k] != DONE) {
+                        span = std::min<std::size_t>(span, remaining[k]);
+                    }
+                }
+
+                for (std::size_t k = 0; k < simd::WIDTH; k++) {
+                    lanes[k] = envelope(group + k);
+                }
+                simd::vfloat level = simd::load(lanes);
+                const simd::vfloat slope = simd::load(slopes + group);
+                for (std::size_t t = frame; t < frame + span; t++) {
+                    const simd::vfloat sample =
+                        simd::mul(simd::sine(phase), level);
+                    float *const left = lanesLeft + t * simd::WIDTH;
+                    float *const right = lanesRight + t * simd::WIDTH;
+                    simd::store(left, simd::add(simd::load(left),
+                                                simd::mul(sample, gainLeft)));
+                    simd::store(right,
+                                simd::add(simd::load(right),
+                                          simd::mul(sample, gainRight)));
+
+                    phase = simd::wrap(simd::add(phase, increment));
+                    level = simd::add(level, slope);
+                }
+                frame += span;
+
+                for (std::size_t k = group; k < group + simd::WIDTH; k++) {
+                    if (segments[k] != DONE) {
+                        remaining[k] -= span;
+                        if (!remaining[k]) {
+                            enter(k, segments[k] + 1, overshoots[k]);
+                        }
+                    }
+                }
+            }
+
+            // Step the fixed-point phases over the chunk, dropping the
+            // rounding the floating-point ones gathered.
+            for (std::size_t k = group; k < group + simd::WIDTH; k++) {
+                phases[k] += steps[k] * std::uint32_t(length);
+            }
+        }
+
+        for (std::size_t t = 0; t < length; t++) {
+            outLeft[start + t] +=
+                simd::sum(simd::load(lanesLeft + t * simd::WIDTH));
+            outRight[start + t] +=
+                simd::sum(simd::load(lanesRight + t * simd::WIDTH));
+        }
+    }
+
+    // Drop finished partials, keeping the sounding ones packed.
+    for (std::size_t p = partialCount; p-- > 0;) {
+        if (segments[p] == DONE) {
+            if (!--voicePartials[owners[p]]) {
+                voiceCount--;
+            }
+            partialCount--;
+            move(partialCount, p);
+            silence(partialCount);
+        }
+    }
+}
+
+void AdditiveVoiceBank::enter(const std::size_t partial,
+                              std::uint8_t segment, float offset) {
+    const float *const envelopeLevels =
+        AdditiveMarimbaParameters::ENVELOPE_LEVELS;
+    while (segment < DONE && offset >= lengths[partial][segment]) {
+        offset -= lengths[partial][segment];
+        segment++;
+    }
+    segments[partial] = segment;
+
+    if (segment == DONE) {
+        slopes[partial] = 0.f;
+        remaining[partial] = FOREVER;
+        overshoots[partial] = 0.f;
+        return;
+    }
+
+    // Frames of the segment fall `offset` frames into it and every frame
+    // after, up to its end.
+    const float length = lengths[partial][segment];
+    const float frames = std::ceil(length - offset);
+    slopes[partial] =
+        (envelopeLevels[segment + 1] - envelopeLevels[segment]) / length;
+    remaining[partial] = std::uint32_t(frames);
+    overshoots[partial] = offset + frames - length;
+}
+
+float AdditiveVoiceBank::envelope(const std::size_t partial) const {
+    const float *const envelopeLevels =
+        AdditiveMarimbaParameters::ENVELOPE_LEVELS;
+    const std::uint8_t segment = segments[partial];
+    if (segment == DONE) {
+        return envelopeLevels[SEGMENTS];
+    }
+    // The segment's last frame falls `overshoots` frames short of where the
+    // next segment's level is reached.
+    return envelopeLevels[segment + 1] -
+           slopes[partial] * (float(remaining[partial]) - overshoots[partial]);
+}
+
+void AdditiveVoiceBank::silence(const std::size_t partial) {
+    phases[partial] = 0;
+    steps[partial] = 0;
+    increments[partial] = 0.f;
+    slopes[partial] = 0.f;
+    gainsLeft[partial] = 0.f;
+    gainsRight[partial] = 0.f;
+    remaining[partial] = FOREVER;
+    overshoots[partial] = 0.f;
+    segments[partial] = DONE;
+    owners[partial] = 0;
+}
+
+void AdditiveVoiceBank::move(const std::size_t from, const std::size_t to) {
+    if (from == to) {
+        return;
+    }
+    phases[to] = phases[from];
+    steps[to] = steps[from];
+    increments[to] = increments[from];
+    slopes[to] = slopes[from];
+    gainsLeft[to] = gainsLeft[from];
+    gainsRight[to] = gainsRight[from];
+    remaining[to] = remaining[from];
+    overshoots[to] = overshoots[from];
+    segments[to] = segments[from];
+    std::copy(std::begin(lengths[from]), std::end(lengths[from]),
+              std::begin(lengths[to]));
+    owners[to] = owners[from];
+}
+
+}; // namespace kelon
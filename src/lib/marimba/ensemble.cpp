@@ -0,0 +1,171 @@
+
+#include <kelon/marimba/ensemble.hpp>
+
+#include <algorithm>
+#include <map>
+
+#include <kelon/marimba/instruments.hpp>
+
+namespace kelon {
+
+/// Mapping of instruments to their identifiers.
+const std::map<Instrument, std::string> INSTRUMENT_NAMES = {
+    {Instrument::Marimba, "marimba"},
+    {Instrument::Xylophone, "xylophone"},
+    {Instrument::Subtractive, "subtractive"},
+    {Instrument::Modal, "modal"},
+};
+
+const std::string &name(const Instrument &i) {
+    return INSTRUMENT_NAMES.at(i);
+}
+
+bool parse(const std::string &s, Instrument &i) {
+    for (const auto &entry : INSTRUMENT_NAMES) {
+        if (entry.second == s) {
+            i = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+Ensemble::Ensemble(al::PolySynth &s)
+    : pools{{VoicePool(s), VoicePool(s), VoicePool(s), VoicePool(s)}},
+      sampledPools{{VoicePool(s), VoicePool(s)}} {
+    instrumentParameters[std::size_t(Instrument::Marimba)] =
+        defaults(AdditiveMarimba::PARAMETERS->internalTriggerParameters);
+    instrumentParameters[std::size_t(Instrument::Xylophone)] =
+        defaults(AdditiveXylophone::PARAMETERS->internalTriggerParameters);
+    instrumentParameters[std::size_t(Instrument::Subtractive)] =
+        defaults(SubtractiveMarimba::PARAMETERS->internalTriggerParameters);
+    instrumentParameters[std::size_t(Instrument::Modal)] =
+        defaults(EnsembleModalMarimba::PARAMETERS->internalTriggerParameters);
+
+    for (std::size_t c = 0; c < MIDI_CHANNELS; c++) {
+        routes[c].store(c < INSTRUMENTS ? Instrument(c) : Instrument::Marimba,
+                        std::memory_order_relaxed);
+    }
+}
+
+void Ensemble::allocate(const unsigned int polyphony,
+                        const unsigned int reserve, const bool sampled,
+                        const bool banked) {
+    if (banked) {
+        // The banks hold every partial inline, so keep them off the stack.
+        banks[std::size_t(Instrument::Marimba)].reset(
+            new AdditiveVoiceBank(AdditiveMarimba::PARAMETERS));
+        banks[std::size_t(Instrument::Xylophone)].reset(
+            new AdditiveVoiceBank(AdditiveXylophone::PARAMETERS));
+    } else {
+        pools[std::size_t(Instrument::Marimba)].allocate<AdditiveMarimba>(
+            polyphony, reserve);
+        pools[std::size_t(Instrument::Xylophone)].allocate<AdditiveXylophone>(
+            polyphony, reserve);
+    }
+    pools[std::size_t(Instrument::Subtractive)].allocate<SubtractiveMarimba>(
+        polyphony, reserve);
+    pools[std::size_t(Instrument::Modal)].allocate<EnsembleModalMarimba>(
+        polyphony, reserve);
+    if (sampled) {
+        sampledPools[std::size_t(Instrument::Marimba)]
+            .allocate<SampledMarimba>(polyphony, reserve);
+        sampledPools[std::size_t(Instrument::Xylophone)]
+            .allocate<SampledXylophone>(polyphony, reserve);
+    }
+}
+
+void Ensemble::policy(const StealPolicy p) {
+    for (auto &pool : pools) {
+        pool.policy(p);
+    }
+    for (auto &pool : sampledPools) {
+        pool.policy(p);
+    }
+}
+
+MarimbaVoice *Ensemble::acquire(const Instrument i, const unsigned char note) {
+    VoicePool &pool = pools[std::size_t(i)];
+    switch (i) {
+    case Instrument::Xylophone:
+        return pool.acquire<AdditiveXylophone>(note);
+    case Instrument::Subtractive:
+        return pool.acquire<SubtractiveMarimba>(note);
+    case Instrument::Modal:
+        return pool.acquire<EnsembleModalMarimba>(note);
+    case Instrument::Marimba:
+    default:
+        return pool.acquire<AdditiveMarimba>(note);
+    }
+}
+
+MarimbaVoice *Ensemble::acquire(const Instrument i, const unsigned char note,
+                                const SampleBank *const bank) {
+    SampledMarimbaBase *voice;
+    switch (i) {
+    case Instrument::Marimba:
+        voice = sampledPools[std::size_t(i)].acquire<SampledMarimba>(note);
+        break;
+    case Instrument::Xylophone:
+        voice = sampledPools[std::size_t(i)].acquire<SampledXylophone>(note);
+        break;
+    default:
+        return acquire(i, note);
+    }
+    if (voice) {
+        voice->bank(bank);
+    }
+    return voice;
+}
+
+bool Ensemble::strike(const Instrument i, const unsigned char note,
+                      const ParameterSnapshot &params,
+                      const unsigned int offset) {
+    if (!banked(i) || bankStrikeCount == MAX_BANK_STRIKES) {
+        trace(TraceLevel::Warning, TraceEvent::NoteDropped, -1, note, 0.f);
+        return false;
+    }
+    bankStrikes[bankStrikeCount++] = {i, note, offset, params};
+    return true;
+}
+
+void Ensemble::render(al::AudioIOData &io) {
+    const unsigned int frames = io.framesPerBuffer();
+    for (std::size_t b = 0; b < SAMPLED_INSTRUMENTS; b++) {
+        AdditiveVoiceBank *const bank = banks[b].get();
+        if (!bank) {
+            continue;
+        }
+
+        // Render up to each note's frame before striking it, so notes start
+        // where voices would.
+        unsigned int rendered = 0;
+        for (std::size_t s = 0; s < bankStrikeCount; s++) {
+            const BankStrike &strike = bankStrikes[s];
+            if (std::size_t(strike.instrument) != b) {
+                continue;
+            }
+            const unsigned int offset =
+                std::max(std::min(strike.offset, frames), rendered);
+            bank->render(io, rendered, offset);
+            rendered = offset;
+            if (!bank->trigger(strike.note, strike.params)) {
+                trace(TraceLevel::Warning, TraceEvent::NoteDropped, -1,
+                      strike.note, 0.f);
+            }
+        }
+        bank->render(io, rendered, frames);
+    }
+    bankStrikeCount = 0;
+}
+
+void Ensemble::value(const Instrument i, const MarimbaParameter p,
+                     const float v, const unsigned int offset) {
+    instrumentParameters[std::size_t(i)][p] = v;
+    pools[std::size_t(i)].value(p, v, offset);
+    if (std::size_t(i) < SAMPLED_INSTRUMENTS) {
+        sampledPools[std::size_t(i)].value(p, v, offset);
+    }
+}
+
+}; // namespace kelon
@@ -2,6 +2,7 @@
 #include <kelon/marimba/instruments.hpp>
 
 #include <kelon/marimba/additive.hpp>
+#include <kelon/marimba/plan.hpp>
 #include <kelon/util.hpp>
 
 namespace kelon {
@@ -11,6 +12,9 @@ const float MINIMUM_ADSR_TIME = 0.001;
 /// The maximum time allowed in an ADSR field.
 const float MAXIMUM_ADSR_TIME = 2.0;
 
+/// Per-note plans of the marimba.
+VoicePlanCache additiveMarimbaPlans;
+
 /// Constants for the marimba.
 const AdditiveMarimbaParameters additiveMarimbaParameters{
     {1, 4, 10},
@@ -36,11 +40,17 @@ const AdditiveMarimbaParameters additiveMarimbaParameters{
 
         {MarimbaParameter::FirstOvertone, 4, 0, 12},
         {MarimbaParameter::SecondOvertone, 10, 0, 12},
-    }};
+
+        {MarimbaParameter::Distance, 1.0, 0.0, 4.0},
+    },
+    &additiveMarimbaPlans};
 
 /// The visualized playing range of the marimba.
 const MarimbaRange additiveMarimbaRange = {C2, C8};
 
+/// Per-note plans of the xylophone.
+VoicePlanCache additiveXylophonePlans;
+
 /// Constants for the xylophone.
 const AdditiveMarimbaParameters additiveXylophoneParameters{
     {1, 3, 6},
@@ -66,7 +76,10 @@ const AdditiveMarimbaParameters additiveXylophoneParameters{
 
         {MarimbaParameter::FirstOvertone, 3, 0, 12},
         {MarimbaParameter::SecondOvertone, 6, 0, 12},
-    }};
+
+        {MarimbaParameter::Distance, 1.0, 0.0, 4.0},
+    },
+    &additiveXylophonePlans};
 
 /// The visualized playing range of the xylophone.
 const MarimbaRange additiveXylophoneRange = {C2, C8};
@@ -90,11 +103,179 @@ const SubtractiveMarimbaParameters subtractiveMarimbaParameters{{
 
     {MarimbaParameter::VisualWidth, 1200, 0, 4096},
     {MarimbaParameter::VisualHeight, 900, 0, 4096},
+
+    {MarimbaParameter::Distance, 1.0, 0.0, 4.0},
 }};
 
 /// The visualized playing range of the xylophone.
 const MarimbaRange subtractiveMarimbaRange = {C2, C8};
 
+/**
+ * Modes of a marimba bar, most important first. The first three are the
+ * vertical bending modes the bar's undercut tunes to 1:4:10. Higher bending
+ * modes follow the spacing of a uniform free bar, scaled to the tuned third
+ * mode. Torsional modes are spaced harmonically and lateral modes like the
+ * bending modes of the bar's width. Higher modes are excited less by a
+ * central strike and decay faster.
+ */
+const MarimbaMode marimbaModes[] = {
+    // Tuned bending modes.
+    {1.f, 1.f, 1.f},
+    {4.f, 0.55f, 0.35f},
+    {10.f, 0.35f, 0.2f},
+    // Modes 4 to 8.
+    {3.1f, 0.45f, 0.06f},
+    {2.3f, 0.5f, 0.04f},
+    {16.5f, 0.25f, 0.08f},
+    {6.2f, 0.38f, 0.03f},
+    {24.7f, 0.2f, 0.05f},
+    // Modes 9 to 16.
+    {7.9f, 0.36f, 0.02f},
+    {9.3f, 0.32f, 0.02f},
+    {34.5f, 0.16f, 0.035f},
+    {12.4f, 0.28f, 0.015f},
+    {16.f, 0.26f, 0.015f},
+    {45.9f, 0.13f, 0.025f},
+    {15.5f, 0.25f, 0.012f},
+    {18.6f, 0.22f, 0.01f},
+    // Modes 17 to 32.
+    {59.f, 0.11f, 0.018f},
+    {26.3f, 0.2f, 0.01f},
+    {21.7f, 0.2f, 0.008f},
+    {73.7f, 0.09f, 0.013f},
+    {24.8f, 0.18f, 0.007f},
+    {38.5f, 0.15f, 0.007f},
+    {27.9f, 0.16f, 0.006f},
+    {90.f, 0.08f, 0.01f},
+    {31.f, 0.15f, 0.005f},
+    {52.4f, 0.12f, 0.005f},
+    {34.1f, 0.14f, 0.004f},
+    {108.f, 0.07f, 0.008f},
+    {37.2f, 0.13f, 0.004f},
+    {68.1f, 0.1f, 0.004f},
+    {128.f, 0.06f, 0.006f},
+    {85.5f, 0.08f, 0.003f},
+};
+
+/// Tuning of the modal instruments.
+std::atomic<const TuningTable *> modalMarimbaTuning{nullptr};
+
+/// Constants for the modal marimba.
+const ModalMarimbaParameters modalMarimbaParameters{
+    marimbaModes,
+    sizeof(marimbaModes) / sizeof(marimbaModes[0]),
+    1,
+    2,
+    {
+        {MarimbaParameter::Hardness, 0.5, 0.0, 1.0},
+        {MarimbaParameter::Brightness, 0.6, 0.0, 1.0},
+
+        {MarimbaParameter::Amplitude, 0.8, 0.0, 1.0},
+
+        {MarimbaParameter::AttackTime, 0.002, MINIMUM_ADSR_TIME,
+         MAXIMUM_ADSR_TIME},
+        {MarimbaParameter::ReleaseTime, 1.5, MINIMUM_ADSR_TIME,
+         MAXIMUM_ADSR_TIME},
+
+        {MarimbaParameter::Pan, 0.0, -1.0, 1.0},
+
+        {MarimbaParameter::VisualWidth, 1200, 0, 4096},
+        {MarimbaParameter::VisualHeight, 900, 0, 4096},
+
+        {MarimbaParameter::FirstOvertone, 4, 0, 12},
+        {MarimbaParameter::SecondOvertone, 10, 0, 12},
+
+        {MarimbaParameter::Distance, 1.0, 0.0, 4.0},
+    },
+    &modalMarimbaTuning};
+
+/// The visualized playing range of the modal marimba.
+const MarimbaRange modalMarimbaRange = {C2, C8};
+
+/**
+ * Modes of a xylophone bar, most important first. The undercut tunes the
+ * first three to 1:3:6, and the rest are the marimba bar's, scaled to the
+ * tuned third mode. The overtones are struck harder than the marimba's and
+ * ring for less of the fundamental's decay.
+ */
+const MarimbaMode xylophoneModes[] = {
+    // Tuned bending modes.
+    {1.f, 1.f, 1.f},
+    {3.f, 0.45f, 0.45f},
+    {6.f, 0.3f, 0.25f},
+    // Modes 4 to 8.
+    {1.86f, 0.45f, 0.06f},
+    {1.38f, 0.5f, 0.04f},
+    {9.9f, 0.25f, 0.08f},
+    {3.72f, 0.38f, 0.03f},
+    {14.82f, 0.2f, 0.05f},
+    // Modes 9 to 16.
+    {4.74f, 0.36f, 0.02f},
+    {5.58f, 0.32f, 0.02f},
+    {20.7f, 0.16f, 0.035f},
+    {7.44f, 0.28f, 0.015f},
+    {9.6f, 0.26f, 0.015f},
+    {27.54f, 0.13f, 0.025f},
+    {9.3f, 0.25f, 0.012f},
+    {11.16f, 0.22f, 0.01f},
+    // Modes 17 to 32.
+    {35.4f, 0.11f, 0.018f},
+    {15.78f, 0.2f, 0.01f},
+    {13.02f, 0.2f, 0.008f},
+    {44.22f, 0.09f, 0.013f},
+    {14.88f, 0.18f, 0.007f},
+    {23.1f, 0.15f, 0.007f},
+    {16.74f, 0.16f, 0.006f},
+    {54.f, 0.08f, 0.01f},
+    {18.6f, 0.15f, 0.005f},
+    {31.44f, 0.12f, 0.005f},
+    {20.46f, 0.14f, 0.004f},
+    {64.8f, 0.07f, 0.008f},
+    {22.32f, 0.13f, 0.004f},
+    {40.86f, 0.1f, 0.004f},
+    {76.8f, 0.06f, 0.006f},
+    {51.3f, 0.08f, 0.003f},
+};
+
+/// Constants for the modal xylophone. It shares the modal marimba's tuning.
+const ModalMarimbaParameters modalXylophoneParameters{
+    xylophoneModes,
+    sizeof(xylophoneModes) / sizeof(xylophoneModes[0]),
+    1,
+    2,
+    {
+        {MarimbaParameter::Hardness, 0.75, 0.0, 1.0},
+        {MarimbaParameter::Brightness, 0.25, 0.0, 1.0},
+
+        {MarimbaParameter::Amplitude, 0.8, 0.0, 1.0},
+
+        {MarimbaParameter::AttackTime, 0.001, MINIMUM_ADSR_TIME,
+         MAXIMUM_ADSR_TIME},
+        {MarimbaParameter::ReleaseTime, 1.5, MINIMUM_ADSR_TIME,
+         MAXIMUM_ADSR_TIME},
+
+        {MarimbaParameter::Pan, 0.0, -1.0, 1.0},
+
+        {MarimbaParameter::VisualWidth, 1200, 0, 4096},
+        {MarimbaParameter::VisualHeight, 900, 0, 4096},
+
+        {MarimbaParameter::FirstOvertone, 3, 0, 12},
+        {MarimbaParameter::SecondOvertone, 6, 0, 12},
+
+        {MarimbaParameter::Distance, 1.0, 0.0, 4.0},
+    },
+    &modalMarimbaTuning};
+
+/// The visualized playing range of the modal xylophone.
+const MarimbaRange modalXylophoneRange = {C2, C8};
+
+const AdditiveMarimbaParameters *const AdditiveMarimba::PARAMETERS =
+    &additiveMarimbaParameters;
+const AdditiveMarimbaParameters *const AdditiveXylophone::PARAMETERS =
+    &additiveXylophoneParameters;
+const SubtractiveMarimbaParameters *const SubtractiveMarimba::PARAMETERS =
+    &subtractiveMarimbaParameters;
+
 AdditiveMarimba::AdditiveMarimba()
     : AdditiveVisualizedMarimba(&additiveMarimbaParameters,
                                 &additiveMarimbaRange){};
@@ -103,8 +284,42 @@ AdditiveXylophone::AdditiveXylophone()
     : AdditiveVisualizedMarimba(&additiveXylophoneParameters,
                                 &additiveXylophoneRange){};
 
+SampledMarimba::SampledMarimba()
+    : SampledVisualizedMarimba(&additiveMarimbaParameters,
+                               &additiveMarimbaRange){};
+
+SampledXylophone::SampledXylophone()
+    : SampledVisualizedMarimba(&additiveXylophoneParameters,
+                               &additiveXylophoneRange){};
+
 SubtractiveMarimba::SubtractiveMarimba()
     : SubtractiveVisualizedMarimba(&subtractiveMarimbaParameters,
                                    &subtractiveMarimbaRange){};
 
+template <std::size_t N>
+const ModalMarimbaParameters *const ModalMarimba<N>::PARAMETERS =
+    &modalMarimbaParameters;
+
+template <std::size_t N>
+ModalMarimba<N>::ModalMarimba()
+    : ModalMarimbaBase<N>(&modalMarimbaParameters, &modalMarimbaRange){};
+
+template class ModalMarimba<3>;
+template class ModalMarimba<8>;
+template class ModalMarimba<16>;
+template class ModalMarimba<32>;
+
+template <std::size_t N>
+const ModalMarimbaParameters *const ModalXylophone<N>::PARAMETERS =
+    &modalXylophoneParameters;
+
+template <std::size_t N>
+ModalXylophone<N>::ModalXylophone()
+    : ModalMarimbaBase<N>(&modalXylophoneParameters, &modalXylophoneRange){};
+
+template class ModalXylophone<3>;
+template class ModalXylophone<8>;
+template class ModalXylophone<16>;
+template class ModalXylophone<32>;
+
 }; // namespace kelon
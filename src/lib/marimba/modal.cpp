@@ -0,0 +1,279 @@
+
+#include <kelon/marimba/modal.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include <kelon/block.hpp>
+#include <kelon/cull.hpp>
+#include <kelon/meter.hpp>
+#include <kelon/trace.hpp>
+#include <kelon/util.hpp>
+
+namespace kelon {
+
+/// Energy below which a mode is silenced, keeping it out of denormals.
+const float MODE_FLOOR = 1e-20f;
+/// Energy below which the whole voice is freed, about -90 dB.
+const float VOICE_FLOOR = 1e-9f;
+
+template <std::size_t N>
+ModalMarimbaBase<N>::ModalMarimbaBase(
+    const ModalMarimbaParameters *const params,
+    const MarimbaRange *const range)
+    : MarimbaVoice(), MarimbaVisualizer(range), parameters(params) {
+    for (std::size_t k = 0; k < N; k++) {
+        stateReal[k] = stateImag[k] = 0.f;
+        poleReal[k] = poleImag[k] = 0.f;
+        displayNotes[k] = 0;
+    }
+}
+
+template <std::size_t N> void ModalMarimbaBase<N>::init() {
+    // Set up the main parameters of the voice.
+    createParameters(parameters->internalTriggerParameters);
+}
+
+template <std::size_t N>
+void ModalMarimbaBase<N>::onProcess(al::AudioIOData &io) {
+    if (defer(io)) {
+        // The parallel renderer will render this block.
+        return;
+    }
+    // Account the time spent rendering to this voice type.
+    const VoiceTimer timer(VoiceType::Modal, io.framesPerBuffer());
+
+    // Set values according to internal trigger parameter values. They are
+    // read once per block, with the changes scheduled within it.
+    settle(io.framesPerBuffer());
+    const ParameterSnapshot params = parameterTable.snapshot();
+
+    /// Amplitude scaled by 1 / scaleAmplitude.
+    const float scaledAmplitude =
+        params[MarimbaParameter::Amplitude] / parameters->scaleAmplitude;
+
+    // Set the pan, and read its gains off a unit sample.
+    pan.pos(params[MarimbaParameter::Pan]);
+    float gainLeft, gainRight;
+    pan(1.f, gainLeft, gainRight);
+
+    float *const left = io.outBuffer(0);
+    float *const right = io.outBuffer(1);
+    const unsigned int frames = io.framesPerBuffer();
+    float *const mono = scratch().mono;
+    // `al::AudioIOData::frame` is one before the voice's start offset.
+    const unsigned int offset = io.frame() + 1;
+
+    // Across a speaker layout, the gains are aimed once per block.
+    const bool spatialized = spatial.active();
+    if (spatialized) {
+        spatial.aim(params[MarimbaParameter::Pan],
+                    params[MarimbaParameter::Distance],
+                    offset < frames ? frames - offset : 0);
+    }
+
+    for (unsigned int start = offset; start < frames;) {
+        const unsigned int chunk = std::min(frames - start, CHUNK_FRAMES);
+
+        // Advance every resonator by one complex multiply per frame and sum
+        // their imaginary parts.
+        for (unsigned int i = 0; i < chunk; i++) {
+            float sample = 0.f;
+            for (std::size_t k = 0; k < live; k++) {
+                const float re =
+                    stateReal[k] * poleReal[k] - stateImag[k] * poleImag[k];
+                const float im =
+                    stateReal[k] * poleImag[k] + stateImag[k] * poleReal[k];
+                stateReal[k] = re;
+                stateImag[k] = im;
+                sample += im;
+            }
+            mono[i] = sample;
+        }
+
+        // Fade the strike in.
+        for (unsigned int i = 0; i < chunk; i++) {
+            mono[i] = mono[i] * scaledAmplitude *
+                      std::fmin(attack + float(i) * attackStep, 1.f);
+        }
+        attack = std::fmin(attack + float(chunk) * attackStep, 1.f);
+
+        // Fade out if stolen, then split the mono output into left and
+        // right, or across the speakers.
+        fade(mono, chunk);
+        if (spatialized) {
+            spatial.accumulate(mono, chunk, io, start);
+        } else {
+            panAccumulate(mono, gainLeft, gainRight, chunk, left + start,
+                          right + start);
+        }
+        start += chunk;
+    }
+
+    /// Amplitude below which a mode is masked by the mix.
+    const float floor = culler().floor();
+    /// Whether the strike has finished fading in.
+    const bool struck = attack >= 1.f;
+
+    // Drop silent and masked modes, keeping the rest in order at the front.
+    float energy = 0.f;
+    std::size_t kept = 0;
+    for (std::size_t k = 0; k < live; k++) {
+        const float e =
+            stateReal[k] * stateReal[k] + stateImag[k] * stateImag[k];
+        if (e < MODE_FLOOR) {
+            continue;
+        }
+        if (struck && std::sqrt(e) * scaledAmplitude < floor) {
+            culler().partialCulled();
+            continue;
+        }
+        stateReal[kept] = stateReal[k];
+        stateImag[kept] = stateImag[k];
+        poleReal[kept] = poleReal[k];
+        poleImag[kept] = poleImag[k];
+        displayNotes[kept] = displayNotes[k];
+        energy += e;
+        kept++;
+    }
+    for (std::size_t k = kept; k < live; k++) {
+        stateReal[k] = stateImag[k] = 0.f;
+    }
+    live = kept;
+
+    if (faded()) {
+        // The voice was stolen and has faded out.
+        return;
+    }
+    const bool masked = struck && energy >= VOICE_FLOOR &&
+                        std::sqrt(energy) * scaledAmplitude < floor;
+    if (masked || energy < VOICE_FLOOR) {
+        // Free the voice.
+        if (masked) {
+            culler().voiceCulled();
+        }
+        trace(TraceLevel::Debug, TraceEvent::VoiceFree, id(), id(),
+              frequency);
+        free();
+    }
+}
+
+template <std::size_t N> float ModalMarimbaBase<N>::loudness() const {
+    float energy = 0.f;
+    for (std::size_t k = 0; k < live; k++) {
+        energy += stateReal[k] * stateReal[k] + stateImag[k] * stateImag[k];
+    }
+    return std::sqrt(energy) * value(MarimbaParameter::Amplitude) /
+           parameters->scaleAmplitude;
+}
+
+template <std::size_t N>
+void ModalMarimbaBase<N>::publish(VoiceLevels &levels) {
+    levels.voice = id();
+    levels.note = id();
+    publishRange(levels);
+    levels.hardness = value(MarimbaParameter::Hardness);
+
+    // Each mode is displayed at the note of its frequency, as tall as its
+    // amplitude. Modes at the note of the voice are drawn as the fundamental.
+    const std::size_t count =
+        live < MAX_VISUAL_PARTIALS ? live : MAX_VISUAL_PARTIALS;
+    levels.partials = count;
+    levels.overtones = 0;
+    for (std::size_t k = 0; k < count; k++) {
+        levels.notes[k] = displayNotes[k];
+        levels.levels[k] = std::sqrt(stateReal[k] * stateReal[k] +
+                                     stateImag[k] * stateImag[k]);
+        if (displayNotes[k] != id()) {
+            levels.overtones |= std::uint32_t(1) << k;
+        }
+    }
+}
+
+template <std::size_t N> void ModalMarimbaBase<N>::onStrike() {
+    const ParameterSnapshot params = parameterTable.snapshot();
+
+    /// Get the MIDI note we are playing from our voice ID.
+    const unsigned char note = id();
+    const TuningTable *const table =
+        parameters->tuning->load(std::memory_order_acquire);
+    frequency = table ? table->frequency(note) : midiNoteToFreq(note);
+    const float sampleRate = gam::sampleRate();
+
+    trace(TraceLevel::Debug, TraceEvent::VoiceTrigger, id(), note, frequency);
+
+    /// Hardness scaled by 1 / scaleHardness.
+    const float scaledHardness =
+        params[MarimbaParameter::Hardness] / parameters->scaleHardness;
+    /// Exponent of the frequency ratio each mode's gain is scaled by.
+    const float tilt = params[MarimbaParameter::Brightness] - 1.f;
+    /// Time for the fundamental to decay by 60 dB.
+    const float decayTime = std::fmax(
+        marimbaDecay(note, params[MarimbaParameter::ReleaseTime]), 0.15f);
+
+    // The tuned modes take their ratios from the overtones, and the modes
+    // past them move with the third, or keep their table ratios if it is
+    // silenced.
+    const float tuned[3] = {
+        1.f,
+        params[MarimbaParameter::FirstOvertone],
+        params[MarimbaParameter::SecondOvertone],
+    };
+    const float stretch = parameters->modeCount > 2 && tuned[2] > 0.f
+                              ? tuned[2] / parameters->modes[2].ratio
+                              : 1.f;
+
+    const std::size_t modes =
+        N < parameters->modeCount ? N : parameters->modeCount;
+    for (std::size_t k = 0; k < N; k++) {
+        if (k >= modes) {
+            poleReal[k] = poleImag[k] = 0.f;
+            stateReal[k] = stateImag[k] = 0.f;
+            continue;
+        }
+
+        const MarimbaMode &mode = parameters->modes[k];
+        const float ratio = k < 3 ? tuned[k] : mode.ratio * stretch;
+        const float modeFreq = frequency * ratio;
+        if (ratio <= 0.f || modeFreq >= sampleRate / 2.f) {
+            // Modes tuned to zero are silenced, and modes above Nyquist
+            // would alias.
+            poleReal[k] = poleImag[k] = 0.f;
+            stateReal[k] = stateImag[k] = 0.f;
+            continue;
+        }
+
+        // Decay by 60 dB (a factor of 1000) over the mode's decay time.
+        const float radius = std::exp(-std::log(1000.f) /
+                                      (decayTime * mode.decay * sampleRate));
+        const float angle = 2.f * float(M_PI) * modeFreq / sampleRate;
+        poleReal[k] = radius * std::cos(angle);
+        poleImag[k] = radius * std::sin(angle);
+
+        // Strike the resonator with an impulse.
+        stateReal[k] =
+            k ? mode.gain * scaledHardness * std::pow(ratio, tilt)
+              : mode.gain;
+        stateImag[k] = 0.f;
+
+        displayNotes[k] = freqToMidiNote(modeFreq);
+    }
+
+    // Silenced modes have no energy and are dropped after the first block.
+    live = modes;
+    // Start at the gains of the pan the note is struck with.
+    spatial.reset();
+
+    const float attackTime = params[MarimbaParameter::AttackTime];
+    attack = 0.f;
+    attackStep = attackTime > 0.f ? 1.f / (attackTime * sampleRate) : 1.f;
+}
+
+template <std::size_t N> void ModalMarimbaBase<N>::onTriggerOff() {}
+
+template class ModalMarimbaBase<3>;
+template class ModalMarimbaBase<8>;
+template class ModalMarimbaBase<16>;
+template class ModalMarimbaBase<32>;
+
+}; // namespace kelon
@@ -12,6 +12,7 @@ const std::map<MarimbaParameter, std::string> PARAMETER_NAMES = {
 
     {MarimbaParameter::Amplitude, "amplitude"},
     {MarimbaParameter::Pan, "pan"},
+    {MarimbaParameter::Distance, "distance"},
 
     {MarimbaParameter::AttackTime, "attack_time"},
     {MarimbaParameter::DecayTime, "decay_time"},
@@ -37,6 +38,47 @@ void create(const MarimbaParameter &p, al::SynthVoice &voice,
     voice.createInternalTriggerParameter(name(p), default_, min, max);
 }
 
+void ParameterTable::create(const MarimbaParameter &p, al::SynthVoice &voice,
+                            const float default_, const float min,
+                            const float max) {
+    handles[index(p)] =
+        voice.createInternalTriggerParameter(name(p), default_, min, max)
+            .get();
+}
+
+bool ParameterTable::has(const MarimbaParameter &p) const {
+    return handles[index(p)] != nullptr;
+}
+
+float ParameterTable::get(const MarimbaParameter &p) const {
+    al::Parameter *const handle = handles[index(p)];
+    return handle ? handle->get() : 0.f;
+}
+
+void ParameterTable::set(const MarimbaParameter &p, const float value) {
+    if (al::Parameter *const handle = handles[index(p)]) {
+        handle->set(value);
+    }
+}
+
+ParameterSnapshot ParameterTable::snapshot() const {
+    ParameterSnapshot s;
+    for (std::size_t i = 0; i < PARAMETER_COUNT; i++) {
+        if (handles[i]) {
+            s[MarimbaParameter(i)] = handles[i]->get();
+        }
+    }
+    return s;
+}
+
+void ParameterTable::assign(const ParameterSnapshot &snapshot) {
+    for (std::size_t i = 0; i < PARAMETER_COUNT; i++) {
+        if (handles[i]) {
+            handles[i]->set(snapshot[MarimbaParameter(i)]);
+        }
+    }
+}
+
 float value(const MarimbaParameter &p, al::SynthVoice &voice) {
     return voice.getInternalParameterValue(name(p));
 }
@@ -0,0 +1,115 @@
+
+#include <kelon/marimba/plan.hpp>
+
+#include <cmath>
+
+#include <kelon/util.hpp>
+
+namespace kelon {
+
+/// Equal-tempered tuning used when no table is set.
+static const TuningTable EQUAL_TEMPERAMENT;
+
+const MarimbaParameter VoicePlanCache::KEYS[KEY_COUNT] = {
+    MarimbaParameter::Hardness,      MarimbaParameter::Brightness,
+    MarimbaParameter::AttackTime,    MarimbaParameter::DecayTime,
+    MarimbaParameter::ReleaseTime,   MarimbaParameter::FirstOvertone,
+    MarimbaParameter::SecondOvertone,
+};
+
+void partialGains(const AdditiveMarimbaParameters &instrument,
+                  const unsigned char note, const float hardness,
+                  const float brightness,
+                  float (&gains)[AdditiveMarimbaParameters::OSCILLATOR_COUNT]) {
+    /// Higher values favor the second overtone, while lower values favor the
+    /// first.
+    const float scaledBrightness = brightness / 48.f;
+    /// Hardness scaled by 1 / scaleHardness.
+    const float scaledHardness = hardness / instrument.scaleHardness;
+    /// Location as a percent distance from C6.
+    const float location = 1.f - float(int(note) - C6) / float(C8 - C6);
+
+    gains[0] = 1.f;
+    gains[1] = scaledHardness * (1 - scaledBrightness);
+    gains[2] = scaledHardness * scaledBrightness * std::fmin(location, 1.f);
+}
+
+VoicePlanCache::VoicePlanCache() : currentTuning(&EQUAL_TEMPERAMENT) {}
+
+void VoicePlanCache::tuning(const TuningTable *const t) {
+    currentTuning.store(t ? t : &EQUAL_TEMPERAMENT, std::memory_order_release);
+}
+
+const VoicePlan &
+VoicePlanCache::plan(const AdditiveMarimbaParameters &instrument,
+                     const unsigned char note,
+                     const ParameterSnapshot &params) {
+    const TuningTable *const tuning =
+        currentTuning.load(std::memory_order_acquire);
+    if (stale(instrument, params, tuning)) {
+        // Only notes struck from now on are rebuilt.
+        for (std::size_t i = 0; i < KEY_COUNT; i++) {
+            keyValues[i] = params[KEYS[i]];
+        }
+        builtTuning = tuning;
+        builtInstrument = &instrument;
+        generation++;
+    }
+
+    const std::size_t index = note % TuningTable::NOTES;
+    if (builtGenerations[index] != generation) {
+        build(instrument, index, params, tuning);
+        builtGenerations[index] = generation;
+    }
+    return plans[index];
+}
+
+bool VoicePlanCache::stale(const AdditiveMarimbaParameters &instrument,
+                           const ParameterSnapshot &params,
+                           const TuningTable *const tuning) const {
+    if (!generation || builtTuning != tuning || builtInstrument != &instrument) {
+        return true;
+    }
+    for (std::size_t i = 0; i < KEY_COUNT; i++) {
+        if (keyValues[i] != params[KEYS[i]]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void VoicePlanCache::build(const AdditiveMarimbaParameters &instrument,
+                           const std::size_t note,
+                           const ParameterSnapshot &params,
+                           const TuningTable *const tuning) {
+    /// Which harmonics to sound.
+    const float harmonics[AdditiveMarimbaParameters::OSCILLATOR_COUNT] = {
+        1,
+        params[MarimbaParameter::FirstOvertone],
+        params[MarimbaParameter::SecondOvertone],
+    };
+
+    VoicePlan &p = plans[note];
+    p.frequency = tuning->frequency(note);
+
+    /// Release time. Modelled linearly using `marimbaDecay`.
+    const float releaseTime = std::fmax(
+        marimbaDecay(note, params[MarimbaParameter::ReleaseTime]), 0.15f);
+
+    partialGains(instrument, note, params[MarimbaParameter::Hardness],
+                 params[MarimbaParameter::Brightness], p.gains);
+
+    for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+         i++) {
+        p.frequencies[i] = p.frequency * harmonics[i];
+        p.lengths[i][0] = params[MarimbaParameter::AttackTime] / harmonics[i];
+        p.lengths[i][1] = params[MarimbaParameter::DecayTime] / harmonics[i];
+        p.lengths[i][2] = releaseTime / harmonics[i];
+        // A zeroth harmonic has no pitch to display.
+        p.displayNotes[i] = p.frequencies[i] > 0.f
+                                ? freqToMidiNote(p.frequencies[i])
+                                : note;
+    }
+}
+
+}; // namespace kelon
@@ -0,0 +1,113 @@
+
+#include <kelon/marimba/pool.hpp>
+
+#include <map>
+
+#include <kelon/trace.hpp>
+
+namespace kelon {
+
+/// Mapping of steal policies to their identifiers.
+const std::map<StealPolicy, std::string> STEAL_POLICY_NAMES = {
+    {StealPolicy::Oldest, "oldest"},
+    {StealPolicy::Quietest, "quietest"},
+    {StealPolicy::SameNote, "same_note"},
+};
+
+const std::string &name(const StealPolicy &p) {
+    return STEAL_POLICY_NAMES.at(p);
+}
+
+bool parse(const std::string &s, StealPolicy &p) {
+    for (const auto &entry : STEAL_POLICY_NAMES) {
+        if (entry.second == s) {
+            p = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+VoicePool::VoicePool(al::PolySynth &s) : synth(s) {}
+
+/// Whether a voice struck through the pool is still sounding.
+static bool isSounding(MarimbaVoice *const voice) {
+    return voice && voice->active() && !voice->stolen();
+}
+
+unsigned int VoicePool::sounding() const {
+    unsigned int count = 0;
+    for (MarimbaVoice *const voice : struck) {
+        count += isSounding(voice);
+    }
+    return count;
+}
+
+void VoicePool::value(const MarimbaParameter &p, const float value,
+                      const unsigned int offset) {
+    for (MarimbaVoice *const voice : struck) {
+        if (isSounding(voice)) {
+            voice->schedule(p, value, offset);
+        }
+    }
+}
+
+void VoicePool::release(const unsigned char note) {
+    if (stealPolicy == StealPolicy::SameNote) {
+        for (MarimbaVoice *const voice : struck) {
+            if (isSounding(voice) && voice->id() == note) {
+                trace(TraceLevel::Debug, TraceEvent::VoiceSteal, voice->id(),
+                      note, 0.f);
+                voice->steal(DECLICK_FRAMES);
+            }
+        }
+    }
+
+    if (sounding() >= cap) {
+        MarimbaVoice *const voice = victim();
+        if (voice) {
+            trace(TraceLevel::Debug, TraceEvent::VoiceSteal, voice->id(),
+                  voice->id(), 0.f);
+            voice->steal(DECLICK_FRAMES);
+        }
+    }
+}
+
+void VoicePool::track(MarimbaVoice *const voice) {
+    voice->order(nextOrder++);
+
+    // Keep the voice's slot if it was struck before.
+    for (MarimbaVoice *const entry : struck) {
+        if (entry == voice) {
+            return;
+        }
+    }
+    // Otherwise take the slot of a voice that has been freed.
+    for (MarimbaVoice *&entry : struck) {
+        if (!entry || !entry->active()) {
+            entry = voice;
+            return;
+        }
+    }
+}
+
+MarimbaVoice *VoicePool::victim() const {
+    MarimbaVoice *chosen = nullptr;
+    for (MarimbaVoice *const voice : struck) {
+        if (!isSounding(voice)) {
+            continue;
+        }
+        if (!chosen) {
+            chosen = voice;
+        } else if (stealPolicy == StealPolicy::Quietest) {
+            if (voice->loudness() < chosen->loudness()) {
+                chosen = voice;
+            }
+        } else if (voice->order() < chosen->order()) {
+            chosen = voice;
+        }
+    }
+    return chosen;
+}
+
+}; // namespace kelon
@@ -0,0 +1,163 @@
+
+#include <kelon/marimba/preset.hpp>
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kelon {
+
+/// Identifies a binary preset bank.
+static const char PRESET_BANK_MAGIC[4] = {'K', 'L', 'N', 'P'};
+
+void PresetRecord::apply(ParameterSnapshot &snapshot) const {
+    for (std::size_t i = 0; i < PARAMETER_COUNT; i++) {
+        if (mask & (std::uint32_t(1) << i)) {
+            snapshot[MarimbaParameter(i)] = values[i];
+        }
+    }
+}
+
+bool parsePreset(std::istream &in, PresetRecord &record) {
+    std::memset(&record, 0, sizeof(record));
+
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 2, "::") == 0) {
+            if (line.size() == 2) {
+                // End of the preset.
+                break;
+            }
+            std::strncpy(record.name, line.c_str() + 2,
+                         PRESET_NAME_BYTES - 1);
+            continue;
+        }
+
+        std::istringstream entry(line);
+        std::string address, type;
+        float value;
+        if (!(entry >> address >> type >> value) || address.empty() ||
+            address[0] != '/' || type != "f") {
+            continue;
+        }
+        for (std::size_t i = 0; i < PARAMETER_COUNT; i++) {
+            if (name(MarimbaParameter(i)) == address.substr(1)) {
+                record.values[i] = value;
+                record.mask |= std::uint32_t(1) << i;
+                break;
+            }
+        }
+    }
+    return record.mask;
+}
+
+bool loadPresetMap(const std::string &path,
+                   std::vector<PresetRecord> &records) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+    const std::size_t slash = path.rfind('/');
+    const std::string directory =
+        slash == std::string::npos ? "" : path.substr(0, slash + 1);
+
+    std::string line;
+    while (std::getline(in, line)) {
+        const std::size_t colon = line.find(':');
+        if (colon == std::string::npos || colon == 0) {
+            // The map ends with `::`.
+            continue;
+        }
+        const std::string name = line.substr(colon + 1);
+        std::ifstream preset(directory + name + ".preset");
+        PresetRecord record;
+        if (preset && parsePreset(preset, record)) {
+            // The file name wins over the name inside it, as in allolib.
+            std::memset(record.name, 0, PRESET_NAME_BYTES);
+            std::strncpy(record.name, name.c_str(), PRESET_NAME_BYTES - 1);
+            records.push_back(record);
+        }
+    }
+    return true;
+}
+
+bool writePresetBank(std::ostream &out,
+                     const std::vector<PresetRecord> &records) {
+    PresetBankHeader header;
+    std::memcpy(header.magic, PRESET_BANK_MAGIC, sizeof(header.magic));
+    header.version = PRESET_BANK_VERSION;
+    header.parameters = PARAMETER_COUNT;
+    header.count = records.size();
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(records.data()),
+              records.size() * sizeof(PresetRecord));
+    return bool(out);
+}
+
+PresetBank::~PresetBank() { close(); }
+
+bool PresetBank::open(const std::string &path) {
+    close();
+
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) || std::size_t(status.st_size) <
+                                    sizeof(PresetBankHeader)) {
+        ::close(file);
+        return false;
+    }
+    void *const map =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping outlives the descriptor.
+    ::close(file);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const auto *const header = static_cast<const PresetBankHeader *>(map);
+    const std::size_t size = status.st_size;
+    if (std::memcmp(header->magic, PRESET_BANK_MAGIC, sizeof(header->magic)) ||
+        header->version != PRESET_BANK_VERSION ||
+        header->parameters != PARAMETER_COUNT ||
+        (size - sizeof(PresetBankHeader)) / sizeof(PresetRecord) <
+            header->count) {
+        munmap(map, size);
+        return false;
+    }
+
+    mapping = map;
+    bytes = size;
+    records = reinterpret_cast<const PresetRecord *>(header + 1);
+    count = header->count;
+    return true;
+}
+
+void PresetBank::close() {
+    if (mapping) {
+        munmap(mapping, bytes);
+    }
+    mapping = nullptr;
+    bytes = 0;
+    records = nullptr;
+    count = 0;
+}
+
+const PresetRecord *PresetBank::find(const std::string &name) const {
+    for (std::size_t i = 0; i < count; i++) {
+        if (!std::strncmp(records[i].name, name.c_str(), PRESET_NAME_BYTES)) {
+            return &records[i];
+        }
+    }
+    return nullptr;
+}
+
+}; // namespace kelon
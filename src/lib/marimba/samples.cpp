@@ -0,0 +1,590 @@
+
+#include <kelon/marimba/samples.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <al/io/al_AudioIOData.hpp>
+
+#include <kelon/block.hpp>
+#include <kelon/control.hpp>
+#include <kelon/cull.hpp>
+#include <kelon/marimba/plan.hpp>
+#include <kelon/marimba/pool.hpp>
+#include <kelon/meter.hpp>
+#include <kelon/util.hpp>
+
+namespace kelon {
+
+/// Identifies a sample bank.
+static const char SAMPLE_BANK_MAGIC[4] = {'K', 'L', 'N', 'S'};
+/// Extension of a cached bank.
+static const std::string SAMPLE_BANK_EXTENSION = ".samples";
+/// Frames rendered per block when rendering a bank.
+const unsigned int SAMPLE_RENDER_BLOCK = 512;
+/// Largest 16-bit sample.
+const float SAMPLE_FULL_SCALE = 32767.f;
+
+/// Parameters the sound of a note depends on, besides its amplitude and pan.
+static const MarimbaParameter SOUND_PARAMETERS[] = {
+    MarimbaParameter::Hardness,      MarimbaParameter::Brightness,
+    MarimbaParameter::AttackTime,    MarimbaParameter::DecayTime,
+    MarimbaParameter::ReleaseTime,   MarimbaParameter::FirstOvertone,
+    MarimbaParameter::SecondOvertone,
+};
+
+/// Seconds between checks for new requests.
+const double SAMPLE_POLL_SECONDS = 0.05;
+/// Seconds the requested parameters must stay the same before their bank is
+/// loaded.
+const double SAMPLE_SETTLE_SECONDS = 0.5;
+/// Seconds a replaced bank is kept for the notes still playing it.
+const double SAMPLE_RETIRE_SECONDS = MAX_SAMPLE_SECONDS + 1.;
+
+/// Additive voice rendering the notes of a bank. Never drawn.
+class BankVoice : public AdditiveMarimbaBase {
+public:
+    BankVoice(const AdditiveMarimbaParameters *const params)
+        : AdditiveMarimbaBase(params) {}
+    void publish(VoiceLevels &) override {}
+};
+
+/// Fold bytes into a 64-bit FNV-1a hash.
+static void hash(std::uint64_t &h, const void *const bytes,
+                 const std::size_t size) {
+    const auto *const b = static_cast<const unsigned char *>(bytes);
+    for (std::size_t i = 0; i < size; i++) {
+        h = (h ^ b[i]) * 0x100000001b3;
+    }
+}
+
+/// Fold a value into a 64-bit FNV-1a hash.
+template <class T> static void hash(std::uint64_t &h, const T &value) {
+    hash(h, &value, sizeof(value));
+}
+
+SampleBank::~SampleBank() {
+    if (mapping) {
+        munmap(mapping, bytes);
+    }
+}
+
+std::uint64_t SampleBank::key(const AdditiveMarimbaParameters &instrument,
+                              const ParameterSnapshot &params,
+                              const TuningTable *const tuning,
+                              const unsigned int sampleRate,
+                              const unsigned int layers) {
+    std::uint64_t h = 0xcbf29ce484222325;
+    hash(h, SAMPLE_BANK_VERSION);
+    hash(h, sampleRate);
+    hash(h, layers);
+    hash(h, controlPeriod());
+    hash(h, instrument.scaleAmplitude);
+
+    // The plans and partial gains hold everything the instrument, its
+    // parameters and the tuning contribute to each note.
+    VoicePlanCache cache;
+    cache.tuning(tuning);
+    for (std::size_t note = 0; note < TuningTable::NOTES; note++) {
+        const VoicePlan &plan = cache.plan(instrument, note, params);
+        hash(h, plan.frequencies);
+        hash(h, plan.lengths);
+        hash(h, plan.gains);
+
+        float gains[AdditiveMarimbaParameters::OSCILLATOR_COUNT];
+        partialGains(instrument, note, params[MarimbaParameter::Hardness],
+                     params[MarimbaParameter::Brightness], gains);
+        hash(h, gains);
+    }
+    return h;
+}
+
+bool SampleBank::load(const std::string &directory,
+                      const AdditiveMarimbaParameters &instrument,
+                      const ParameterSnapshot &params,
+                      const TuningTable *const tuning,
+                      const unsigned int layers) {
+    const std::uint64_t k =
+        key(instrument, params, tuning, std::lround(gam::sampleRate()),
+            std::max(layers, 1u));
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)k);
+    const std::string path =
+        directory + "/" + name + SAMPLE_BANK_EXTENSION;
+    if (open(path, k)) {
+        return true;
+    }
+
+    render(instrument, params, tuning, k, std::max(layers, 1u));
+
+    // Write to a temporary file first, so the cache never holds part of a
+    // bank.
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        out.write(reinterpret_cast<const char *>(image.data()), image.size());
+        if (!out) {
+            std::remove(temporary.c_str());
+            return false;
+        }
+    }
+    return !std::rename(temporary.c_str(), path.c_str());
+}
+
+bool SampleBank::matches(const ParameterSnapshot &params) const {
+    for (const MarimbaParameter p : SOUND_PARAMETERS) {
+        if (header->values[index(p)] != params[p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/// Whether notes struck with `a` and `b` sound alike, whatever their
+/// amplitude and pan.
+static bool soundAlike(const ParameterSnapshot &a, const ParameterSnapshot &b) {
+    for (const MarimbaParameter p : SOUND_PARAMETERS) {
+        if (a[p] != b[p]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SampleBank::open(const std::string &path, const std::uint64_t key) {
+    const int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat status;
+    if (fstat(file, &status) ||
+        std::size_t(status.st_size) < sizeof(SampleBankHeader)) {
+        ::close(file);
+        return false;
+    }
+    void *const map =
+        mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // The mapping outlives the descriptor.
+    ::close(file);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    const auto *const h = static_cast<const SampleBankHeader *>(map);
+    const std::size_t size = status.st_size;
+    const std::size_t expected =
+        sizeof(SampleBankHeader) +
+        std::size_t(h->layers) * TuningTable::NOTES * sizeof(SampleEntry) +
+        h->samples * sizeof(std::int16_t);
+    if (std::memcmp(h->magic, SAMPLE_BANK_MAGIC, sizeof(h->magic)) ||
+        h->version != SAMPLE_BANK_VERSION || h->key != key || !h->layers ||
+        size != expected) {
+        munmap(map, size);
+        return false;
+    }
+
+    mapping = map;
+    bytes = size;
+    use(static_cast<const unsigned char *>(map));
+    // Mark the bank used, for `trimSampleCache`.
+    utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+    return true;
+}
+
+void SampleBank::render(const AdditiveMarimbaParameters &instrument,
+                        const ParameterSnapshot &params,
+                        const TuningTable *const tuning,
+                        const std::uint64_t key, const unsigned int layers) {
+    const double sampleRate = gam::sampleRate();
+    const std::size_t maxFrames = std::size_t(MAX_SAMPLE_SECONDS * sampleRate);
+
+    std::unique_ptr<BankVoice> voice;
+    {
+        std::lock_guard<std::mutex> lock(gammaAllocation());
+        voice.reset(new BankVoice(&instrument));
+    }
+    voice->init();
+    // Plans are cached per bank, since the cache is not thread-safe.
+    VoicePlanCache cache;
+    cache.tuning(tuning);
+    voice->plans(&cache);
+    voice->adaptive(false);
+
+    al::AudioIOData io;
+    io.framesPerSecond(sampleRate);
+    io.framesPerBuffer(SAMPLE_RENDER_BLOCK);
+    io.channelsIn(0);
+    io.channelsOut(2);
+
+    std::vector<SampleEntry> table(TuningTable::NOTES * layers);
+    std::vector<std::int16_t> samples;
+    std::vector<float> note;
+    for (std::size_t n = 0; n < TuningTable::NOTES; n++) {
+        for (unsigned int l = 0; l < layers; l++) {
+            ParameterSnapshot strike = params;
+            strike[MarimbaParameter::Amplitude] = float(l + 1) / layers;
+            // Panned hard left, the left channel holds the note in mono.
+            strike[MarimbaParameter::Pan] = -1.f;
+            voice->assign(strike);
+            voice->id(n);
+            voice->triggerOn();
+
+            note.clear();
+            while (voice->active() && note.size() < maxFrames) {
+                io.zeroOut();
+                io.frame(0);
+                voice->onProcess(io);
+                const float *const left = io.outBuffer(0);
+                note.insert(note.end(), left, left + SAMPLE_RENDER_BLOCK);
+            }
+            if (voice->active()) {
+                // Cut the note off at the longest length, with a fade.
+                voice->free();
+                note.resize(maxFrames);
+                const std::size_t fade =
+                    std::min<std::size_t>(VoicePool::DECLICK_FRAMES, maxFrames);
+                for (std::size_t i = 0; i < fade; i++) {
+                    note[maxFrames - 1 - i] *= float(i) / fade;
+                }
+            }
+            // Drop the silence after the voice freed itself.
+            while (!note.empty() && note.back() == 0.f) {
+                note.pop_back();
+            }
+
+            SampleEntry &entry = table[n * layers + l];
+            entry.offset = samples.size();
+            entry.frames = note.size();
+            entry.peak = 0;
+            float peak = 0.f;
+            for (std::size_t i = 0; i < note.size(); i++) {
+                if (std::fabs(note[i]) > peak) {
+                    peak = std::fabs(note[i]);
+                    entry.peak = i;
+                }
+            }
+            entry.scale = peak / SAMPLE_FULL_SCALE;
+            const float inverse = peak > 0.f ? 1.f / entry.scale : 0.f;
+            for (const float sample : note) {
+                samples.push_back(std::int16_t(std::lrint(sample * inverse)));
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(gammaAllocation());
+        voice.reset();
+    }
+
+    SampleBankHeader h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, SAMPLE_BANK_MAGIC, sizeof(h.magic));
+    h.version = SAMPLE_BANK_VERSION;
+    h.layers = layers;
+    h.sampleRate = std::lround(sampleRate);
+    h.key = key;
+    h.samples = samples.size();
+    for (std::size_t i = 0; i < PARAMETER_COUNT; i++) {
+        h.values[i] = params[MarimbaParameter(i)];
+    }
+
+    const std::size_t tableBytes = table.size() * sizeof(SampleEntry);
+    const std::size_t sampleBytes = samples.size() * sizeof(std::int16_t);
+    image.resize(sizeof(h) + tableBytes + sampleBytes);
+    std::memcpy(image.data(), &h, sizeof(h));
+    std::memcpy(image.data() + sizeof(h), table.data(), tableBytes);
+    std::memcpy(image.data() + sizeof(h) + tableBytes, samples.data(),
+                sampleBytes);
+    use(image.data());
+}
+
+void SampleBank::use(const unsigned char *const b) {
+    header = reinterpret_cast<const SampleBankHeader *>(b);
+    entries = reinterpret_cast<const SampleEntry *>(header + 1);
+    data = reinterpret_cast<const std::int16_t *>(
+        entries + std::size_t(header->layers) * TuningTable::NOTES);
+}
+
+void trimSampleCache(const std::string &directory, const std::uint64_t limit) {
+    /// A bank in the cache.
+    struct Cached {
+        std::string path;
+        std::uint64_t bytes;
+        /// Time the bank was last written or mapped.
+        timespec used;
+    };
+
+    DIR *const dir = opendir(directory.c_str());
+    if (!dir) {
+        return;
+    }
+    std::vector<Cached> banks;
+    std::uint64_t total = 0;
+    const std::size_t suffix = SAMPLE_BANK_EXTENSION.size();
+    while (const dirent *const entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        if (name.size() <= suffix ||
+            name.compare(name.size() - suffix, suffix, SAMPLE_BANK_EXTENSION)) {
+            continue;
+        }
+        const std::string path = directory + "/" + name;
+        struct stat status;
+        if (stat(path.c_str(), &status) || !S_ISREG(status.st_mode)) {
+            continue;
+        }
+        banks.push_back({path, std::uint64_t(status.st_size), status.st_mtim});
+        total += status.st_size;
+    }
+    closedir(dir);
+
+    // Delete the least recently used first, and never the most recent. A
+    // deleted bank that is still mapped stays readable.
+    std::sort(banks.begin(), banks.end(),
+              [](const Cached &a, const Cached &b) {
+                  return a.used.tv_sec != b.used.tv_sec
+                             ? a.used.tv_sec < b.used.tv_sec
+                             : a.used.tv_nsec < b.used.tv_nsec;
+              });
+    for (std::size_t i = 0; i + 1 < banks.size() && total > limit; i++) {
+        if (!std::remove(banks[i].path.c_str())) {
+            total -= banks[i].bytes;
+        }
+    }
+}
+
+SampleLoader::~SampleLoader() {
+    if (worker.joinable()) {
+        stopping.store(true, std::memory_order_relaxed);
+        worker.join();
+    }
+}
+
+void SampleLoader::start(const AdditiveMarimbaParameters *const i,
+                         const std::string &d, const TuningTable *const t,
+                         const unsigned int l, const std::uint64_t c) {
+    instrument = i;
+    directory = d;
+    tuning = t;
+    layers = l;
+    cacheBytes = c;
+    worker = std::thread(&SampleLoader::run, this);
+}
+
+void SampleLoader::request(const ParameterSnapshot &params) {
+    if (pending.load(std::memory_order_relaxed) && params == requested) {
+        return;
+    }
+    requested = params;
+    requests.back() = params;
+    requests.publish();
+    pending.store(true, std::memory_order_release);
+}
+
+void SampleLoader::run() {
+    using Clock = std::chrono::steady_clock;
+    const auto retirement = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(SAMPLE_RETIRE_SECONDS));
+    const auto settling = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(SAMPLE_SETTLE_SECONDS));
+
+    /// Parameters requested last, and when they last changed.
+    ParameterSnapshot waiting;
+    Clock::time_point changed;
+    bool waited = false;
+
+    while (!stopping.load(std::memory_order_relaxed)) {
+        if (pending.load(std::memory_order_acquire)) {
+            const ParameterSnapshot params = requests.latest();
+            if (!waited || !soundAlike(params, waiting)) {
+                // Wait for the parameters to settle.
+                waiting = params;
+                changed = Clock::now();
+                waited = true;
+            } else if (Clock::now() - changed >= settling &&
+                       (!latest || !latest->matches(waiting))) {
+                std::unique_ptr<SampleBank> loaded(new SampleBank());
+                loaded->load(directory, *instrument, waiting, tuning, layers);
+                trimSampleCache(directory, cacheBytes);
+                current.store(loaded.get(), std::memory_order_release);
+                if (latest) {
+                    retired.emplace_back(std::move(latest), Clock::now());
+                }
+                latest = std::move(loaded);
+            }
+        }
+
+        // Free the banks replaced longer ago than any note rings.
+        const Clock::time_point now = Clock::now();
+        for (auto r = retired.begin(); r != retired.end();) {
+            r = now - r->second > retirement ? retired.erase(r) : r + 1;
+        }
+
+        std::this_thread::sleep_for(
+            std::chrono::duration<double>(SAMPLE_POLL_SECONDS));
+    }
+}
+
+SampledMarimbaBase::SampledMarimbaBase(
+    const AdditiveMarimbaParameters *const params)
+    : MarimbaVoice(), parameters(params) {}
+
+void SampledMarimbaBase::init() {
+    // Take the instrument's parameters, so snapshots and presets apply as to
+    // its synthesized voices.
+    createParameters(parameters->internalTriggerParameters);
+}
+
+void SampledMarimbaBase::onStrike() {
+    if (!sampleBank) {
+        // Nothing to play: the voice frees itself on its first block.
+        frames = 0;
+        position = 0;
+        blockPeak = 0.f;
+        return;
+    }
+    // The ID of the voice is the MIDI note it sounds.
+    const SampleBank &bank = *sampleBank;
+    const unsigned int layers = bank.layers();
+    const float velocity = std::fmax(value(MarimbaParameter::Amplitude), 0.f);
+
+    // Layer `l` was struck with amplitude `(l + 1) / layers`. Between two
+    // layers, crossfade so that the note scales with the velocity; outside
+    // them, scale the nearest layer.
+    const float layer = velocity * layers - 1.f;
+    unsigned int low;
+    float weight;
+    if (layer <= 0.f || layers == 1) {
+        low = 0;
+        weight = 0.f;
+    } else if (layer >= layers - 1) {
+        low = layers - 1;
+        weight = 0.f;
+    } else {
+        low = unsigned(layer);
+        weight = layer - low;
+    }
+    const SampleEntry &a = bank.entry(id(), low);
+    lower = bank.samples(a);
+    frames = a.frames;
+    peak = a.peak;
+    if (weight > 0.f) {
+        const SampleEntry &b = bank.entry(id(), low + 1);
+        upper = bank.samples(b);
+        lowerGain = a.scale * (1.f - weight);
+        upperGain = b.scale * weight;
+        frames = std::min(frames, b.frames);
+    } else {
+        // Play the one layer twice, the second time silently, so the loop
+        // does not branch.
+        upper = lower;
+        lowerGain = a.scale * velocity * layers / (low + 1);
+        upperGain = 0.f;
+    }
+
+    position = 0;
+    blockPeak = 0.f;
+    // Start at the pan of the first block.
+    panPosition = NAN;
+    spatial.reset();
+}
+
+void SampledMarimbaBase::onProcess(al::AudioIOData &io) {
+    if (defer(io)) {
+        // The parallel renderer will render this block.
+        return;
+    }
+    // Account the time spent rendering to this voice type.
+    const VoiceTimer timer(VoiceType::Sampled, io.framesPerBuffer());
+    // A sampled note's timbre is fixed when it is struck, so changes
+    // scheduled within the block are only kept for its parameters.
+    settle(io.framesPerBuffer());
+
+    float *const left = io.outBuffer(0);
+    float *const right = io.outBuffer(1);
+    // `al::AudioIOData::frame` is one before the voice's start offset.
+    const unsigned int start = io.frame() + 1;
+    const unsigned int span =
+        std::min(io.framesPerBuffer() - start, frames - position);
+
+    // Equal-power pan, read once per block and ramped to over the block.
+    float targets[2] = {panGains[0], panGains[1]};
+    const float pan = value(MarimbaParameter::Pan);
+    if (pan != panPosition) {
+        const float angle =
+            (std::fmax(std::fmin(pan, 1.f), -1.f) + 1.f) * float(M_PI) / 4.f;
+        targets[0] = std::cos(angle);
+        targets[1] = std::sin(angle);
+        if (std::isnan(panPosition)) {
+            panGains[0] = targets[0];
+            panGains[1] = targets[1];
+        }
+        panPosition = pan;
+    }
+    const float steps[2] = {span ? (targets[0] - panGains[0]) / span : 0.f,
+                            span ? (targets[1] - panGains[1]) / span : 0.f};
+    // Across a speaker layout, the gains are aimed the same way.
+    const bool spatialized = spatial.active();
+    if (spatialized) {
+        spatial.aim(pan, value(MarimbaParameter::Distance), span);
+    }
+
+    Scratch &buffers = scratch();
+    float level = 0.f;
+    for (unsigned int done = 0; done < span;) {
+        const unsigned int chunk = std::min(span - done, CHUNK_FRAMES);
+        float *const mono = buffers.mono;
+
+        // Crossfade the layers.
+        const std::int16_t *const a = lower + position + done;
+        const std::int16_t *const b = upper + position + done;
+        for (unsigned int i = 0; i < chunk; i++) {
+            mono[i] = a[i] * lowerGain + b[i] * upperGain;
+        }
+        for (unsigned int i = 0; i < chunk; i++) {
+            level = std::fmax(level, std::fabs(mono[i]));
+        }
+
+        // Fade out if stolen, then pan along the block's ramps.
+        fade(mono, chunk);
+        if (spatialized) {
+            spatial.accumulate(mono, chunk, io, start + done);
+        } else {
+            ramp(buffers.left, chunk, panGains[0] + done * steps[0],
+                 steps[0]);
+            ramp(buffers.right, chunk, panGains[1] + done * steps[1],
+                 steps[1]);
+            panAccumulate(mono, buffers.left, buffers.right, chunk,
+                          left + start + done, right + start + done);
+        }
+        done += chunk;
+    }
+    position += span;
+    panGains[0] = targets[0];
+    panGains[1] = targets[1];
+    blockPeak = level;
+
+    if (faded()) {
+        // The voice was stolen and has faded out.
+        return;
+    }
+    if (position >= frames) {
+        // The note has ended.
+        free();
+    } else if (position > peak && blockPeak < culler().floor()) {
+        // The rest of the note is masked by the mix.
+        culler().voiceCulled();
+        free();
+    }
+}
+
+}; // namespace kelon
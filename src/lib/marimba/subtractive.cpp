@@ -1,15 +1,39 @@
 
 #include <kelon/marimba/subtractive.hpp>
 
-#include <iostream>
-
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <kelon/block.hpp>
+#include <kelon/cull.hpp>
+#include <kelon/governor.hpp>
+#include <kelon/meter.hpp>
+#include <kelon/trace.hpp>
 #include <kelon/util.hpp>
 
 namespace kelon {
 
+/// Seed of the noise generator, offset by the note.
+const std::uint32_t NOISE_SEED = 0x6b656c6f;
+/// Harmonics of the oscillator in each quality tier.
+static const float HARMONICS[QUALITY_TIERS] = {12.f, 6.f, 1.f};
+/// Frequency above which harmonics are not worth rendering, in Hz.
+const float HARMONIC_CUTOFF = 16000.f;
+
+/**
+ * Most harmonics of a note that fit below both Nyquist and
+ * `HARMONIC_CUTOFF`, so high notes neither alias nor spend work on
+ * harmonics nobody hears. At least the fundamental is kept.
+ */
+static float harmonicBudget(const float frequency, const float sampleRate) {
+    const float cutoff = std::fmin(HARMONIC_CUTOFF, sampleRate / 2.f);
+    return std::fmax(std::floor(cutoff / frequency), 1.f);
+}
+
 SubtractiveMarimbaBase::SubtractiveMarimbaBase(
     const SubtractiveMarimbaParameters *const params)
-    : al::SynthVoice(), parameters(params) {}
+    : MarimbaVoice(), parameters(params) {}
 
 SubtractiveMarimbaBase::~SubtractiveMarimbaBase() {}
 
@@ -20,69 +44,168 @@ void SubtractiveMarimbaBase::init() {
                     SubtractiveMarimbaParameters::ENVELOPE_LEVELS[2],
                     SubtractiveMarimbaParameters::ENVELOPE_LEVELS[3]);
 
-    oscillator.harmonics(12);
+    harmonics = HARMONICS[0];
+    oscillator.harmonics(harmonics);
 
     // Set up the main parameters of the voice.
-    for (const auto &values : parameters->internalTriggerParameters) {
-        create(std::get<0>(values), *this, std::get<1>(values),
-               std::get<2>(values), std::get<3>(values));
-    }
+    createParameters(parameters->internalTriggerParameters);
 }
 
 void SubtractiveMarimbaBase::onProcess(al::AudioIOData &io) {
-    // Set values according to internal trigger parameter values.
+    if (defer(io)) {
+        // The parallel renderer will render this block.
+        return;
+    }
+    // Account the time spent rendering to this voice type.
+    const VoiceTimer timer(VoiceType::Subtractive, io.framesPerBuffer());
+
+    // Set values according to internal trigger parameter values. They are
+    // read once per block, with the changes scheduled within it, but the
+    // voice is only set up again when they change, so small blocks do not
+    // pay for it every time.
+    settle(io.framesPerBuffer());
+    const ParameterSnapshot params = parameterTable.snapshot();
+    if (!prepared || params != applied) {
+        prepare(params);
+    }
 
     /// Get the MIDI note we are playing from our voice ID.
     const unsigned char note = id();
     /// Location as a percent distance from C6.
     const float location = 1.f - float(note - C6) / float(C8 - C6);
 
-    std::cout << id() << "\t@\t" << midiNoteToFreq(id()) << std::endl;
-    oscillator.freq(midiNoteToFreq(note));
-    gam::real *const lengths = envelope.lengths();
-    lengths[0] = value(MarimbaParameter::AttackTime, *this);
-    lengths[1] = value(MarimbaParameter::DecayTime, *this);
-    lengths[2] =
-        marimbaDecay(note, value(MarimbaParameter::ReleaseTime, *this));
-
-    // Set parameters on the comb filter.
-    comb.set(value(MarimbaParameter::Delay, *this),
-             value(MarimbaParameter::Feedforward, *this),
-             value(MarimbaParameter::Feedback, *this));
-    comb.freq(freqToMidiNote(note));
-
-    // Set the pan.
-    pan.pos(value(MarimbaParameter::Pan, *this));
-
-    while (io()) {
-        // Generate a sample in mono.
+    trace(TraceLevel::Debug, TraceEvent::VoiceProcess, id(), note, frequency);
+    // Under load, thin the oscillator once the note's attack has passed.
+    const float h = std::fmin(
+        HARMONICS[envelope.stage() > 0 ? std::size_t(governor().tier()) : 0],
+        budget);
+    if (h != harmonics) {
+        harmonics = h;
+        oscillator.harmonics(harmonics);
+    }
 
-        static constexpr float NOISE_MIX = 0.1;
+    const float amplitude = params[MarimbaParameter::Amplitude];
 
-        /// Sample mixing oscillator output and noise.
-        float sampleLeft = oscillator() * (1 - NOISE_MIX) + noise() * NOISE_MIX;
+    // Equal-power gains of the pan, read off a unit sample.
+    float gainLeft, gainRight;
+    pan(1.f, gainLeft, gainRight);
 
-        sampleLeft = comb() * sampleLeft * envelope() *
-                     value(MarimbaParameter::Amplitude, *this);
+    static constexpr float NOISE_MIX = 0.1;
 
-        // Graphics follow the mono sample.
-        follower(sampleLeft);
+    float *const left = io.outBuffer(0);
+    float *const right = io.outBuffer(1);
+    const unsigned int frames = io.framesPerBuffer();
+    Scratch &buffers = scratch();
+    // `al::AudioIOData::frame` is one before the voice's start offset.
+    const unsigned int offset = io.frame() + 1;
 
-        float sampleRight;
-        pan(sampleLeft, sampleLeft, sampleRight);
+    // Across a speaker layout, the gains are aimed once per block.
+    const bool spatialized = spatial.active();
+    if (spatialized) {
+        spatial.aim(params[MarimbaParameter::Pan],
+                    params[MarimbaParameter::Distance],
+                    offset < frames ? frames - offset : 0);
+    }
 
-        io.out(0) += sampleLeft;
-        io.out(1) += sampleRight;
+    for (unsigned int start = offset; start < frames;) {
+        const unsigned int chunk = std::min(frames - start, CHUNK_FRAMES);
+        float *const mono = buffers.mono;
+        float *const stage = buffers.stage;
+
+        // Mix oscillator output and noise.
+        for (unsigned int i = 0; i < chunk; i++) {
+            mono[i] = oscillator() * (1 - NOISE_MIX) + noise() * NOISE_MIX;
+        }
+        // Resonate through the comb.
+        for (unsigned int i = 0; i < chunk; i++) {
+            mono[i] = comb() * mono[i];
+        }
+        // Shape by the envelope.
+        for (unsigned int i = 0; i < chunk; i++) {
+            stage[i] = envelope();
+        }
+        for (unsigned int i = 0; i < chunk; i++) {
+            mono[i] = mono[i] * stage[i] * amplitude;
+        }
+        // Graphics follow the mono output.
+        for (unsigned int i = 0; i < chunk; i++) {
+            follower(mono[i]);
+        }
+
+        // Fade out if stolen, then split the mono output into left and
+        // right, or across the speakers.
+        fade(mono, chunk);
+        if (spatialized) {
+            spatial.accumulate(mono, chunk, io, start);
+        } else {
+            panAccumulate(mono, gainLeft, gainRight, chunk, left + start,
+                          right + start);
+        }
+        start += chunk;
     }
 
-    // Wait for the envelope to be finished.
-    if (follower.done()) {
+    if (faded()) {
+        // The voice was stolen and has faded out.
+        return;
+    }
+    // Wait for the envelope to be finished, or for the voice to be masked by
+    // the mix once its attack has passed. The follower tracks the mean of
+    // the rectified output, which is 2 / pi of a sine's peak.
+    const bool masked = envelope.stage() > 0 && !follower.done() &&
+                        follower.value() * float(M_PI) / 2.f <
+                            culler().floor();
+    if (masked || follower.done()) {
         // Free the voice.
+        if (masked) {
+            culler().voiceCulled();
+        }
+        trace(TraceLevel::Debug, TraceEvent::VoiceFree, id(), note,
+              frequency);
         free();
     }
 }
 
-void SubtractiveMarimbaBase::onTriggerOn() { envelope.reset(); }
+void SubtractiveMarimbaBase::prepare(const ParameterSnapshot &params) {
+    const unsigned char note = id();
+
+    gam::real *const lengths = envelope.lengths();
+    lengths[0] = params[MarimbaParameter::AttackTime];
+    lengths[1] = params[MarimbaParameter::DecayTime];
+    lengths[2] = marimbaDecay(note, params[MarimbaParameter::ReleaseTime]);
+
+    // Set parameters on the comb filter.
+    comb.set(params[MarimbaParameter::Delay],
+             params[MarimbaParameter::Feedforward],
+             params[MarimbaParameter::Feedback]);
+    comb.freq(freqToMidiNote(note));
+
+    // Set the pan.
+    pan.pos(params[MarimbaParameter::Pan]);
+
+    applied = params;
+    prepared = true;
+}
+
+void SubtractiveMarimbaBase::onStrike() {
+    // The note's frequency is fixed for its length.
+    frequency = midiNoteToFreq(id());
+    trace(TraceLevel::Debug, TraceEvent::VoiceTrigger, id(), id(), frequency);
+    oscillator.freq(frequency);
+    budget = harmonicBudget(frequency, gam::sampleRate());
+    envelope.reset();
+    // Set the voice up from the parameters it is struck with.
+    prepared = false;
+
+    // Clear what the previous note left behind, so a note sounds the same
+    // whichever voice plays it.
+    oscillator.phase(0.f);
+    noise.seed(NOISE_SEED + id());
+    comb.zero();
+    follower.lpf.zero();
+    spatial.reset();
+}
+
+float SubtractiveMarimbaBase::loudness() const { return follower.value(); }
 
 void SubtractiveMarimbaBase::onTriggerOff() {}
 
@@ -1,9 +1,11 @@
 
 #include <kelon/marimba/visualization.hpp>
 
+#include <cstddef>
+
+#include <al/graphics/al_OpenGL.hpp>
 #include <al/graphics/al_Shapes.hpp>
 
-#include <iostream>
 #include <kelon/marimba/parameter.hpp>
 #include <kelon/util.hpp>
 
@@ -13,18 +15,106 @@ namespace kelon {
 /// overtone visualization.
 const unsigned int VISUAL_DIVISIONS = 8;
 
-MarimbaVisualizer::MarimbaVisualizer(const MarimbaRange *const range)
-    : playingRange(range) {}
-MarimbaVisualizer::~MarimbaVisualizer() {}
+/// Vertex attribute locations of the instance rectangle and color, clear of
+/// the ones `al::VAOMesh` uses.
+const unsigned int RECT_ATTRIBUTE = 6;
+const unsigned int COLOR_ATTRIBUTE = 7;
+
+/// Stretches the unit quad over each instance's rectangle, as
+/// `translate(x, y)` then `scale(width, height)` would.
+const char *const NOTE_VERTEX_SHADER = R"(
+#version 330
+uniform mat4 al_ModelViewMatrix;
+uniform mat4 al_ProjectionMatrix;
+
+layout (location = 0) in vec3 position;
+layout (location = 6) in vec4 rect;
+layout (location = 7) in vec4 color;
+
+out vec4 noteColor;
+
+void main() {
+    vec4 p = vec4(rect.xy + position.xy * rect.zw, position.z, 1.0);
+    gl_Position = al_ProjectionMatrix * al_ModelViewMatrix * p;
+    noteColor = color;
+}
+)";
+
+/// Fills each rectangle with its instance color.
+const char *const NOTE_FRAGMENT_SHADER = R"(
+#version 330
+in vec4 noteColor;
+
+layout (location = 0) out vec4 fragColor;
+
+void main() { fragColor = noteColor; }
+)";
+
+void NoteBatch::create() {
+    shader.compile(NOTE_VERTEX_SHADER, NOTE_FRAGMENT_SHADER);
+
+    al::addRect(quad, 0, 0, 1, 1);
+    quad.update();
+
+    buffer.bufferType(GL_ARRAY_BUFFER);
+    buffer.usage(GL_DYNAMIC_DRAW);
+    buffer.create();
+
+    // Step the rectangle and color once per instance rather than per vertex.
+    al::VAO &vao = quad.vao();
+    vao.bind();
+    vao.enableAttrib(RECT_ATTRIBUTE);
+    vao.attribPointer(RECT_ATTRIBUTE, buffer, 4, GL_FLOAT, GL_FALSE,
+                      sizeof(NoteInstance),
+                      (void *)offsetof(NoteInstance, x));
+    glVertexAttribDivisor(RECT_ATTRIBUTE, 1);
+    vao.enableAttrib(COLOR_ATTRIBUTE);
+    vao.attribPointer(COLOR_ATTRIBUTE, buffer, 4, GL_FLOAT, GL_FALSE,
+                      sizeof(NoteInstance),
+                      (void *)offsetof(NoteInstance, color));
+    glVertexAttribDivisor(COLOR_ATTRIBUTE, 1);
+    vao.unbind();
+
+    created = true;
+}
+
+void NoteBatch::draw(al::Graphics &g) {
+    if (instances.empty()) {
+        return;
+    }
+    if (!created) {
+        create();
+    }
+
+    g.shader(shader);
+    // Send the current matrices to the shader.
+    g.update();
+
+    buffer.bind();
+    buffer.data(instances.size() * sizeof(NoteInstance), instances.data());
+    quad.vao().bind();
+    glDrawArraysInstanced(GL_TRIANGLES, 0, quad.vertices().size(),
+                          instances.size());
+    quad.vao().unbind();
+    buffer.unbind();
+
+    instances.clear();
+}
 
-void MarimbaVisualizer::drawNoteVisual(
-    al::Graphics &g, const unsigned char midiNote, const float hardness,
-    const float amplitude, const float windowWidth, const float windowHeight,
-    const bool reverse) const {
+NoteBatch &noteBatch() {
+    static NoteBatch b;
+    return b;
+}
+
+/// Queue the visual associated with a given note in `noteBatch`.
+static void drawNoteVisual(const VoiceLevels &levels,
+                           const unsigned char midiNote, const float amplitude,
+                           const float windowWidth, const float windowHeight,
+                           const bool reverse) {
     // Offset the note to zero out at the minimum note.
-    const float offsetNote = midiNote - playingRange->first;
+    const float offsetNote = midiNote - levels.low;
     /// The range to display.
-    const float range = playingRange->second - playingRange->first;
+    const float range = levels.high - levels.low;
 
     /// Height of a divided portion of the window.
     const float divisionHeight = windowHeight / VISUAL_DIVISIONS;
@@ -40,19 +130,29 @@ void MarimbaVisualizer::drawNoteVisual(
     const float sat = 1 - reduceRange(offsetNote) / range;
     const float val = 1.f;
 
-    g.pushMatrix();
-    g.translate(x, divisionHeight - (reverse ? h : 0.f));
-    g.scale(w, h);
-
-    g.color(al::Color(al::HSV(hue, sat, val), amplitude * 30));
+    noteBatch().add({x, divisionHeight - (reverse ? h : 0.f), w, h,
+                     al::Color(al::HSV(hue, sat, val), amplitude * 30)});
+}
 
-    g.draw(mesh);
-    g.popMatrix();
+void drawLevels(const LevelSnapshot &snapshot, const float windowWidth,
+                const float windowHeight) {
+    for (std::size_t v = 0; v < snapshot.count; v++) {
+        const VoiceLevels &levels = snapshot.voices[v];
+        for (std::size_t i = 0; i < levels.partials; i++) {
+            drawNoteVisual(levels, levels.notes[i], levels.levels[i],
+                           windowWidth, windowHeight,
+                           levels.overtones >> i & 1);
+        }
+    }
 }
 
-void MarimbaVisualizer::init() {
-    // Initialize the visualization for the voice.
-    al::addRect(mesh, 0, 0, 1, 1);
+MarimbaVisualizer::MarimbaVisualizer(const MarimbaRange *const range)
+    : playingRange(range) {}
+MarimbaVisualizer::~MarimbaVisualizer() {}
+
+void MarimbaVisualizer::publishRange(VoiceLevels &levels) const {
+    levels.low = playingRange->first;
+    levels.high = playingRange->second;
 }
 
 AdditiveVisualizedMarimba::AdditiveVisualizedMarimba(
@@ -60,28 +160,21 @@ AdditiveVisualizedMarimba::AdditiveVisualizedMarimba(
     const MarimbaRange *const range)
     : AdditiveMarimbaBase(params), MarimbaVisualizer(range) {}
 
-void AdditiveVisualizedMarimba::init() {
-    AdditiveMarimbaBase::init();
-    MarimbaVisualizer::init();
-}
-
-void AdditiveVisualizedMarimba::onProcess(al::Graphics &g) {
-    /// Get the MIDI note from the voice ID.
-    const unsigned char note = id();
-
-    /// The harmonics sounded by the marimba.
-    const float harmonics[AdditiveMarimbaParameters::OSCILLATOR_COUNT] = {
-        1,
-        value(MarimbaParameter::FirstOvertone),
-        value(MarimbaParameter::SecondOvertone),
-    };
-
+void AdditiveVisualizedMarimba::publish(VoiceLevels &levels) {
+    levels.voice = id();
+    levels.note = id();
+    publishRange(levels);
+    levels.hardness = value(MarimbaParameter::Hardness);
+
+    // Each partial is displayed at the note of its frequency, taken from the
+    // plan of the note being played. Every partial but the first is an
+    // overtone.
+    levels.partials = AdditiveMarimbaParameters::OSCILLATOR_COUNT;
+    levels.overtones = ~std::uint32_t(1);
     for (std::size_t i = 0; i < AdditiveMarimbaParameters::OSCILLATOR_COUNT;
          i++) {
-        drawNoteVisual(g, freqToMidiNote(midiNoteToFreq(note) * harmonics[i]),
-                       value(MarimbaParameter::Hardness), followers[i].value(),
-                       value(MarimbaParameter::VisualWidth),
-                       value(MarimbaParameter::VisualHeight), i != 0);
+        levels.notes[i] = plan.displayNotes[i];
+        levels.levels[i] = level(i);
     }
 }
 
@@ -90,18 +183,36 @@ SubtractiveVisualizedMarimba::SubtractiveVisualizedMarimba(
     const MarimbaRange *const range)
     : SubtractiveMarimbaBase(params), MarimbaVisualizer(range) {}
 
-void SubtractiveVisualizedMarimba::init() {
-    SubtractiveMarimbaBase::init();
-    MarimbaVisualizer::init();
+void SubtractiveVisualizedMarimba::publish(VoiceLevels &levels) {
+    levels.voice = id();
+    levels.note = id();
+    publishRange(levels);
+    levels.hardness = 1.f;
+
+    // The voice is displayed at its note, as loud as its output.
+    levels.partials = 1;
+    levels.overtones = 0;
+    levels.notes[0] = id();
+    levels.levels[0] = follower.value();
 }
 
-void SubtractiveVisualizedMarimba::onProcess(al::Graphics &g) {
-    /// Get the MIDI note from the voice ID.
-    const unsigned char note = id();
-
-    drawNoteVisual(g, note, 1, follower.value(),
-                   value(MarimbaParameter::VisualWidth, *this),
-                   value(MarimbaParameter::VisualHeight, *this), false);
+SampledVisualizedMarimba::SampledVisualizedMarimba(
+    const AdditiveMarimbaParameters *const params,
+    const MarimbaRange *const range)
+    : SampledMarimbaBase(params), MarimbaVisualizer(range) {}
+
+void SampledVisualizedMarimba::publish(VoiceLevels &levels) {
+    levels.voice = id();
+    levels.note = id();
+    publishRange(levels);
+    levels.hardness = value(MarimbaParameter::Hardness);
+
+    // The partials are mixed in the samples, so the voice is displayed at
+    // its note, as loud as its output, scaled like an envelope follower.
+    levels.partials = 1;
+    levels.overtones = 0;
+    levels.notes[0] = id();
+    levels.levels[0] = blockPeak * 2.f / float(M_PI);
 }
 
 }; // namespace kelon
@@ -0,0 +1,78 @@
+
+#include <kelon/marimba/voice.hpp>
+
+#include <algorithm>
+
+#include <kelon/render.hpp>
+
+namespace kelon {
+
+float MarimbaVoice::value(const MarimbaParameter &p) const {
+    return parameterTable.get(p);
+}
+
+void MarimbaVoice::value(const MarimbaParameter &p, const float value) {
+    parameterTable.set(p, value);
+}
+
+void MarimbaVoice::schedule(const MarimbaParameter &p, const float value,
+                            const unsigned int offset) {
+    if (scheduledCount == MAX_SCHEDULED) {
+        // Every held change is due by the new one's frame.
+        settle(offset);
+    }
+    scheduled[scheduledCount++] = {p, value, offset};
+}
+
+bool MarimbaVoice::settle(const unsigned int frame) {
+    std::size_t due = 0;
+    while (due < scheduledCount && scheduled[due].offset <= frame) {
+        value(scheduled[due].parameter, scheduled[due].value);
+        due++;
+    }
+    if (!due) {
+        return false;
+    }
+    std::copy(scheduled + due, scheduled + scheduledCount, scheduled);
+    scheduledCount -= due;
+    return true;
+}
+
+ParameterSnapshot MarimbaVoice::snapshot() const {
+    return parameterTable.snapshot();
+}
+
+void MarimbaVoice::assign(const ParameterSnapshot &snapshot) {
+    parameterTable.assign(snapshot);
+}
+
+void MarimbaVoice::renderer(ParallelRenderer *const r) {
+    parallelRenderer = r;
+}
+
+void MarimbaVoice::steal(const unsigned int frames) {
+    fadeStep = fadeGain / (frames ? frames : 1);
+}
+
+void MarimbaVoice::onTriggerOn() {
+    // A stolen voice may also end, be culled or run out of samples before
+    // its fade does, and be freed with the fade half done.
+    fadeGain = 1.f;
+    fadeStep = 0.f;
+    scheduledCount = 0;
+    onStrike();
+}
+
+bool MarimbaVoice::faded() {
+    if (!stolen() || fadeGain > 0.f) {
+        return false;
+    }
+    free();
+    return true;
+}
+
+bool MarimbaVoice::defer(al::AudioIOData &io) {
+    return parallelRenderer && parallelRenderer->defer(*this, io);
+}
+
+}; // namespace kelon
@@ -0,0 +1,152 @@
+
+#include <kelon/meter.hpp>
+
+#include <map>
+
+namespace kelon {
+
+constexpr float DspMeter::NEAR_MISS_LOAD;
+
+/// Width of each block load bucket: 2.5% of the block period, so the
+/// histogram reaches 160%.
+const float LOAD_BUCKET = 0.025f;
+/// Width of each voice count bucket.
+const float VOICE_BUCKET = 4.f;
+
+void Histogram::record(const float value) {
+    const float bucket = value / bucketWidth;
+    const std::size_t i =
+        bucket >= BUCKETS - 1 ? BUCKETS - 1 : std::size_t(bucket);
+    counts[i].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Histogram::clear() {
+    for (auto &c : counts) {
+        c.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::uint64_t Histogram::total() const {
+    std::uint64_t sum = 0;
+    for (std::size_t i = 0; i < BUCKETS; i++) {
+        sum += count(i);
+    }
+    return sum;
+}
+
+float Histogram::quantile(const float p) const {
+    const std::uint64_t n = total();
+    if (!n) {
+        return 0.f;
+    }
+    const std::uint64_t rank = std::uint64_t(p * (n - 1)) + 1;
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < BUCKETS; i++) {
+        seen += count(i);
+        if (seen >= rank) {
+            return (i + 1) * bucketWidth;
+        }
+    }
+    return BUCKETS * bucketWidth;
+}
+
+/// Mapping of voice types to their identifiers.
+const std::map<VoiceType, std::string> VOICE_TYPE_NAMES = {
+    {VoiceType::Additive, "additive"},
+    {VoiceType::Subtractive, "subtractive"},
+    {VoiceType::Modal, "modal"},
+    {VoiceType::Sampled, "sampled"},
+};
+
+const std::string &name(const VoiceType &t) { return VOICE_TYPE_NAMES.at(t); }
+
+DspMeter::DspMeter()
+    : loadHistogram(LOAD_BUCKET), voiceHistogram(VOICE_BUCKET) {}
+
+void DspMeter::end(const unsigned int frames, const double sampleRate) {
+    const double elapsed = std::chrono::duration<double>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+    const float l = float(elapsed * sampleRate / frames);
+
+    loadHistogram.record(l);
+    voiceHistogram.record(blockVoices.exchange(0, std::memory_order_relaxed));
+    blockCount.fetch_add(1, std::memory_order_relaxed);
+    if (l > 1.f) {
+        missCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (l > NEAR_MISS_LOAD) {
+        nearMissCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    lastLoad.store(l, std::memory_order_relaxed);
+    if (l > peak()) {
+        peakLoad.store(l, std::memory_order_relaxed);
+    }
+}
+
+void DspMeter::voice(const VoiceType t, const std::int64_t nanoseconds,
+                     const unsigned int frames) {
+    voiceTime[std::size_t(t)].fetch_add(nanoseconds,
+                                        std::memory_order_relaxed);
+    voiceFrames[std::size_t(t)].fetch_add(frames, std::memory_order_relaxed);
+    blockVoices.fetch_add(1, std::memory_order_relaxed);
+}
+
+void DspMeter::reset() {
+    loadHistogram.clear();
+    voiceHistogram.clear();
+    blockCount.store(0, std::memory_order_relaxed);
+    missCount.store(0, std::memory_order_relaxed);
+    nearMissCount.store(0, std::memory_order_relaxed);
+    peakLoad.store(0.f, std::memory_order_relaxed);
+    for (std::size_t t = 0; t < VOICE_TYPES; t++) {
+        voiceTime[t].store(0, std::memory_order_relaxed);
+        voiceFrames[t].store(0, std::memory_order_relaxed);
+    }
+}
+
+void DspMeter::header(std::ostream &out) {
+    out << "seconds,blocks,misses,near_misses,load_p50,load_p99,load_peak,"
+           "voices_p50,voices_p99";
+    for (std::size_t t = 0; t < VOICE_TYPES; t++) {
+        const std::string &type = name(VoiceType(t));
+        out << "," << type << "_ns," << type << "_frames";
+    }
+    out << "\n";
+}
+
+void DspMeter::row(std::ostream &out, const double seconds) const {
+    out << seconds << "," << blocks() << "," << misses() << ","
+        << nearMisses() << "," << loads().quantile(0.5f) << ","
+        << loads().quantile(0.99f) << "," << peak() << ","
+        << voices().quantile(0.5f) << "," << voices().quantile(0.99f);
+    for (std::size_t t = 0; t < VOICE_TYPES; t++) {
+        out << "," << nanoseconds(VoiceType(t)) << ","
+            << frames(VoiceType(t));
+    }
+    out << "\n";
+}
+
+DspMeter &meter() {
+    static DspMeter m;
+    return m;
+}
+
+VoiceTimer::VoiceTimer(const VoiceType t, const unsigned int f)
+    : type(t), frames(f), timing(meter().enabled()) {
+    if (timing) {
+        start = std::chrono::steady_clock::now();
+    }
+}
+
+VoiceTimer::~VoiceTimer() {
+    if (timing) {
+        meter().voice(type,
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::steady_clock::now() - start)
+                          .count(),
+                      frames);
+    }
+}
+
+}; // namespace kelon
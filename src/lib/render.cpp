@@ -0,0 +1,223 @@
+
+#include <kelon/render.hpp>
+
+#include <chrono>
+#include <cstdlib>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace kelon {
+
+/// Iterations a waiting thread spins before yielding.
+const unsigned int SPIN_LIMIT = 4096;
+/// Iterations a waiting thread yields before sleeping between checks.
+const unsigned int YIELD_LIMIT = 256;
+/// How long an idle worker sleeps between checks.
+const std::chrono::microseconds IDLE_SLEEP{50};
+/// Iterations the calling thread spins, after rendering its own share, for
+/// the workers to pick up theirs before it renders them itself.
+const unsigned int HANDOFF_LIMIT = 1024;
+
+/// Hint to the processor that the thread is spinning.
+static inline void relax() {
+#if defined(__SSE2__)
+    _mm_pause();
+#endif
+}
+
+/// Wait for `done` to return true: spin, then yield, then sleep.
+template <class Predicate> static void await(const Predicate &done) {
+    for (unsigned int i = 0; !done(); i++) {
+        if (i < SPIN_LIMIT) {
+            relax();
+        } else if (i < SPIN_LIMIT + YIELD_LIMIT) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(IDLE_SLEEP);
+        }
+    }
+}
+
+ParallelRenderer::ParallelRenderer(const unsigned int threads,
+                                   const std::size_t minimumVoices)
+    : minimum(minimumVoices) {
+    for (unsigned int i = 1; i < threads; i++) {
+        workers.emplace_back(new Worker);
+    }
+    for (unsigned int i = 0; i < workers.size(); i++) {
+        workers[i]->thread = std::thread(&ParallelRenderer::run, this, i + 1);
+    }
+}
+
+ParallelRenderer::~ParallelRenderer() {
+    stopping.store(true, std::memory_order_release);
+    for (auto &worker : workers) {
+        worker->thread.join();
+    }
+}
+
+void ParallelRenderer::prepare(const int framesPerBuffer, const int channels,
+                               const double framesPerSecond) {
+    io.framesPerSecond(framesPerSecond);
+    io.framesPerBuffer(framesPerBuffer);
+    io.channelsIn(0);
+    io.channelsOut(channels);
+    for (auto &worker : workers) {
+        worker->io.framesPerSecond(framesPerSecond);
+        worker->io.framesPerBuffer(framesPerBuffer);
+        worker->io.channelsIn(0);
+        worker->io.channelsOut(channels);
+    }
+    preparedFrames = framesPerBuffer;
+    preparedChannels = channels;
+}
+
+bool ParallelRenderer::defer(MarimbaVoice &voice, const al::AudioIOData &io) {
+    // Voices rendered by `finish` render in place.
+    if (workers.empty() || dispatching.load(std::memory_order_relaxed) ||
+        jobCount == MAX_JOBS) {
+        return false;
+    }
+    // `al::PolySynth::render` shortens the block to a voice's end offset, so
+    // a voice cut short by one renders in place, as do blocks the buffers
+    // were not prepared for.
+    if (io.framesPerBuffer() != preparedFrames ||
+        io.channelsOut() != preparedChannels) {
+        return false;
+    }
+    // `al::AudioIOData::frame` is one before the voice's start offset.
+    jobs[jobCount++] = {&voice, io.frame() + 1};
+    return true;
+}
+
+void ParallelRenderer::finish(al::AudioIOData &out) {
+    if (!jobCount) {
+        return;
+    }
+    dispatching.store(true, std::memory_order_relaxed);
+
+    if (jobCount < minimum) {
+        // Too few voices to be worth waking the workers.
+        for (std::size_t i = 0; i < jobCount; i++) {
+            out.frame(jobs[i].start);
+            jobs[i].voice->onProcess(out);
+        }
+    } else {
+        const unsigned int count =
+            jobCount < threads() ? jobCount : threads();
+        participants.store(count, std::memory_order_relaxed);
+        for (unsigned int t = 1; t < count; t++) {
+            workers[t - 1]->share.store(Share::Waiting,
+                                        std::memory_order_release);
+        }
+        generation.fetch_add(1, std::memory_order_release);
+
+        renderShare(0, io);
+
+        // Give the workers a bounded time to pick up their shares, then
+        // render the shares still waiting in place, so a worker that is
+        // asleep or descheduled never holds up the block.
+        for (unsigned int i = 0; i < HANDOFF_LIMIT && waiting(count); i++) {
+            relax();
+        }
+        for (unsigned int t = 1; t < count; t++) {
+            renderClaimed(t);
+        }
+        // Shares the workers picked up are already rendering: wait for them
+        // without sleeping.
+        for (unsigned int t = 1; t < count; t++) {
+            const Worker &worker = *workers[t - 1];
+            for (unsigned int i = 0;
+                 worker.share.load(std::memory_order_acquire) != Share::Done;
+                 i++) {
+                if (i < SPIN_LIMIT) {
+                    relax();
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        // Mix down in thread order.
+        const int frames = out.framesPerBuffer();
+        for (int channel = 0; channel < preparedChannels; channel++) {
+            float *const mix = out.outBuffer(channel);
+            for (unsigned int t = 0; t < count; t++) {
+                const float *const buffer =
+                    (t ? workers[t - 1]->io : io).outBuffer(channel);
+                for (int frame = 0; frame < frames; frame++) {
+                    mix[frame] += buffer[frame];
+                }
+            }
+        }
+    }
+
+    jobCount = 0;
+    dispatching.store(false, std::memory_order_relaxed);
+}
+
+void ParallelRenderer::renderShare(const unsigned int index,
+                                   al::AudioIOData &buffers) {
+    const unsigned int count =
+        participants.load(std::memory_order_relaxed);
+    const std::size_t begin = jobCount * index / count;
+    const std::size_t end = jobCount * (index + 1) / count;
+
+    buffers.zeroOut();
+    for (std::size_t i = begin; i < end; i++) {
+        buffers.frame(jobs[i].start);
+        jobs[i].voice->onProcess(buffers);
+    }
+}
+
+bool ParallelRenderer::waiting(const unsigned int count) const {
+    for (unsigned int t = 1; t < count; t++) {
+        if (workers[t - 1]->share.load(std::memory_order_relaxed) ==
+            Share::Waiting) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ParallelRenderer::renderClaimed(const unsigned int index) {
+    Worker &worker = *workers[index - 1];
+    Share expected = Share::Waiting;
+    if (worker.share.compare_exchange_strong(expected, Share::Claimed,
+                                             std::memory_order_acq_rel)) {
+        renderShare(index, worker.io);
+        worker.share.store(Share::Done, std::memory_order_release);
+    }
+}
+
+void ParallelRenderer::run(const unsigned int index) {
+    // Start from the constructor's generation rather than the current one:
+    // a worker scheduled late must not miss the first dispatch.
+    unsigned int seen = 0;
+    while (true) {
+        await([&] {
+            return generation.load(std::memory_order_acquire) != seen ||
+                   stopping.load(std::memory_order_acquire);
+        });
+        if (stopping.load(std::memory_order_acquire)) {
+            return;
+        }
+        seen = generation.load(std::memory_order_acquire);
+
+        // The calling thread may have rendered this share already.
+        renderClaimed(index);
+    }
+}
+
+unsigned int defaultRenderThreads() {
+    const char *const threads = std::getenv("KELON_THREADS");
+    if (threads && std::atoi(threads) > 0) {
+        return std::atoi(threads);
+    }
+    const unsigned int hardware = std::thread::hardware_concurrency();
+    return hardware ? hardware : 1;
+}
+
+}; // namespace kelon
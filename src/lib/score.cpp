@@ -0,0 +1,244 @@
+
+#include <kelon/score.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+
+namespace kelon {
+
+/// Tempo of a MIDI file until it sets one, in microseconds per quarter note.
+const std::uint32_t DEFAULT_TEMPO = 500000;
+
+void Score::sort() {
+    std::stable_sort(notes.begin(), notes.end(),
+                     [](const ScoreNote &a, const ScoreNote &b) {
+                         return a.time < b.time;
+                     });
+}
+
+/// Read a big-endian integer of `bytes` bytes. Returns false at the end of
+/// the stream.
+static bool readBigEndian(std::istream &in, const unsigned int bytes,
+                          std::uint32_t &value) {
+    value = 0;
+    for (unsigned int i = 0; i < bytes; i++) {
+        const int c = in.get();
+        if (c == EOF) {
+            return false;
+        }
+        value = value << 8 | std::uint32_t(c);
+    }
+    return true;
+}
+
+/// Read a MIDI variable-length quantity from a track. Returns false if it
+/// runs past the end of the track.
+static bool readVariable(const std::string &track, std::size_t &position,
+                         std::uint32_t &value) {
+    value = 0;
+    for (unsigned int i = 0; i < 4; i++) {
+        if (position >= track.size()) {
+            return false;
+        }
+        const unsigned char c = track[position++];
+        value = value << 7 | (c & 0x7f);
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Note-on or tempo change at a tick of a MIDI file.
+struct MidiEvent {
+    std::uint64_t tick;
+    /// Tempo in microseconds per quarter note, or zero for a note.
+    std::uint32_t tempo;
+    unsigned char note;
+    unsigned char velocity;
+};
+
+/// Read the note-ons and tempo changes of a MIDI track.
+static bool parseTrack(const std::string &track,
+                       std::vector<MidiEvent> &events) {
+    std::uint64_t tick = 0;
+    unsigned char status = 0;
+    std::size_t position = 0;
+
+    while (position < track.size()) {
+        std::uint32_t delta;
+        if (!readVariable(track, position, delta) ||
+            position >= track.size()) {
+            return false;
+        }
+        tick += delta;
+
+        unsigned char byte = track[position];
+        if (byte & 0x80) {
+            status = byte;
+            position++;
+        } else if (!status) {
+            // Running status without a status to run on.
+            return false;
+        }
+
+        if (status == 0xff) {
+            // Meta event.
+            if (position >= track.size()) {
+                return false;
+            }
+            const unsigned char type = track[position++];
+            std::uint32_t length;
+            if (!readVariable(track, position, length) ||
+                position + length > track.size()) {
+                return false;
+            }
+            if (type == 0x51 && length == 3) {
+                const std::uint32_t tempo =
+                    std::uint32_t((unsigned char)track[position]) << 16 |
+                    std::uint32_t((unsigned char)track[position + 1]) << 8 |
+                    std::uint32_t((unsigned char)track[position + 2]);
+                events.push_back({tick, tempo ? tempo : DEFAULT_TEMPO, 0, 0});
+            } else if (type == 0x2f) {
+                // End of track.
+                return true;
+            }
+            position += length;
+            // Meta events cancel running status.
+            status = 0;
+        } else if (status == 0xf0 || status == 0xf7) {
+            // System exclusive.
+            std::uint32_t length;
+            if (!readVariable(track, position, length) ||
+                position + length > track.size()) {
+                return false;
+            }
+            position += length;
+            status = 0;
+        } else {
+            // Channel message. Program changes and channel pressure carry one
+            // data byte; the rest carry two.
+            const unsigned char kind = status & 0xf0;
+            const std::size_t length = kind == 0xc0 || kind == 0xd0 ? 1 : 2;
+            if (position + length > track.size()) {
+                return false;
+            }
+            const unsigned char note = track[position] & 0x7f;
+            const unsigned char velocity =
+                length > 1 ? track[position + 1] & 0x7f : 0;
+            // A note-on with zero velocity is a note-off.
+            if (kind == 0x90 && velocity) {
+                events.push_back({tick, 0, note, velocity});
+            }
+            position += length;
+        }
+    }
+    return true;
+}
+
+bool parseMidi(std::istream &in, Score &score) {
+    char id[4];
+    std::uint32_t length, format, tracks, division;
+    if (!in.read(id, 4) || std::string(id, 4) != "MThd" ||
+        !readBigEndian(in, 4, length) || length < 6 ||
+        !readBigEndian(in, 2, format) || !readBigEndian(in, 2, tracks) ||
+        !readBigEndian(in, 2, division) || !division) {
+        return false;
+    }
+    in.ignore(length - 6);
+
+    std::vector<MidiEvent> events;
+    for (std::uint32_t t = 0; t < tracks; t++) {
+        if (!in.read(id, 4) || !readBigEndian(in, 4, length)) {
+            return false;
+        }
+        std::string track(length, '\0');
+        if (!in.read(&track[0], length)) {
+            return false;
+        }
+        // Skip chunks that are not tracks.
+        if (std::string(id, 4) == "MTrk" && !parseTrack(track, events)) {
+            return false;
+        }
+    }
+
+    // Put tempo changes before notes at the same tick.
+    std::stable_sort(events.begin(), events.end(),
+                     [](const MidiEvent &a, const MidiEvent &b) {
+                         return a.tick < b.tick ||
+                                (a.tick == b.tick && a.tempo > b.tempo);
+                     });
+
+    // Seconds per tick: SMPTE divisions count ticks per frame, others ticks
+    // per quarter note.
+    const bool smpte = division & 0x8000;
+    const double smpteTick =
+        smpte ? 1. / (-std::int8_t(division >> 8) * double(division & 0xff))
+              : 0.;
+    double tickSeconds = smpte ? smpteTick : DEFAULT_TEMPO * 1e-6 / division;
+
+    double seconds = 0.;
+    std::uint64_t tick = 0;
+    for (const MidiEvent &e : events) {
+        seconds += (e.tick - tick) * tickSeconds;
+        tick = e.tick;
+        if (e.tempo) {
+            if (!smpte) {
+                tickSeconds = e.tempo * 1e-6 / division;
+            }
+        } else {
+            score.notes.push_back({seconds, e.note, e.velocity / 127.f, {}});
+        }
+    }
+    score.sort();
+    return true;
+}
+
+bool parseSequence(std::istream &in, Score &score) {
+    std::string line;
+    while (std::getline(in, line)) {
+        // Drop comments.
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream event(line);
+        std::string type;
+        if (!(event >> type) || type != "+") {
+            continue;
+        }
+
+        double time;
+        int id;
+        std::string synth;
+        if (!(event >> time >> id >> synth) || time < 0. || id < 0 ||
+            id > 127) {
+            return false;
+        }
+        ScoreNote note{time, (unsigned char)id, -1.f, {}};
+        float value;
+        while (event >> value) {
+            note.parameters.push_back(value);
+        }
+        score.notes.push_back(note);
+    }
+    score.sort();
+    return true;
+}
+
+bool loadScore(const std::string &path, Score &score) {
+    const std::size_t dot = path.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : path.substr(dot);
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](const char c) { return std::tolower(c); });
+
+    if (extension == ".mid" || extension == ".midi") {
+        std::ifstream in(path, std::ios::binary);
+        return in && parseMidi(in, score);
+    }
+    std::ifstream in(path);
+    return in && parseSequence(in, score);
+}
+
+}; // namespace kelon
@@ -0,0 +1,144 @@
+
+#include <kelon/spatial.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include <kelon/block.hpp>
+
+namespace kelon {
+
+/// Radians per degree.
+const float RADIANS_PER_DEGREE = float(M_PI) / 180.f;
+/// Decibels of a doubling of amplitude.
+const float DB_PER_DOUBLING = 6.0206f;
+
+unsigned int SpeakerLayout::channels() const {
+    unsigned int count = 0;
+    for (const Speaker &s : speakerList) {
+        count = std::max(count, s.channel + 1);
+    }
+    return count;
+}
+
+void SpeakerLayout::gains(const float pan, const float distance,
+                          float *const out) const {
+    const float azimuth = std::fmax(std::fmin(pan, 1.f), -1.f) * panSpread /
+                          2.f * RADIANS_PER_DEGREE;
+    const float reach = std::fmax(distance, 0.f);
+    const float x = reach * std::sin(azimuth);
+    const float y = reach * std::cos(azimuth);
+
+    // Gains fall by the rolloff per doubling of each speaker's distance from
+    // the blurred source, then are scaled so their powers sum to one.
+    const float exponent = -rolloffDb / DB_PER_DOUBLING / 2.f;
+    float power = 0.f;
+    for (std::size_t i = 0; i < speakerList.size(); i++) {
+        const Speaker &s = speakerList[i];
+        const float squared = (s.x - x) * (s.x - x) + (s.y - y) * (s.y - y) +
+                              s.z * s.z + SPATIAL_BLUR * SPATIAL_BLUR;
+        out[i] = std::pow(squared, exponent);
+        power += out[i] * out[i];
+    }
+    const float scale = power > 0.f ? 1.f / std::sqrt(power) : 0.f;
+    for (std::size_t i = 0; i < speakerList.size(); i++) {
+        out[i] *= scale;
+    }
+}
+
+bool parseLayout(std::istream &in, SpeakerLayout &layout) {
+    SpeakerLayout parsed;
+    std::string line;
+    while (std::getline(in, line)) {
+        std::istringstream entry(line);
+        std::string keyword;
+        if (!(entry >> keyword) || keyword[0] == '#') {
+            continue;
+        }
+
+        if (keyword == "speaker") {
+            int channel;
+            float azimuth, elevation, distance = 1.f;
+            if (!(entry >> channel >> azimuth >> elevation) || channel < 0 ||
+                parsed.speakerList.size() == MAX_SPEAKERS) {
+                return false;
+            }
+            if (!(entry >> distance)) {
+                distance = 1.f;
+            }
+            azimuth *= RADIANS_PER_DEGREE;
+            elevation *= RADIANS_PER_DEGREE;
+            const float across = distance * std::cos(elevation);
+            parsed.speakerList.push_back({unsigned(channel),
+                                          across * std::sin(azimuth),
+                                          across * std::cos(azimuth),
+                                          distance * std::sin(elevation)});
+        } else if (keyword == "spread") {
+            if (!(entry >> parsed.panSpread)) {
+                return false;
+            }
+        } else if (keyword == "rolloff") {
+            if (!(entry >> parsed.rolloffDb) || parsed.rolloffDb <= 0.f) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    if (parsed.empty()) {
+        return false;
+    }
+    layout = parsed;
+    return true;
+}
+
+bool loadLayout(const std::string &path, SpeakerLayout &layout) {
+    std::ifstream in(path);
+    return in && parseLayout(in, layout);
+}
+
+void SpatialGains::reset() { sourcePan = sourceDistance = NAN; }
+
+void SpatialGains::aim(const float pan, const float distance,
+                       const unsigned int frames) {
+    const std::size_t speakers = speakerLayout->size();
+    // The last block ended at its targets.
+    std::copy(targets, targets + speakers, current);
+    if (pan != sourcePan || distance != sourceDistance) {
+        speakerLayout->gains(pan, distance, targets);
+        if (std::isnan(sourcePan)) {
+            // The first block of a note starts at its gains.
+            std::copy(targets, targets + speakers, current);
+        }
+        sourcePan = pan;
+        sourceDistance = distance;
+    }
+
+    ramping = false;
+    for (std::size_t i = 0; i < speakers; i++) {
+        steps[i] = frames ? (targets[i] - current[i]) / frames : 0.f;
+        ramping = ramping || steps[i] != 0.f;
+    }
+}
+
+void SpatialGains::accumulate(const float *const mono,
+                              const unsigned int frames, al::AudioIOData &io,
+                              const unsigned int start) {
+    const std::vector<Speaker> &speakers = speakerLayout->speakers();
+    for (std::size_t i = 0; i < speakers.size(); i++) {
+        if (int(speakers[i].channel) >= io.channelsOut()) {
+            continue;
+        }
+        float *const out = io.outBuffer(speakers[i].channel) + start;
+        if (ramping) {
+            accumulateRamp(out, mono, frames, current[i], steps[i]);
+            current[i] += steps[i] * frames;
+        } else {
+            kelon::accumulate(out, mono, frames, current[i]);
+        }
+    }
+}
+
+}; // namespace kelon
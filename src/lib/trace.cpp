@@ -0,0 +1,142 @@
+
+#include <kelon/trace.hpp>
+
+#include <chrono>
+#include <map>
+
+#include <kelon/event.hpp>
+
+namespace kelon {
+
+/// Mapping of trace levels to their identifiers.
+const std::map<TraceLevel, std::string> TRACE_LEVEL_NAMES = {
+    {TraceLevel::Error, "error"},
+    {TraceLevel::Warning, "warning"},
+    {TraceLevel::Info, "info"},
+    {TraceLevel::Debug, "debug"},
+};
+
+/// Mapping of trace events to their identifiers.
+const std::map<TraceEvent, std::string> TRACE_EVENT_NAMES = {
+    {TraceEvent::VoiceTrigger, "trigger"},
+    {TraceEvent::VoiceProcess, "process"},
+    {TraceEvent::VoiceFree, "free"},
+    {TraceEvent::VoiceSteal, "steal"},
+    {TraceEvent::NoteDropped, "drop"},
+    {TraceEvent::QualityDrop, "degrade"},
+    {TraceEvent::QualityRecover, "recover"},
+    {TraceEvent::Dropped, "dropped"},
+};
+
+/// How long the drainer sleeps when the ring is empty.
+const std::chrono::milliseconds DRAIN_INTERVAL{10};
+
+const std::string &name(const TraceLevel &l) {
+    return TRACE_LEVEL_NAMES.at(l);
+}
+
+const std::string &name(const TraceEvent &e) {
+    return TRACE_EVENT_NAMES.at(e);
+}
+
+bool parse(const std::string &s, TraceLevel &l) {
+    for (const auto &entry : TRACE_LEVEL_NAMES) {
+        if (entry.second == s) {
+            l = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+Tracer::Tracer() : verbosity(std::uint8_t(TraceLevel::Warning)) {}
+
+Tracer::~Tracer() { stop(); }
+
+void Tracer::level(const TraceLevel l) {
+    verbosity.store(std::uint8_t(l), std::memory_order_relaxed);
+}
+
+TraceLevel Tracer::level() const {
+    return TraceLevel(verbosity.load(std::memory_order_relaxed));
+}
+
+void Tracer::record(const TraceLevel l, const TraceEvent e, const int voice,
+                    const unsigned char note, const float frequency) {
+    if (!ring.push({eventClock(), voice, frequency, l, e, note})) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Tracer::start(std::FILE *const out) {
+    if (running.exchange(true)) {
+        return;
+    }
+    output = out;
+    ownsOutput = false;
+    drainer = std::thread(&Tracer::run, this);
+}
+
+bool Tracer::start(const std::string &path) {
+    if (running.load()) {
+        return true;
+    }
+    std::FILE *const out = std::fopen(path.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    start(out);
+    ownsOutput = true;
+    return true;
+}
+
+void Tracer::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+    drainer.join();
+    drain();
+    std::fflush(output);
+    if (ownsOutput) {
+        std::fclose(output);
+    }
+    output = nullptr;
+}
+
+std::size_t Tracer::drain() {
+    std::size_t written = 0;
+
+    const std::uint32_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost) {
+        std::fprintf(output, "%.6f\t%s\t%s\t-1\t0\t%u\n", eventClock() / 1e9,
+                     name(TraceLevel::Warning).c_str(),
+                     name(TraceEvent::Dropped).c_str(), lost);
+        written++;
+    }
+
+    TraceRecord r;
+    while (ring.pop(r)) {
+        std::fprintf(output, "%.6f\t%s\t%s\t%d\t%u\t%g\n", r.timestamp / 1e9,
+                     name(r.level).c_str(), name(r.event).c_str(), r.voice,
+                     r.note, r.frequency);
+        written++;
+    }
+    return written;
+}
+
+void Tracer::run() {
+    while (running.load()) {
+        if (drain()) {
+            std::fflush(output);
+        } else {
+            std::this_thread::sleep_for(DRAIN_INTERVAL);
+        }
+    }
+}
+
+Tracer &tracer() {
+    static Tracer t;
+    return t;
+}
+
+}; // namespace kelon
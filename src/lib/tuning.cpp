@@ -0,0 +1,105 @@
+
+#include <kelon/tuning.hpp>
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <kelon/util.hpp>
+
+namespace kelon {
+
+TuningTable::TuningTable() {
+    for (std::size_t note = 0; note < NOTES; note++) {
+        frequencies[note] = midiNoteToFreq(note);
+    }
+}
+
+/// Read the next line of a Scala file that is not a comment.
+static bool nextLine(std::istream &in, std::string &line) {
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] != '!') {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Parse a Scala pitch: cents if it contains a period, otherwise a ratio or an
+ * integer. Returns false if the pitch is not a positive ratio.
+ */
+static bool parsePitch(const std::string &line, double &ratio) {
+    std::istringstream pitch(line);
+    std::string token;
+    if (!(pitch >> token)) {
+        return false;
+    }
+
+    if (token.find('.') != std::string::npos) {
+        ratio = std::pow(2., std::stod(token) / 1200.);
+        return true;
+    }
+
+    const std::size_t slash = token.find('/');
+    const double numerator = std::stod(token.substr(0, slash));
+    const double denominator =
+        slash == std::string::npos ? 1. : std::stod(token.substr(slash + 1));
+    if (numerator <= 0. || denominator <= 0.) {
+        return false;
+    }
+    ratio = numerator / denominator;
+    return true;
+}
+
+bool parseScala(std::istream &in, TuningTable &table,
+                const unsigned char baseNote, const float baseFrequency) {
+    std::string line;
+
+    // The description comes first, then the number of pitches.
+    if (!nextLine(in, line) || !nextLine(in, line)) {
+        return false;
+    }
+    const int count = std::atoi(line.c_str());
+    if (count <= 0) {
+        return false;
+    }
+
+    /// Ratios of every degree to degree 0. The last one is the period.
+    std::vector<double> ratios{1.};
+    try {
+        for (int i = 0; i < count; i++) {
+            double ratio;
+            if (!nextLine(in, line) || !parsePitch(line, ratio)) {
+                return false;
+            }
+            ratios.push_back(ratio);
+        }
+    } catch (const std::logic_error &) {
+        // `std::stod` could not read the pitch.
+        return false;
+    }
+
+    const double period = ratios.back();
+    for (std::size_t note = 0; note < TuningTable::NOTES; note++) {
+        const int steps = int(note) - baseNote;
+        // Round towards negative infinity so notes below the base wrap into
+        // the period below.
+        const int octave = steps >= 0 ? steps / count : (steps + 1) / count - 1;
+        const int degree = steps - octave * count;
+        table.frequency(note, float(baseFrequency * std::pow(period, octave) *
+                                    ratios[degree]));
+    }
+    return true;
+}
+
+bool loadScala(const std::string &path, TuningTable &table,
+               const unsigned char baseNote, const float baseFrequency) {
+    std::ifstream in(path);
+    return in && parseScala(in, table, baseNote, baseFrequency);
+}
+
+}; // namespace kelon
@@ -23,4 +23,9 @@ float marimbaDecay(const unsigned char midiNote, const float baseDecay) {
     return baseDecay - 11.f * (midiNote - 52.f) / 360.f;
 }
 
+std::mutex &gammaAllocation() {
+    static std::mutex allocation;
+    return allocation;
+}
+
 }; // namespace kelon
@@ -0,0 +1,197 @@
+
+#include <kelon/wav.hpp>
+
+#include <cmath>
+#include <cstring>
+#include <map>
+
+namespace kelon {
+
+/// Mapping of sample formats to their identifiers.
+const std::map<SampleFormat, std::string> SAMPLE_FORMAT_NAMES = {
+    {SampleFormat::Pcm16, "pcm16"},
+    {SampleFormat::Pcm24, "pcm24"},
+    {SampleFormat::Float32, "float32"},
+};
+
+const std::string &name(const SampleFormat &f) {
+    return SAMPLE_FORMAT_NAMES.at(f);
+}
+
+bool parse(const std::string &s, SampleFormat &f) {
+    for (const auto &entry : SAMPLE_FORMAT_NAMES) {
+        if (entry.second == s) {
+            f = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Largest chunk size a RIFF header can hold.
+const std::uint64_t RIFF_LIMIT = 0xffffffff;
+/// Size of the `ds64` chunk body, without a table.
+const std::uint32_t DS64_BYTES = 28;
+/// Offset of the `JUNK` chunk reserved for `ds64`.
+const long DS64_OFFSET = 12;
+
+/// Append a little-endian integer of `bytes` bytes.
+static void putLittleEndian(std::vector<unsigned char> &out,
+                            const std::uint64_t value,
+                            const unsigned int bytes) {
+    for (unsigned int i = 0; i < bytes; i++) {
+        out.push_back((value >> (8 * i)) & 0xff);
+    }
+}
+
+/// Append a four-character code.
+static void putId(std::vector<unsigned char> &out, const char *const id) {
+    out.insert(out.end(), id, id + 4);
+}
+
+WavWriter::~WavWriter() { close(); }
+
+bool WavWriter::open(const std::string &path, const unsigned int channels,
+                     const unsigned int sampleRate, const SampleFormat format) {
+    close();
+    file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    channelCount = channels;
+    sampleFormat = format;
+    sampleBytes = format == SampleFormat::Pcm16 ? 2
+                  : format == SampleFormat::Pcm24 ? 3
+                                                  : 4;
+    frameCount = 0;
+    failed = false;
+    buffer.clear();
+    buffer.reserve(BUFFER_BYTES);
+
+    const bool isFloat = format == SampleFormat::Float32;
+    const std::uint32_t blockAlign = channels * sampleBytes;
+
+    // The sizes are filled in by `close`.
+    putId(buffer, "RIFF");
+    putLittleEndian(buffer, 0, 4);
+    putId(buffer, "WAVE");
+    // Reserve room for a `ds64` chunk in case the file outgrows RIFF.
+    putId(buffer, "JUNK");
+    putLittleEndian(buffer, DS64_BYTES, 4);
+    buffer.insert(buffer.end(), DS64_BYTES, 0);
+    // Non-PCM formats carry an empty extension.
+    putId(buffer, "fmt ");
+    putLittleEndian(buffer, isFloat ? 18 : 16, 4);
+    putLittleEndian(buffer, isFloat ? 3 : 1, 2);
+    putLittleEndian(buffer, channels, 2);
+    putLittleEndian(buffer, sampleRate, 4);
+    putLittleEndian(buffer, std::uint64_t(sampleRate) * blockAlign, 4);
+    putLittleEndian(buffer, blockAlign, 2);
+    putLittleEndian(buffer, sampleBytes * 8, 2);
+    if (isFloat) {
+        putLittleEndian(buffer, 0, 2);
+    }
+    putId(buffer, "data");
+    putLittleEndian(buffer, 0, 4);
+    dataOffset = buffer.size();
+
+    return flush();
+}
+
+bool WavWriter::write(const float *const samples, const std::size_t frames) {
+    if (!file) {
+        return false;
+    }
+
+    const std::size_t count = frames * channelCount;
+    for (std::size_t i = 0; i < count; i++) {
+        if (buffer.size() + sampleBytes > BUFFER_BYTES && !flush()) {
+            return false;
+        }
+
+        const float sample = samples[i];
+        switch (sampleFormat) {
+        case SampleFormat::Pcm16:
+            putLittleEndian(
+                buffer,
+                std::uint16_t(std::lrint(
+                    std::fmax(std::fmin(sample, 1.f), -1.f) * 32767.f)),
+                2);
+            break;
+        case SampleFormat::Pcm24:
+            putLittleEndian(
+                buffer,
+                std::uint32_t(std::lrint(
+                    std::fmax(std::fmin(sample, 1.f), -1.f) * 8388607.f)),
+                3);
+            break;
+        case SampleFormat::Float32: {
+            std::uint32_t bits;
+            std::memcpy(&bits, &sample, sizeof(bits));
+            putLittleEndian(buffer, bits, 4);
+            break;
+        }
+        }
+    }
+    frameCount += frames;
+    return true;
+}
+
+bool WavWriter::flush() {
+    if (!buffer.empty() &&
+        std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size()) {
+        failed = true;
+    }
+    buffer.clear();
+    return !failed;
+}
+
+bool WavWriter::close() {
+    if (!file) {
+        return true;
+    }
+
+    const std::uint64_t dataBytes = frameCount * channelCount * sampleBytes;
+    // Chunks are padded to an even size.
+    if (dataBytes & 1) {
+        buffer.push_back(0);
+    }
+    flush();
+
+    const std::uint64_t riffBytes =
+        dataOffset - 8 + dataBytes + (dataBytes & 1);
+    const bool rf64 = riffBytes > RIFF_LIMIT;
+
+    std::vector<unsigned char> header;
+    putId(header, rf64 ? "RF64" : "RIFF");
+    putLittleEndian(header, rf64 ? RIFF_LIMIT : riffBytes, 4);
+    bool ok = !std::fseek(file, 0, SEEK_SET) &&
+              std::fwrite(header.data(), 1, header.size(), file) ==
+                  header.size();
+
+    if (rf64) {
+        // Turn the reserved `JUNK` chunk into `ds64`, which holds the real
+        // sizes.
+        header.clear();
+        putId(header, "ds64");
+        putLittleEndian(header, DS64_BYTES, 4);
+        putLittleEndian(header, riffBytes, 8);
+        putLittleEndian(header, dataBytes, 8);
+        putLittleEndian(header, frameCount, 8);
+        putLittleEndian(header, 0, 4);
+        ok = ok && !std::fseek(file, DS64_OFFSET, SEEK_SET) &&
+             std::fwrite(header.data(), 1, header.size(), file) ==
+                 header.size();
+    }
+
+    header.clear();
+    putLittleEndian(header, rf64 ? RIFF_LIMIT : dataBytes, 4);
+    ok = ok && !std::fseek(file, dataOffset - 4, SEEK_SET) &&
+         std::fwrite(header.data(), 1, header.size(), file) == header.size();
+
+    ok = !std::fclose(file) && ok && !failed;
+    file = nullptr;
+    return ok;
+}
+
+}; // namespace kelon
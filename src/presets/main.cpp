@@ -0,0 +1,60 @@
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <kelon/marimba/preset.hpp>
+
+/// Print usage information.
+static void usage(const char *const program) {
+    std::cerr << "Usage: " << program << " OUTPUT INPUT...\n"
+              << "Compile text presets into a binary preset bank. Each INPUT "
+                 "is a .preset file,\n"
+              << "or a .presetMap whose presets are read in order.\n";
+}
+
+/// Whether `s` ends with `suffix`.
+static bool endsWith(const std::string &s, const std::string &suffix) {
+    return s.size() >= suffix.size() &&
+           s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    std::vector<kelon::PresetRecord> records;
+    for (int i = 2; i < argc; i++) {
+        const std::string path = argv[i];
+        if (endsWith(path, ".presetMap")) {
+            if (!kelon::loadPresetMap(path, records)) {
+                std::cerr << "Could not read preset map " << path << "."
+                          << std::endl;
+                return 1;
+            }
+            continue;
+        }
+
+        std::ifstream in(path);
+        kelon::PresetRecord record;
+        if (!in || !kelon::parsePreset(in, record)) {
+            std::cerr << "Could not read preset " << path << "." << std::endl;
+            return 1;
+        }
+        records.push_back(record);
+    }
+
+    std::ofstream out(argv[1], std::ios::binary);
+    if (!out || !kelon::writePresetBank(out, records)) {
+        std::cerr << "Could not write " << argv[1] << "." << std::endl;
+        return 1;
+    }
+    for (const auto &record : records) {
+        std::cerr << "Compiled " << record.name << "." << std::endl;
+    }
+
+    return 0;
+}
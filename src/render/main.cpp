@@ -0,0 +1,139 @@
+#include "offline.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <kelon/control.hpp>
+#include <kelon/render.hpp>
+#include <kelon/score.hpp>
+#include <kelon/wav.hpp>
+
+/// Print usage information.
+static void usage(const char *const program) {
+    std::cerr
+        << "Usage: " << program << " [options] SCORE OUTPUT\n"
+        << "Render a MIDI file or a synth sequence to a WAV file, faster than "
+           "real time.\n\n"
+        << "  -i, --instrument NAME   additive_marimba, additive_xylophone,\n"
+        << "                          subtractive_marimba, modal_marimba or\n"
+        << "                          modal_xylophone\n"
+        << "                          (additive_marimba)\n"
+        << "  -e, --engine NAME       voices, or bank to synthesize the "
+           "additive\n"
+        << "                          instruments with a voice bank "
+           "(voices)\n"
+        << "  -r, --rate RATE         sampling rate (48000)\n"
+        << "  -b, --block FRAMES      frames per block (64)\n"
+        << "  -t, --threads COUNT     segments rendered at once, 1 for serial "
+           "(all cores)\n"
+        << "  -f, --format FORMAT     pcm16, pcm24 or float32 (pcm24)\n"
+        << "  -k, --control FRAMES    frames between control-rate updates "
+           "(32)\n"
+        << "  -l, --tail SECONDS      longest ring after the last note (30)\n"
+        << "  -h, --help              print this help\n";
+}
+
+int main(int argc, char **argv) {
+    kelon::OfflineConfig config;
+    config.threads = kelon::defaultRenderThreads();
+    kelon::SampleFormat format = kelon::SampleFormat::Pcm24;
+    const char *paths[2] = {nullptr, nullptr};
+    int pathCount = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char *const arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help")) {
+            usage(argv[0]);
+            return 0;
+        } else if (arg[0] != '-') {
+            if (pathCount == 2) {
+                usage(argv[0]);
+                return 1;
+            }
+            paths[pathCount++] = arg;
+        } else if (!hasValue) {
+            usage(argv[0]);
+            return 1;
+        } else if (!std::strcmp(arg, "-i") ||
+                   !std::strcmp(arg, "--instrument")) {
+            if (!kelon::parse(argv[++i], config.instrument)) {
+                std::cerr << "Unknown instrument " << argv[i] << "."
+                          << std::endl;
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "-e") || !std::strcmp(arg, "--engine")) {
+            if (!kelon::parse(argv[++i], config.engine)) {
+                std::cerr << "Unknown engine " << argv[i] << "." << std::endl;
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "-r") || !std::strcmp(arg, "--rate")) {
+            config.sampleRate = std::atof(argv[++i]);
+        } else if ((!std::strcmp(arg, "-b") || !std::strcmp(arg, "--block")) &&
+                   std::atoi(argv[i + 1]) > 0) {
+            config.blockSize = std::atoi(argv[++i]);
+        } else if ((!std::strcmp(arg, "-t") ||
+                    !std::strcmp(arg, "--threads")) &&
+                   std::atoi(argv[i + 1]) > 0) {
+            config.threads = std::atoi(argv[++i]);
+        } else if (!std::strcmp(arg, "-f") || !std::strcmp(arg, "--format")) {
+            if (!kelon::parse(argv[++i], format)) {
+                std::cerr << "Unknown sample format " << argv[i] << "."
+                          << std::endl;
+                return 1;
+            }
+        } else if (!std::strcmp(arg, "-k") || !std::strcmp(arg, "--control")) {
+            kelon::controlPeriod(std::atoi(argv[++i]));
+        } else if (!std::strcmp(arg, "-l") || !std::strcmp(arg, "--tail")) {
+            config.maxTail = std::atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (pathCount != 2 || config.sampleRate <= 0. || !config.blockSize ||
+        !config.threads) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    kelon::Score score;
+    if (!kelon::loadScore(paths[0], score)) {
+        std::cerr << "Could not read score " << paths[0] << "." << std::endl;
+        return 1;
+    }
+
+    kelon::WavWriter wav;
+    if (!wav.open(paths[1], 2, (unsigned int)config.sampleRate, format)) {
+        std::cerr << "Could not create " << paths[1] << "." << std::endl;
+        return 1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    kelon::OfflineStats stats;
+    const bool rendered = kelon::renderOffline(
+        score, config,
+        [&wav](const float *const samples, const std::size_t frames) {
+            return wav.write(samples, frames);
+        },
+        stats);
+    if (!wav.close() || !rendered) {
+        std::cerr << "Could not write " << paths[1] << "." << std::endl;
+        return 1;
+    }
+    const double wallTime = std::chrono::duration<double>(
+                                std::chrono::steady_clock::now() - start)
+                                .count();
+
+    const double seconds = stats.frames / config.sampleRate;
+    std::cerr << score.notes.size() << " notes, " << stats.frames
+              << " frames (" << seconds << " s) in " << stats.segments
+              << " segments with " << stats.merges << " merges, rendered in "
+              << wallTime << " s ("
+              << (wallTime > 0. ? seconds / wallTime : 0.)
+              << "x real time)" << std::endl;
+
+    return 0;
+}
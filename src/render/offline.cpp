@@ -0,0 +1,426 @@
+#include "offline.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <al/io/al_AudioIOData.hpp>
+#include <al/scene/al_PolySynth.hpp>
+
+#include <kelon/control.hpp>
+#include <kelon/marimba/bank.hpp>
+#include <kelon/marimba/instruments.hpp>
+#include <kelon/marimba/plan.hpp>
+#include <kelon/marimba/strike.hpp>
+#include <kelon/util.hpp>
+
+namespace kelon {
+
+/// Mapping of offline instruments to their identifiers.
+const std::map<OfflineInstrument, std::string> OFFLINE_INSTRUMENT_NAMES = {
+    {OfflineInstrument::AdditiveMarimba, "additive_marimba"},
+    {OfflineInstrument::AdditiveXylophone, "additive_xylophone"},
+    {OfflineInstrument::SubtractiveMarimba, "subtractive_marimba"},
+    {OfflineInstrument::ModalMarimba, "modal_marimba"},
+    {OfflineInstrument::ModalXylophone, "modal_xylophone"},
+};
+
+const std::string &name(const OfflineInstrument &i) {
+    return OFFLINE_INSTRUMENT_NAMES.at(i);
+}
+
+bool parse(const std::string &s, OfflineInstrument &i) {
+    for (const auto &entry : OFFLINE_INSTRUMENT_NAMES) {
+        if (entry.second == s) {
+            i = entry.first;
+            return true;
+        }
+    }
+    return false;
+}
+
+/// Longest segment, in seconds, so that a wave of segments fits in memory.
+const double MAX_SEGMENT_SECONDS = 60.;
+/// Time the subtractive marimba's envelope follower takes to settle after
+/// its envelope ends, in seconds.
+const double FOLLOWER_SECONDS = 0.5;
+
+/// A span of the timeline rendered by one synth.
+struct Segment {
+    /// First frame.
+    std::uint64_t start;
+    /// Frame after the last, or zero for the final segment, which rings
+    /// until its voices end.
+    std::uint64_t end;
+    /// Rendered interleaved frames.
+    std::vector<float> samples;
+    /// Whether `samples` holds the segment.
+    bool rendered;
+    /// Whether every voice ended before `end`.
+    bool valid;
+};
+
+/// Seconds an additive note rings: the longest envelope of its partials.
+static double ringLength(const AdditiveMarimbaParameters *const instrument,
+                         VoicePlanCache &cache, const unsigned char note,
+                         const ParameterSnapshot &params) {
+    const VoicePlan &plan = cache.plan(*instrument, note, params);
+    double length = 0.;
+    for (const auto &lengths : plan.lengths) {
+        length = std::max(length, double(lengths[0]) + lengths[1] + lengths[2]);
+    }
+    return length;
+}
+
+/// Seconds a subtractive note rings: its envelope, then its follower.
+static double ringLength(const SubtractiveMarimbaParameters *const,
+                         VoicePlanCache &, const unsigned char note,
+                         const ParameterSnapshot &params) {
+    return params[MarimbaParameter::AttackTime] +
+           params[MarimbaParameter::DecayTime] +
+           marimbaDecay(note, params[MarimbaParameter::ReleaseTime]) +
+           FOLLOWER_SECONDS;
+}
+
+/// Seconds a modal note rings: its fade-in, then until its slowest mode has
+/// fallen by 90 dB, when the voice frees itself.
+static double ringLength(const ModalMarimbaParameters *const instrument,
+                         VoicePlanCache &, const unsigned char note,
+                         const ParameterSnapshot &params) {
+    float decay = 0.f;
+    for (std::size_t k = 0; k < instrument->modeCount; k++) {
+        decay = std::max(decay, instrument->modes[k].decay);
+    }
+    const float decayTime = std::fmax(
+        marimbaDecay(note, params[MarimbaParameter::ReleaseTime]), 0.15f);
+    return params[MarimbaParameter::AttackTime] + 1.5 * decayTime * decay;
+}
+
+/// Place the notes of a score on the timeline with the parameters of
+/// `TVoice`, predicting when each one ends.
+template <class TVoice>
+static std::vector<Strike> predict(const Score &score,
+                                   const OfflineConfig &config) {
+    // Ringing is predicted with a margin of two blocks and a control period,
+    // for the block and period in which a voice notices it has ended.
+    const std::uint64_t margin = 2 * config.blockSize + controlPeriod();
+
+    VoicePlanCache cache;
+    std::vector<Strike> strikes =
+        place(score, TVoice::PARAMETERS->internalTriggerParameters,
+              config.sampleRate);
+    for (Strike &s : strikes) {
+        const double length =
+            ringLength(TVoice::PARAMETERS, cache, s.note, s.params);
+        s.end = s.frame + std::uint64_t(std::ceil(length * config.sampleRate)) +
+                margin;
+    }
+    return strikes;
+}
+
+/// Split the timeline into segments of about `target` frames, at block
+/// boundaries that no note is predicted to ring across.
+static std::vector<Segment> split(const std::vector<Strike> &strikes,
+                                  const unsigned int blockSize,
+                                  const std::uint64_t target) {
+    std::vector<Segment> segments;
+    std::uint64_t start = 0;
+    std::uint64_t ringing = 0;
+    for (const Strike &s : strikes) {
+        // The first block boundary after every earlier note has ended.
+        const std::uint64_t boundary =
+            (ringing + blockSize - 1) / blockSize * blockSize;
+        if (boundary > start && boundary <= s.frame &&
+            boundary - start >= target) {
+            segments.push_back({start, boundary, {}, false, false});
+            start = boundary;
+        }
+        ringing = std::max(ringing, s.end);
+    }
+    segments.push_back({start, 0, {}, false, false});
+    return segments;
+}
+
+/// Have an additive voice read plans from `cache`.
+static void usePlans(AdditiveMarimbaBase *const voice, VoicePlanCache &cache) {
+    voice->plans(&cache);
+}
+/// Other voices read no plans.
+static void usePlans(MarimbaVoice *const, VoicePlanCache &) {}
+
+/// Count the voices currently in the active list of `synth`.
+static unsigned int activeVoices(al::PolySynth &synth) {
+    unsigned int count = 0;
+    for (al::SynthVoice *voice = synth.getActiveVoices(); voice;
+         voice = voice->next) {
+        if (voice->active()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+/// Render a segment of the timeline with a fresh synth.
+template <class TVoice>
+static void renderSegment(const std::vector<Strike> &strikes,
+                          const OfflineConfig &config, Segment &segment) {
+    const unsigned int blockSize = config.blockSize;
+    const bool final = !segment.end;
+    const std::uint64_t lastStrike = strikes.empty() ? 0 : strikes.back().frame;
+    const std::uint64_t stop =
+        final ? lastStrike + std::uint64_t(config.maxTail * config.sampleRate)
+              : segment.end;
+
+    std::unique_ptr<al::PolySynth> synth;
+    {
+        std::lock_guard<std::mutex> lock(gammaAllocation());
+        synth.reset(new al::PolySynth());
+    }
+    // Plans are cached per segment, since the cache is not thread-safe.
+    VoicePlanCache cache;
+
+    al::AudioIOData io;
+    io.framesPerSecond(config.sampleRate);
+    io.framesPerBuffer(blockSize);
+    io.channelsIn(0);
+    io.channelsOut(2);
+
+    // The first note struck in the segment.
+    auto next = std::lower_bound(
+        strikes.begin(), strikes.end(), segment.start,
+        [](const Strike &s, const std::uint64_t f) { return s.frame < f; });
+
+    segment.samples.clear();
+    if (!final) {
+        segment.samples.reserve(2 * (segment.end - segment.start));
+    }
+    for (std::uint64_t frame = segment.start; frame < stop;
+         frame += blockSize) {
+        for (; next != strikes.end() && next->frame < frame + blockSize &&
+               (final || next->frame < segment.end);
+             ++next) {
+            TVoice *voice;
+            {
+                std::lock_guard<std::mutex> lock(gammaAllocation());
+                voice = synth->getVoice<TVoice>();
+            }
+            usePlans(voice, cache);
+            voice->assign(next->params);
+            synth->triggerOn(voice, int(next->frame - frame), next->note);
+        }
+
+        io.zeroOut();
+        io.frame(0);
+        synth->render(io);
+
+        const float *const left = io.outBuffer(0);
+        const float *const right = io.outBuffer(1);
+        for (unsigned int i = 0; i < blockSize; i++) {
+            segment.samples.push_back(left[i]);
+            segment.samples.push_back(right[i]);
+        }
+
+        if (final && next == strikes.end() && !activeVoices(*synth)) {
+            // The piece has rung out.
+            break;
+        }
+    }
+
+    segment.rendered = true;
+    segment.valid = final || !activeVoices(*synth);
+
+    std::lock_guard<std::mutex> lock(gammaAllocation());
+    synth.reset();
+}
+
+/// Render a segment of the timeline with a fresh voice bank, striking each
+/// note at its frame between the spans of a block the bank renders.
+template <class TVoice>
+static void renderBankSegment(const std::vector<Strike> &strikes,
+                              const OfflineConfig &config, Segment &segment) {
+    const unsigned int blockSize = config.blockSize;
+    const bool final = !segment.end;
+    const std::uint64_t lastStrike = strikes.empty() ? 0 : strikes.back().frame;
+    const std::uint64_t stop =
+        final ? lastStrike + std::uint64_t(config.maxTail * config.sampleRate)
+              : segment.end;
+
+    // The bank holds every partial inline, so keep it off the stack.
+    std::unique_ptr<AdditiveVoiceBank> bank(
+        new AdditiveVoiceBank(TVoice::PARAMETERS));
+    // Plans are cached per segment, since the cache is not thread-safe.
+    VoicePlanCache cache;
+    bank->plans(&cache);
+
+    al::AudioIOData io;
+    io.framesPerSecond(config.sampleRate);
+    io.framesPerBuffer(blockSize);
+    io.channelsIn(0);
+    io.channelsOut(2);
+
+    // The first note struck in the segment.
+    auto next = std::lower_bound(
+        strikes.begin(), strikes.end(), segment.start,
+        [](const Strike &s, const std::uint64_t f) { return s.frame < f; });
+
+    segment.samples.clear();
+    if (!final) {
+        segment.samples.reserve(2 * (segment.end - segment.start));
+    }
+    for (std::uint64_t frame = segment.start; frame < stop;
+         frame += blockSize) {
+        io.zeroOut();
+        unsigned int rendered = 0;
+        for (; next != strikes.end() && next->frame < frame + blockSize &&
+               (final || next->frame < segment.end);
+             ++next) {
+            const unsigned int offset = next->frame - frame;
+            bank->render(io, rendered, offset);
+            rendered = offset;
+            bank->trigger(next->note, next->params);
+        }
+        bank->render(io, rendered, blockSize);
+
+        const float *const left = io.outBuffer(0);
+        const float *const right = io.outBuffer(1);
+        for (unsigned int i = 0; i < blockSize; i++) {
+            segment.samples.push_back(left[i]);
+            segment.samples.push_back(right[i]);
+        }
+
+        if (final && next == strikes.end() && !bank->activeVoices()) {
+            // The piece has rung out.
+            break;
+        }
+    }
+
+    segment.rendered = true;
+    segment.valid = final || !bank->activeVoices();
+}
+
+/// Renders a segment of the timeline.
+using SegmentRenderer = void (*)(const std::vector<Strike> &,
+                                 const OfflineConfig &, Segment &);
+
+/// Render the segments of the timeline in waves of `config.threads`,
+/// passing them to `sink` in order.
+static bool renderSegments(const std::vector<Strike> &strikes,
+                           const OfflineConfig &config,
+                           std::vector<Segment> &segments,
+                           const SegmentRenderer renderer,
+                           const FrameSink &sink, OfflineStats &stats) {
+    const unsigned int threads = std::max(config.threads, 1u);
+
+    std::size_t first = 0;
+    while (first < segments.size()) {
+        // Render every segment of the wave that is not rendered yet.
+        std::vector<std::thread> workers;
+        const std::size_t wave =
+            std::min(segments.size(), first + std::size_t(threads));
+        for (std::size_t i = first; i < wave; i++) {
+            if (segments[i].rendered) {
+                continue;
+            }
+            if (threads == 1) {
+                renderer(strikes, config, segments[i]);
+            } else {
+                workers.emplace_back(renderer, std::cref(strikes),
+                                     std::cref(config), std::ref(segments[i]));
+            }
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        // Pass the segments on in order, until one has voices ringing past
+        // its end.
+        for (; first < wave; first++) {
+            Segment &segment = segments[first];
+            if (!segment.valid) {
+                // Merge it with the next segment and render both again.
+                Segment &following = segments[first + 1];
+                following.start = segment.start;
+                following.samples.clear();
+                following.samples.shrink_to_fit();
+                following.rendered = following.valid = false;
+                segments.erase(segments.begin() + first);
+                stats.merges++;
+                break;
+            }
+
+            const std::size_t frames = segment.samples.size() / 2;
+            if (!sink(segment.samples.data(), frames)) {
+                return false;
+            }
+            stats.frames += frames;
+            segment.samples.clear();
+            segment.samples.shrink_to_fit();
+        }
+    }
+    return true;
+}
+
+/// Render a score with the parameters of `TVoice`, segment by segment
+/// through `renderer`, by default with voices of `TVoice`.
+template <class TVoice>
+static bool render(const Score &score, const OfflineConfig &config,
+                   const FrameSink &sink, OfflineStats &stats,
+                   const SegmentRenderer renderer = renderSegment<TVoice>) {
+    const std::vector<Strike> strikes = predict<TVoice>(score, config);
+    if (strikes.empty()) {
+        return true;
+    }
+
+    // Aim for a segment per thread, within the memory budget.
+    const std::uint64_t length = std::max_element(
+                                     strikes.begin(), strikes.end(),
+                                     [](const Strike &a, const Strike &b) {
+                                         return a.end < b.end;
+                                     })
+                                     ->end;
+    const std::uint64_t target = std::min<std::uint64_t>(
+        length / std::max(config.threads, 1u),
+        std::uint64_t(MAX_SEGMENT_SECONDS * config.sampleRate));
+
+    std::vector<Segment> segments = split(strikes, config.blockSize, target);
+    stats.segments = segments.size();
+    return renderSegments(strikes, config, segments, renderer, sink, stats);
+}
+
+bool renderOffline(const Score &score, const OfflineConfig &config,
+                   const FrameSink &sink, OfflineStats &stats) {
+    stats = OfflineStats();
+    gam::sampleRate(config.sampleRate);
+
+    const bool banked = config.engine == AdditiveEngine::Bank;
+    switch (config.instrument) {
+    case OfflineInstrument::AdditiveXylophone:
+        if (banked) {
+            return render<AdditiveXylophone>(
+                score, config, sink, stats,
+                renderBankSegment<AdditiveXylophone>);
+        }
+        return render<AdditiveXylophone>(score, config, sink, stats);
+    case OfflineInstrument::SubtractiveMarimba:
+        return render<SubtractiveMarimba>(score, config, sink, stats);
+    case OfflineInstrument::ModalMarimba:
+        return render<EnsembleModalMarimba>(score, config, sink, stats);
+    case OfflineInstrument::ModalXylophone:
+        // With as many modes as the ensemble's modal marimba.
+        return render<ModalXylophone<EnsembleModalMarimba::MODE_COUNT>>(
+            score, config, sink, stats);
+    case OfflineInstrument::AdditiveMarimba:
+    default:
+        if (banked) {
+            return render<AdditiveMarimba>(score, config, sink, stats,
+                                           renderBankSegment<AdditiveMarimba>);
+        }
+        return render<AdditiveMarimba>(score, config, sink, stats);
+    }
+}
+
+}; // namespace kelon
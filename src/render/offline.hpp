@@ -0,0 +1,77 @@
+#ifndef KELON_OFFLINE_H
+#define KELON_OFFLINE_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include <kelon/marimba/bank.hpp>
+#include <kelon/score.hpp>
+
+namespace kelon {
+
+/// Instruments that can render a score.
+enum class OfflineInstrument {
+    AdditiveMarimba,
+    AdditiveXylophone,
+    SubtractiveMarimba,
+    ModalMarimba,
+    ModalXylophone,
+};
+
+/// Get the name of this offline instrument.
+const std::string &name(const OfflineInstrument &i);
+/// Parse an offline instrument name. Returns false if the name is unknown.
+bool parse(const std::string &s, OfflineInstrument &i);
+
+/// Settings of an offline render.
+struct OfflineConfig {
+    /// Instrument playing every note.
+    OfflineInstrument instrument = OfflineInstrument::AdditiveMarimba;
+    /// Engine synthesizing the additive instruments. The others always
+    /// render with voices.
+    AdditiveEngine engine = AdditiveEngine::Voices;
+    /// Sampling rate.
+    double sampleRate = 48000.;
+    /// Frames per block. Notes are struck at their exact frame within a
+    /// block.
+    unsigned int blockSize = 64;
+    /// Segments rendered at once. One renders serially.
+    unsigned int threads = 1;
+    /// Longest the piece may ring on after its last note, in seconds.
+    double maxTail = 30.;
+};
+
+/// Counters of an offline render.
+struct OfflineStats {
+    /// Frames written.
+    std::uint64_t frames = 0;
+    /// Segments the timeline was split into.
+    unsigned int segments = 0;
+    /// Segments rendered again because a voice outlasted their end.
+    unsigned int merges = 0;
+};
+
+/// Receives rendered interleaved stereo frames in order. Returns false to
+/// stop the render.
+using FrameSink = std::function<bool(const float *, std::size_t)>;
+
+/**
+ * Render a score with a single instrument, faster than real time.
+ *
+ * The timeline is split at block boundaries that no note is predicted to
+ * ring across, and up to `threads` segments are rendered at once, each by
+ * its own synth or voice bank. Since every note starts from the same state
+ * whichever voice plays it, a segment that starts in silence renders exactly
+ * like the same span of a serial render. A segment with voices still sounding at its
+ * end is merged with the next one and rendered again, so the output is
+ * bit-identical to a serial render whatever the thread count.
+ *
+ * Returns false if the sink stopped the render.
+ */
+bool renderOffline(const Score &score, const OfflineConfig &config,
+                   const FrameSink &sink, OfflineStats &stats);
+
+}; // namespace kelon
+
+#endif